@@ -38,6 +38,7 @@
 #include "convert_rgb.h"
 #include "convert_yv12.h"
 #include "convert_yuy2.h"
+#include "../core/RowBands.h"
 #include <avs/alignment.h>
 #include <avs/win.h>
 #include <avs/minmax.h>
@@ -552,42 +553,49 @@ PVideoFrame __stdcall ConvertToRGB::GetFrame(int n, IScriptEnvironment* env)
   PVideoFrame dst = env->NewVideoFrame(vi);
   const int dst_pitch = dst->GetPitch();
   BYTE* dstp = dst->GetWritePtr();
-  int tv_scale = theMatrix == Rec601 || theMatrix == Rec709 ? 16 : 0;
+  const int tv_scale = theMatrix == Rec601 || theMatrix == Rec709 ? 16 : 0;
+  const int cpu = env->GetCPUFlags();
 
+  // Output lines are converted in bands on several threads. Packed RGB is
+  // upside down, output lines [y_begin, y_end) come from the other end of the source.
+  RunRowBands(env, vi.height, 1, [&](int y_begin, int y_end) {
+    const BYTE* band_srcp = srcp + (vi.height - y_end) * src_pitch;
+    BYTE* band_dstp = dstp + y_begin * dst_pitch;
 
 #ifdef __SSE2__
-  if (env->GetCPUFlags() & CPUF_SSE2) {
-    if (vi.IsRGB32()) {
-      convert_yuy2_to_rgb_sse2<4>(srcp, dstp, src_pitch, dst_pitch, vi.height, vi.width,
-        crv_values[theMatrix], cgv_values[theMatrix], cgu_values[theMatrix], cbu_values[theMatrix], cy_values[theMatrix], tv_scale);
-    } else {
-      convert_yuy2_to_rgb_sse2<3>(srcp, dstp, src_pitch, dst_pitch, vi.height, vi.width,
-        crv_values[theMatrix], cgv_values[theMatrix], cgu_values[theMatrix], cbu_values[theMatrix], cy_values[theMatrix], tv_scale);
+    if (cpu & CPUF_SSE2) {
+      if (vi.IsRGB32()) {
+        convert_yuy2_to_rgb_sse2<4>(band_srcp, band_dstp, src_pitch, dst_pitch, y_end - y_begin, vi.width,
+          crv_values[theMatrix], cgv_values[theMatrix], cgu_values[theMatrix], cbu_values[theMatrix], cy_values[theMatrix], tv_scale);
+      } else {
+        convert_yuy2_to_rgb_sse2<3>(band_srcp, band_dstp, src_pitch, dst_pitch, y_end - y_begin, vi.width,
+          crv_values[theMatrix], cgv_values[theMatrix], cgu_values[theMatrix], cbu_values[theMatrix], cy_values[theMatrix], tv_scale);
+      }
     }
-  }
-  else
+    else
 #endif
 #ifdef X86_32
-  if (env->GetCPUFlags() & CPUF_INTEGER_SSE) {
-    if (vi.IsRGB32()) {
-      convert_yuy2_to_rgb_isse<4>(srcp, dstp, src_pitch, dst_pitch, vi.height, vi.width,
-        crv_values[theMatrix], cgv_values[theMatrix], cgu_values[theMatrix], cbu_values[theMatrix], cy_values[theMatrix], tv_scale);
-    } else {
-      convert_yuy2_to_rgb_isse<3>(srcp, dstp, src_pitch, dst_pitch, vi.height, vi.width,
-        crv_values[theMatrix], cgv_values[theMatrix], cgu_values[theMatrix], cbu_values[theMatrix], cy_values[theMatrix], tv_scale);
+    if (cpu & CPUF_INTEGER_SSE) {
+      if (vi.IsRGB32()) {
+        convert_yuy2_to_rgb_isse<4>(band_srcp, band_dstp, src_pitch, dst_pitch, y_end - y_begin, vi.width,
+          crv_values[theMatrix], cgv_values[theMatrix], cgu_values[theMatrix], cbu_values[theMatrix], cy_values[theMatrix], tv_scale);
+      } else {
+        convert_yuy2_to_rgb_isse<3>(band_srcp, band_dstp, src_pitch, dst_pitch, y_end - y_begin, vi.width,
+          crv_values[theMatrix], cgv_values[theMatrix], cgu_values[theMatrix], cbu_values[theMatrix], cy_values[theMatrix], tv_scale);
+      }
     }
-  }
-  else
+    else
 #endif
-  {
-    if (vi.IsRGB32()) {
-      convert_yuy2_to_rgb_c<4>(srcp, dstp, src_pitch, dst_pitch, vi.height, vi.width,
-        crv_values[theMatrix], cgv_values[theMatrix], cgu_values[theMatrix], cbu_values[theMatrix], cy_values[theMatrix], tv_scale);
-    } else {
-      convert_yuy2_to_rgb_c<3>(srcp, dstp, src_pitch, dst_pitch, vi.height, vi.width,
-        crv_values[theMatrix], cgv_values[theMatrix], cgu_values[theMatrix], cbu_values[theMatrix], cy_values[theMatrix], tv_scale);
+    {
+      if (vi.IsRGB32()) {
+        convert_yuy2_to_rgb_c<4>(band_srcp, band_dstp, src_pitch, dst_pitch, y_end - y_begin, vi.width,
+          crv_values[theMatrix], cgv_values[theMatrix], cgu_values[theMatrix], cbu_values[theMatrix], cy_values[theMatrix], tv_scale);
+      } else {
+        convert_yuy2_to_rgb_c<3>(band_srcp, band_dstp, src_pitch, dst_pitch, y_end - y_begin, vi.width,
+          crv_values[theMatrix], cgv_values[theMatrix], cgu_values[theMatrix], cbu_values[theMatrix], cy_values[theMatrix], tv_scale);
+      }
     }
-  }
+  });
   return dst;
 }
 
@@ -0,0 +1,183 @@
+// Avisynth v2.5.  Copyright 2009 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+// ConvertAudio AVX2 converters
+
+// experimental simd includes for avx2 compiled files
+#if defined (__GNUC__) && ! defined (__INTEL_COMPILER)
+#include <x86intrin.h>
+// x86intrin.h includes header files for whatever instruction
+// sets are specified on the compiler command line, such as: xopintrin.h, fma4intrin.h
+#else
+#include <immintrin.h> // MS version of immintrin.h covers AVX, AVX2 and FMA3
+#endif // __GNUC__
+
+#include <avisynth.h>
+#include "convert_audio_avx2.h"
+
+int convertToFloat_AVX2(const char* inbuf, float* outbuf, int sample_type, int count) {
+  int i = 0;
+  switch (sample_type) {
+    case SAMPLE_INT8: {
+      const __m256 divisor = _mm256_set1_ps(float(1.0 / 128));
+      const __m256i bias = _mm256_set1_epi32(128);
+      const unsigned char* samples = (const unsigned char*)inbuf;
+      for (; i + 16 <= count; i += 16) {
+        __m128i src = _mm_loadu_si128((const __m128i*)(samples + i));
+        __m256i lo = _mm256_sub_epi32(_mm256_cvtepu8_epi32(src), bias);
+        __m256i hi = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_srli_si128(src, 8)), bias);
+        _mm256_storeu_ps(outbuf + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(lo), divisor));
+        _mm256_storeu_ps(outbuf + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), divisor));
+      }
+      break;
+    }
+    case SAMPLE_INT16: {
+      const __m256 divisor = _mm256_set1_ps(float(1.0 / 32768));
+      const short* samples = (const short*)inbuf;
+      for (; i + 16 <= count; i += 16) {
+        __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(samples + i)));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(samples + i + 8)));
+        _mm256_storeu_ps(outbuf + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(lo), divisor));
+        _mm256_storeu_ps(outbuf + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), divisor));
+      }
+      break;
+    }
+    case SAMPLE_INT32: {
+      const __m256 divisor = _mm256_set1_ps(float(1.0 / (unsigned)(1<<31)));
+      const int* samples = (const int*)inbuf;
+      for (; i + 16 <= count; i += 16) {
+        __m256i lo = _mm256_loadu_si256((const __m256i*)(samples + i));
+        __m256i hi = _mm256_loadu_si256((const __m256i*)(samples + i + 8));
+        _mm256_storeu_ps(outbuf + i,     _mm256_mul_ps(_mm256_cvtepi32_ps(lo), divisor));
+        _mm256_storeu_ps(outbuf + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), divisor));
+      }
+      break;
+    }
+    case SAMPLE_INT24: {
+      const __m256 divisor = _mm256_set1_ps(float(1.0 / (unsigned)(1<<31)));
+      // three bytes of each sample to the top of a dword, four samples per lane
+      const __m256i shuf = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                            -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+      const unsigned char* samples = (const unsigned char*)inbuf;
+      // 16 byte loads on 12 byte steps: keep the last load inside the buffer
+      for (; i*3 + 28 <= count*3; i += 8) {
+        __m256i src = _mm256_inserti128_si256(
+          _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(samples + i*3))),
+          _mm_loadu_si128((const __m128i*)(samples + i*3 + 12)), 1);
+        _mm256_storeu_ps(outbuf + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_shuffle_epi8(src, shuf)), divisor));
+      }
+      break;
+    }
+  }
+  return i;
+}
+
+// Saturate_int8/16/24 for eight floats already scaled to the integer range
+static __forceinline __m256i saturate_ps_avx2(__m256 n, __m256 lo, __m256 hi, __m256 half) {
+  __m256i r = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_min_ps(_mm256_max_ps(n, lo), hi), half));
+  // n <= lo: min+0.5 truncates one above lo
+  return _mm256_add_epi32(r, _mm256_castps_si256(_mm256_cmp_ps(n, lo, _CMP_LE_OQ)));
+}
+
+int convertFromFloat_AVX2(const float* inbuf, void* outbuf, int sample_type, int count) {
+  const __m256 half = _mm256_set1_ps(0.5f);
+  int i = 0;
+  switch (sample_type) {
+    case SAMPLE_INT8: {
+      const __m256 scale = _mm256_set1_ps(128.0f);
+      const __m256 lo = _mm256_set1_ps(-128.0f);
+      const __m256 hi = _mm256_set1_ps(127.0f);
+      const __m256i bias = _mm256_set1_epi16(128);
+      unsigned char* samples = (unsigned char*)outbuf;
+      for (; i + 32 <= count; i += 32) {
+        __m256i r0 = saturate_ps_avx2(_mm256_mul_ps(_mm256_loadu_ps(inbuf + i),      scale), lo, hi, half);
+        __m256i r1 = saturate_ps_avx2(_mm256_mul_ps(_mm256_loadu_ps(inbuf + i + 8),  scale), lo, hi, half);
+        __m256i r2 = saturate_ps_avx2(_mm256_mul_ps(_mm256_loadu_ps(inbuf + i + 16), scale), lo, hi, half);
+        __m256i r3 = saturate_ps_avx2(_mm256_mul_ps(_mm256_loadu_ps(inbuf + i + 24), scale), lo, hi, half);
+        // packs and packus work per lane: the dwords come out as the low
+        // halves of r0..r3, then their high halves; put them back in order
+        __m256i w0 = _mm256_add_epi16(_mm256_packs_epi32(r0, r1), bias);
+        __m256i w1 = _mm256_add_epi16(_mm256_packs_epi32(r2, r3), bias);
+        __m256i b = _mm256_packus_epi16(w0, w1);
+        b = _mm256_permutevar8x32_epi32(b, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+        _mm256_storeu_si256((__m256i*)(samples + i), b);
+      }
+      break;
+    }
+    case SAMPLE_INT16: {
+      const __m256 scale = _mm256_set1_ps(32768.0f);
+      const __m256 lo = _mm256_set1_ps(-32768.0f);
+      const __m256 hi = _mm256_set1_ps(32767.0f);
+      short* samples = (short*)outbuf;
+      for (; i + 16 <= count; i += 16) {
+        __m256i r0 = saturate_ps_avx2(_mm256_mul_ps(_mm256_loadu_ps(inbuf + i),     scale), lo, hi, half);
+        __m256i r1 = saturate_ps_avx2(_mm256_mul_ps(_mm256_loadu_ps(inbuf + i + 8), scale), lo, hi, half);
+        __m256i w = _mm256_permute4x64_epi64(_mm256_packs_epi32(r0, r1), 0xD8);
+        _mm256_storeu_si256((__m256i*)(samples + i), w);
+      }
+      break;
+    }
+    case SAMPLE_INT32: {
+      const __m256 scale = _mm256_set1_ps((float)((unsigned)(1<<31)));
+      int* samples = (int*)outbuf;
+      for (; i + 8 <= count; i += 8) {
+        __m256 n = _mm256_mul_ps(_mm256_loadu_ps(inbuf + i), scale);
+        // out of range gives 0x80000000, flip it to 0x7fffffff at the top
+        __m256i r = _mm256_cvttps_epi32(_mm256_add_ps(n, half));
+        r = _mm256_xor_si256(r, _mm256_castps_si256(_mm256_cmp_ps(n, scale, _CMP_GE_OQ)));
+        _mm256_storeu_si256((__m256i*)(samples + i), r);
+      }
+      break;
+    }
+    case SAMPLE_INT24: {
+      const __m256 scale = _mm256_set1_ps((float)(1<<23));
+      const __m256 lo = _mm256_set1_ps((float)-(1<<23));
+      const __m256 hi = _mm256_set1_ps((float)((1<<23)-1));
+      // lower three bytes of each dword, packed into the low 12 bytes of a lane
+      const __m256i shuf = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+      unsigned char* samples = (unsigned char*)outbuf;
+      // two 16 byte stores on 12 byte steps, the second one overlaps by four
+      // bytes: keep it inside the buffer
+      for (; i*3 + 28 <= count*3; i += 8) {
+        __m256i r = saturate_ps_avx2(_mm256_mul_ps(_mm256_loadu_ps(inbuf + i), scale), lo, hi, half);
+        r = _mm256_shuffle_epi8(r, shuf);
+        _mm_storeu_si128((__m128i*)(samples + i*3),      _mm256_castsi256_si128(r));
+        _mm_storeu_si128((__m128i*)(samples + i*3 + 12), _mm256_extracti128_si256(r, 1));
+      }
+      break;
+    }
+  }
+  return i;
+}
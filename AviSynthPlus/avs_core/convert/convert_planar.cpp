@@ -40,6 +40,7 @@
 #include "../filters/resample.h"
 #include "../filters/planeswap.h"
 #include "../filters/field.h"
+#include "../core/RowBands.h"
 #include <avs/win.h>
 #include <avs/alignment.h>
 #include <tmmintrin.h>
@@ -2759,65 +2760,91 @@ void fill_plane(BYTE* dstp, int height, int pitch, pixel_t val)
 }
 
 
-PVideoFrame __stdcall ConvertToPlanarGeneric::GetFrame(int n, IScriptEnvironment* env) {
-  PVideoFrame src = child->GetFrame(n, env);
-  PVideoFrame dst = env->NewVideoFrame(vi);
+PVideoFrame __stdcall ConvertToPlanarGeneric::GetFrame(int n, IScriptEnvironment* env) {
+  PVideoFrame src = child->GetFrame(n, env);
+  PVideoFrame srcU, srcV;
+  if (!Yinput) {
+    srcU = Usource->GetFrame(n, env);
+    srcV = Vsource->GetFrame(n, env);
+  }
+  PVideoFrame dst = env->NewVideoFrame(vi);
 
-  env->BitBlt(dst->GetWritePtr(PLANAR_Y), dst->GetPitch(PLANAR_Y), src->GetReadPtr(PLANAR_Y), src->GetPitch(PLANAR_Y),
-              src->GetRowSize(PLANAR_Y_ALIGNED), src->GetHeight(PLANAR_Y));
-
-  // alpha. if pitch is zero -> no alpha channel
-  const int dst_pitchA = dst->GetPitch(PLANAR_A);
-  BYTE* dstp_a = (dst_pitchA == 0) ? nullptr : dst->GetWritePtr(PLANAR_A);
-  const int heightA = dst->GetHeight(PLANAR_A);
-
-  if (dst_pitchA != 0)
-  {
-    if (src->GetPitch(PLANAR_A) != 0)
-      env->BitBlt(dstp_a, dst_pitchA, src->GetReadPtr(PLANAR_A), src->GetPitch(PLANAR_A),
-        src->GetRowSize(PLANAR_A_ALIGNED), src->GetHeight(PLANAR_A));
-    else {
-      switch (vi.ComponentSize())
-      {
-      case 1:
-        fill_plane<BYTE>(dstp_a, heightA, dst_pitchA, 255);
-        break;
-      case 2:
-        fill_plane<uint16_t>(dstp_a, heightA, dst_pitchA, (1 << vi.BitsPerComponent()) - 1);
-        break;
-      case 4:
-        fill_plane<float>(dstp_a, heightA, dst_pitchA, 1.0f);
-        break;
-      }
-    }
-  }
-
-  BYTE* dstp_u = dst->GetWritePtr(PLANAR_U);
-  BYTE* dstp_v = dst->GetWritePtr(PLANAR_V);
-  const int height = dst->GetHeight(PLANAR_U);
-  const int dst_pitch = dst->GetPitch(PLANAR_U);
-
-  if (Yinput) {
-    switch (vi.ComponentSize())
-    {
-      case 1:
-        fill_chroma<BYTE>(dstp_u, dstp_v, height, dst_pitch, 0x80);
-        break;
-      case 2:
-        fill_chroma<uint16_t>(dstp_u, dstp_v, height, dst_pitch, 1 << (vi.BitsPerComponent() - 1));
-        break;
-      case 4:
-        fill_chroma<float>(dstp_u, dstp_v, height, dst_pitch, 0.5f);
-        break;
-    }
-  } else {
-    src = Usource->GetFrame(n, env);
-    env->BitBlt(dstp_u, dst_pitch, src->GetReadPtr(PLANAR_Y), src->GetPitch(PLANAR_Y), src->GetRowSize(PLANAR_Y_ALIGNED), height);
-    src = Vsource->GetFrame(n, env);
-    env->BitBlt(dstp_v, dst_pitch, src->GetReadPtr(PLANAR_Y), src->GetPitch(PLANAR_Y), src->GetRowSize(PLANAR_Y_ALIGNED), height);
-  }
-
-  return dst;
+  BYTE* dstp_y = dst->GetWritePtr(PLANAR_Y);
+  const int dst_pitch_y = dst->GetPitch(PLANAR_Y);
+  const BYTE* srcp_y = src->GetReadPtr(PLANAR_Y);
+  const int src_pitch_y = src->GetPitch(PLANAR_Y);
+  const int rowsize_y = src->GetRowSize(PLANAR_Y_ALIGNED);
+
+  // alpha. if pitch is zero -> no alpha channel
+  const int dst_pitchA = dst->GetPitch(PLANAR_A);
+  BYTE* dstp_a = (dst_pitchA == 0) ? nullptr : dst->GetWritePtr(PLANAR_A);
+  const int src_pitchA = src->GetPitch(PLANAR_A);
+  const BYTE* srcp_a = (src_pitchA == 0) ? nullptr : src->GetReadPtr(PLANAR_A);
+  const int rowsizeA = src->GetRowSize(PLANAR_A_ALIGNED);
+
+  BYTE* dstp_u = dst->GetWritePtr(PLANAR_U);
+  BYTE* dstp_v = dst->GetWritePtr(PLANAR_V);
+  const int dst_pitch = dst->GetPitch(PLANAR_U);
+  const BYTE* srcp_u = Yinput ? nullptr : srcU->GetReadPtr(PLANAR_Y);
+  const BYTE* srcp_v = Yinput ? nullptr : srcV->GetReadPtr(PLANAR_Y);
+  const int src_pitch_u = Yinput ? 0 : srcU->GetPitch(PLANAR_Y);
+  const int src_pitch_v = Yinput ? 0 : srcV->GetPitch(PLANAR_Y);
+  const int rowsize_uv = Yinput ? 0 : srcU->GetRowSize(PLANAR_Y_ALIGNED);
+
+  const int shift_h = vi.GetPlaneHeightSubsampling(PLANAR_U);
+  const int bits_per_pixel = vi.BitsPerComponent();
+
+  // Copy and fill the planes in bands on several threads, chroma rows along
+  // with the luma rows they belong to
+  RunRowBands(env, vi.height, 1 << shift_h, [&](int y_begin, int y_end) {
+    env->BitBlt(dstp_y + y_begin * dst_pitch_y, dst_pitch_y, srcp_y + y_begin * src_pitch_y, src_pitch_y, rowsize_y, y_end - y_begin);
+
+    if (dst_pitchA != 0)
+    {
+      BYTE* dstp_a_band = dstp_a + y_begin * dst_pitchA;
+      if (src_pitchA != 0)
+        env->BitBlt(dstp_a_band, dst_pitchA, srcp_a + y_begin * src_pitchA, src_pitchA, rowsizeA, y_end - y_begin);
+      else {
+        switch (pixelsize)
+        {
+        case 1:
+          fill_plane<BYTE>(dstp_a_band, y_end - y_begin, dst_pitchA, 255);
+          break;
+        case 2:
+          fill_plane<uint16_t>(dstp_a_band, y_end - y_begin, dst_pitchA, (1 << bits_per_pixel) - 1);
+          break;
+        case 4:
+          fill_plane<float>(dstp_a_band, y_end - y_begin, dst_pitchA, 1.0f);
+          break;
+        }
+      }
+    }
+
+    const int uv_begin = y_begin >> shift_h;
+    const int uv_height = (y_end >> shift_h) - uv_begin;
+    BYTE* dstp_u_band = dstp_u + uv_begin * dst_pitch;
+    BYTE* dstp_v_band = dstp_v + uv_begin * dst_pitch;
+
+    if (Yinput) {
+      switch (pixelsize)
+      {
+        case 1:
+          fill_chroma<BYTE>(dstp_u_band, dstp_v_band, uv_height, dst_pitch, 0x80);
+          break;
+        case 2:
+          fill_chroma<uint16_t>(dstp_u_band, dstp_v_band, uv_height, dst_pitch, 1 << (bits_per_pixel - 1));
+          break;
+        case 4:
+          fill_chroma<float>(dstp_u_band, dstp_v_band, uv_height, dst_pitch, 0.5f);
+          break;
+      }
+    } else {
+      env->BitBlt(dstp_u_band, dst_pitch, srcp_u + uv_begin * src_pitch_u, src_pitch_u, rowsize_uv, uv_height);
+      env->BitBlt(dstp_v_band, dst_pitch, srcp_v + uv_begin * src_pitch_v, src_pitch_v, rowsize_uv, uv_height);
+    }
+  });
+
+  return dst;
 }
 
 AVSValue ConvertToPlanarGeneric::Create(AVSValue& args, const char* filter, IScriptEnvironment* env) {
@@ -0,0 +1,210 @@
+#include "FilterProfiler.h"
+#include <chrono>
+#include <cstdio>
+
+typedef std::chrono::high_resolution_clock ProfileClock;
+
+static unsigned __int64 ElapsedNs(const ProfileClock::time_point &start)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(ProfileClock::now() - start).count();
+}
+
+// The profiled filter currently running on this thread, and the time its
+// nested profiled filters have used so far.
+static thread_local FilterProfileEntry* CurrentEntry = NULL;
+static thread_local unsigned __int64 CurrentChildNs = 0;
+
+// Makes 'entry' the current filter for its lifetime, also if GetFrame throws.
+class ProfileScope
+{
+  FilterProfileEntry* Entry;
+  FilterProfileEntry* ParentEntry;
+  unsigned __int64 ParentChildNs;
+  ProfileClock::time_point Start;
+
+public:
+  ProfileScope(FilterProfileEntry* entry) :
+    Entry(entry),
+    ParentEntry(CurrentEntry),
+    ParentChildNs(CurrentChildNs),
+    Start(ProfileClock::now())
+  {
+    CurrentEntry = entry;
+    CurrentChildNs = 0;
+  }
+
+  ~ProfileScope()
+  {
+    const unsigned __int64 elapsed = ElapsedNs(Start);
+    ++Entry->Calls;
+    Entry->InclusiveNs += elapsed;
+    Entry->ExclusiveNs += (elapsed > CurrentChildNs) ? elapsed - CurrentChildNs : 0;
+
+    CurrentEntry = ParentEntry;
+    CurrentChildNs = ParentChildNs + elapsed;
+  }
+};
+
+class ProfiledClip : public GenericVideoFilter
+{
+  std::shared_ptr<FilterProfileEntry> Entry;
+  std::shared_ptr<std::mutex> Mutex;
+
+public:
+  ProfiledClip(const PClip& child, const std::shared_ptr<FilterProfileEntry> &entry, const std::shared_ptr<std::mutex> &mutex) :
+    GenericVideoFilter(child),
+    Entry(entry),
+    Mutex(mutex)
+  {}
+
+  ~ProfiledClip()
+  {
+    // Write() may be querying the cache right now, it goes away with 'child' after us
+    std::lock_guard<std::mutex> lock(*Mutex);
+    Entry->Cache = NULL;
+  }
+
+  PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env)
+  {
+    ProfileScope scope(Entry.get());
+    return child->GetFrame(n, env);
+  }
+
+  // Requests meant for the cache behind us pass through. Identity queries
+  // don't, we are neither a Cache nor an MTGuard to whoever asks.
+  int __stdcall SetCacheHints(int cachehints, int frame_range)
+  {
+    switch (cachehints)
+    {
+    case CACHE_GET_MTMODE:
+    case CACHE_DONT_CACHE_ME:
+    case CACHE_NOTHING:
+    case CACHE_WINDOW:
+    case CACHE_GENERIC:
+    case CACHE_FORCE_GENERIC:
+    case CACHE_AUDIO:
+    case CACHE_AUDIO_NOTHING:
+    case CACHE_AUDIO_NONE:
+    case CACHE_AUDIO_AUTO:
+    case CACHE_SET_MIN_CAPACITY:
+    case CACHE_SET_MAX_CAPACITY:
+      return child->SetCacheHints(cachehints, frame_range);
+
+    default:
+      return 0;
+    }
+  }
+};
+
+
+FilterProfileEntry::FilterProfileEntry(const char* name, IClip* cache) :
+  Name(name),
+  Cache(cache),
+  Calls(0),
+  InclusiveNs(0),
+  ExclusiveNs(0),
+  BytesAllocated(0),
+  LockWaitNs(0)
+{
+}
+
+FilterProfiler::FilterProfiler(const char* filename) :
+  Mutex(std::make_shared<std::mutex>()),
+  Filename(filename)
+{
+}
+
+PClip FilterProfiler::Wrap(const PClip& clip, const char* name)
+{
+  std::shared_ptr<FilterProfileEntry> entry = std::make_shared<FilterProfileEntry>(name, (IClip*)(void*)clip);
+
+  std::lock_guard<std::mutex> lock(*Mutex);
+  Entries.push_back(entry);
+  return new ProfiledClip(clip, entry, Mutex);
+}
+
+int FilterProfiler::Count()
+{
+  std::lock_guard<std::mutex> lock(*Mutex);
+  return (int)Entries.size();
+}
+
+// Filter names end up in a JSON string
+static std::string JsonEscape(const std::string &s)
+{
+  std::string ret;
+  ret.reserve(s.size());
+  for (size_t i = 0; i < s.size(); ++i)
+  {
+    const unsigned char c = (unsigned char)s[i];
+    if ((c == '"') || (c == '\\'))
+    {
+      ret += '\\';
+      ret += (char)c;
+    }
+    else if (c < 0x20)
+    {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      ret += buf;
+    }
+    else
+      ret += (char)c;
+  }
+  return ret;
+}
+
+int FilterProfiler::Write()
+{
+  std::lock_guard<std::mutex> lock(*Mutex);
+
+  FILE* f = fopen(Filename.c_str(), "w");
+  if (f == NULL)
+    return -1;
+
+  fprintf(f, "{\n  \"filters\": [\n");
+  for (size_t i = 0; i < Entries.size(); ++i)
+  {
+    const FilterProfileEntry &e = *Entries[i];
+    IClip* cache = e.Cache;
+    const int hits = cache ? cache->SetCacheHints(CACHE_GET_FRAME_HITS, 0) : 0;
+    const int misses = cache ? cache->SetCacheHints(CACHE_GET_FRAME_MISSES, 0) : 0;
+    const int capacity = cache ? cache->SetCacheHints(CACHE_GET_CAPACITY, 0) : 0;
+    const int ghost_hits = cache ? cache->SetCacheHints(CACHE_GET_GHOST_HITS, 0) : 0;
+    const int reuse_gap = cache ? cache->SetCacheHints(CACHE_GET_REUSE_GAP, 0) : 0;
+    const int recompute_us = cache ? cache->SetCacheHints(CACHE_GET_RECOMPUTE_COST, 0) : 0;
+
+    fprintf(f, "    { \"id\": %zu, \"name\": \"%s\", \"calls\": %llu, \"inclusive_ms\": %.3f, \"exclusive_ms\": %.3f, "
+               "\"cache_hits\": %d, \"cache_misses\": %d, \"cache_capacity\": %d, \"ghost_hits\": %d, \"reuse_gap\": %d, \"recompute_us\": %d, "
+               "\"bytes_allocated\": %llu, \"lock_wait_ms\": %.3f }%s\n",
+      i, JsonEscape(e.Name).c_str(), (unsigned long long)e.Calls.load(), e.InclusiveNs / 1e6, e.ExclusiveNs / 1e6,
+      hits, misses, capacity, ghost_hits, reuse_gap, recompute_us,
+      (unsigned long long)e.BytesAllocated.load(), e.LockWaitNs / 1e6,
+      (i + 1 < Entries.size()) ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+  fclose(f);
+
+  return (int)Entries.size();
+}
+
+void FilterProfiler::AddAllocation(size_t bytes)
+{
+  if (CurrentEntry != NULL)
+    CurrentEntry->BytesAllocated += bytes;
+}
+
+void FilterProfiler::Lock(std::unique_lock<std::mutex> &lock)
+{
+  if (CurrentEntry == NULL)
+  {
+    lock.lock();
+    return;
+  }
+  if (lock.try_lock())
+    return;
+
+  const ProfileClock::time_point start = ProfileClock::now();
+  lock.lock();
+  CurrentEntry->LockWaitNs += ElapsedNs(start);
+}
@@ -0,0 +1,48 @@
+#ifndef _AVS_FILTERPROFILER_H
+#define _AVS_FILTERPROFILER_H
+
+#include <avisynth.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Per filter instance counters, see SetFilterProfile().
+struct FilterProfileEntry
+{
+  std::string Name;
+  IClip* Cache;                         // queried for hit/miss counts, NULL once the filter is gone; guarded by the profiler mutex
+  std::atomic<unsigned __int64> Calls;
+  std::atomic<unsigned __int64> InclusiveNs;
+  std::atomic<unsigned __int64> ExclusiveNs;  // without the time spent in other profiled filters
+  std::atomic<unsigned __int64> BytesAllocated;
+  std::atomic<unsigned __int64> LockWaitNs;   // waiting for the MTGuard of a MT_SERIALIZED filter
+
+  FilterProfileEntry(const char* name, IClip* cache);
+};
+
+// Wraps filter instances created by Invoke() and collects where GetFrame time goes.
+// The profile is written as JSON on demand (WriteFilterProfile()) and when the
+// environment is destroyed.
+class FilterProfiler
+{
+private:
+  // Shared with the wrappers, which may outlive the profiler
+  std::shared_ptr<std::mutex> Mutex;
+  std::vector<std::shared_ptr<FilterProfileEntry> > Entries;
+  std::string Filename;
+
+public:
+  FilterProfiler(const char* filename);
+
+  PClip Wrap(const PClip& clip, const char* name);
+  int Write(); // returns the number of filters written, -1 if the file could not be created
+  int Count();
+
+  // Attribute work to the profiled filter running on the calling thread, if any
+  static void AddAllocation(size_t bytes);
+  static void Lock(std::unique_lock<std::mutex> &lock);
+};
+
+#endif  // _AVS_FILTERPROFILER_H
@@ -0,0 +1,172 @@
+#include "FrameMemory.h"
+#include <avs/config.h>
+#include <avs/win.h>
+#include <cstdlib>
+#include <mutex>
+#include "strings.h"
+
+// Only buffers at least this big are worth their own virtual allocation.
+// Anything smaller stays on the heap, VirtualAlloc works in 64K steps.
+static const size_t FRAME_MEMORY_VIRTUAL_MIN = 1024 * 1024;
+
+enum FrameMemoryKind
+{
+  KIND_HEAP,
+  KIND_VIRTUAL
+};
+
+// Every block starts with this header, so that FrameMemoryFree knows how to
+// release it. It is padded to FRAME_ALIGN to keep the data aligned.
+struct FrameMemoryHeader
+{
+  void* base;
+  int kind;
+  size_t footprint;
+};
+static const size_t FRAME_MEMORY_HEADER_SIZE = FRAME_ALIGN;
+
+static size_t GetLargePageSize()
+{
+  static std::once_flag once;
+  static size_t page_size = 0;
+
+  std::call_once(once, []() {
+    // MEM_LARGE_PAGES fails unless SeLockMemoryPrivilege is enabled in our token.
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+      return;
+
+    TOKEN_PRIVILEGES tp;
+    tp.PrivilegeCount = 1;
+    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool enabled = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid)
+      && AdjustTokenPrivileges(token, FALSE, &tp, 0, NULL, NULL)
+      && (GetLastError() == ERROR_SUCCESS); // ERROR_NOT_ALL_ASSIGNED if the account lacks the right
+    CloseHandle(token);
+
+    if (enabled)
+      page_size = GetLargePageMinimum();
+  });
+
+  return page_size;
+}
+
+static void* VirtualAllocOnNode(size_t size, DWORD flags, bool numa)
+{
+  if (numa)
+  {
+    ULONG highest_node;
+    UCHAR node;
+    if (GetNumaHighestNodeNumber(&highest_node) && (highest_node > 0)
+      && GetNumaProcessorNode((UCHAR)GetCurrentProcessorNumber(), &node) && (node != 0xFF))
+    {
+      return VirtualAllocExNuma(GetCurrentProcess(), NULL, size, flags, PAGE_READWRITE, node);
+    }
+  }
+
+  return VirtualAlloc(NULL, size, flags, PAGE_READWRITE);
+}
+
+static unsigned char* PlaceHeader(void* base, int kind, size_t footprint)
+{
+  FrameMemoryHeader* header = (FrameMemoryHeader*)base;
+  header->base = base;
+  header->kind = kind;
+  header->footprint = footprint;
+  return (unsigned char*)base + FRAME_MEMORY_HEADER_SIZE;
+}
+
+unsigned char* FrameMemoryAlloc(size_t size, int mode, bool &degraded)
+{
+  degraded = false;
+  const size_t total = size + FRAME_MEMORY_HEADER_SIZE;
+
+  if ((mode != FRAME_MEMORY_HEAP) && (size >= FRAME_MEMORY_VIRTUAL_MIN))
+  {
+    const bool numa = (mode & FRAME_MEMORY_NUMA) != 0;
+
+    if (mode & FRAME_MEMORY_LARGE_PAGES)
+    {
+      const size_t page_size = GetLargePageSize();
+      if (page_size != 0)
+      {
+        // Large pages must be reserved and committed in one go, in whole pages.
+        const size_t large_total = (total + page_size - 1) & ~(page_size - 1);
+        void* base = VirtualAllocOnNode(large_total, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, numa);
+        if (base != NULL)
+          return PlaceHeader(base, KIND_VIRTUAL, large_total);
+      }
+      // No privilege, or physical memory too fragmented for another large page
+      degraded = true;
+    }
+
+    void* base = VirtualAllocOnNode(total, MEM_RESERVE | MEM_COMMIT, numa);
+    if (base != NULL)
+      return PlaceHeader(base, KIND_VIRTUAL, total);
+    degraded = true;
+  }
+
+  // Heap blocks are only guaranteed to be 16-byte aligned, so over-allocate
+  // and put the header right in front of the aligned data.
+  void* base = malloc(total + FRAME_ALIGN - 1);
+  if (base == NULL)
+    return NULL;
+  unsigned char* data = (unsigned char*)(((uintptr_t)base + FRAME_MEMORY_HEADER_SIZE + FRAME_ALIGN - 1) & ~(uintptr_t)(FRAME_ALIGN - 1));
+  FrameMemoryHeader* header = (FrameMemoryHeader*)(data - FRAME_MEMORY_HEADER_SIZE);
+  header->base = base;
+  header->kind = KIND_HEAP;
+  header->footprint = size;
+  return data;
+}
+
+size_t FrameMemoryFootprint(const unsigned char* ptr)
+{
+  if (ptr == NULL)
+    return 0;
+
+  const FrameMemoryHeader* header = (const FrameMemoryHeader*)(ptr - FRAME_MEMORY_HEADER_SIZE);
+  return header->footprint;
+}
+
+void FrameMemoryFree(unsigned char* ptr)
+{
+  if (ptr == NULL)
+    return;
+
+  const FrameMemoryHeader* header = (const FrameMemoryHeader*)(ptr - FRAME_MEMORY_HEADER_SIZE);
+  if (header->kind == KIND_VIRTUAL)
+    VirtualFree(header->base, 0, MEM_RELEASE);
+  else
+    free(header->base);
+}
+
+static const struct
+{
+  const char* name;
+  int mode;
+} FrameMemoryModeNames[] = {
+  { "heap", FRAME_MEMORY_HEAP },
+  { "largepages", FRAME_MEMORY_LARGE_PAGES },
+  { "numa", FRAME_MEMORY_NUMA },
+  { "largepages+numa", FRAME_MEMORY_LARGE_PAGES | FRAME_MEMORY_NUMA }
+};
+
+const char* FrameMemoryModeName(int mode)
+{
+  for (const auto& entry : FrameMemoryModeNames)
+  {
+    if (entry.mode == mode)
+      return entry.name;
+  }
+  return "heap";
+}
+
+int FrameMemoryModeFromName(const char* name)
+{
+  for (const auto& entry : FrameMemoryModeNames)
+  {
+    if (streqi(entry.name, name))
+      return entry.mode;
+  }
+  return -1;
+}
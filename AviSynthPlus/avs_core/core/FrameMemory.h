@@ -0,0 +1,27 @@
+#ifndef _AVS_FRAMEMEMORY_H
+#define _AVS_FRAMEMEMORY_H
+
+#include <cstddef>
+
+// Where VideoFrameBuffer data comes from, see SetMemoryMode().
+// The flags can be combined.
+enum FrameMemoryMode
+{
+  FRAME_MEMORY_HEAP = 0,          // plain C runtime heap
+  FRAME_MEMORY_LARGE_PAGES = 1,   // large pages, needs the "Lock pages in memory" right
+  FRAME_MEMORY_NUMA = 2           // pages on the NUMA node of the allocating thread
+};
+
+// Returns NULL only if no memory could be had at all. When the requested mode
+// cannot be honoured the block comes from the next best source and 'degraded'
+// is set, so that the caller can tell the user.
+unsigned char* FrameMemoryAlloc(size_t size, int mode, bool &degraded);
+void FrameMemoryFree(unsigned char* ptr);
+// What a block really takes, e.g. whole large pages. For heap blocks this is
+// the requested size, as memory_used has always counted them.
+size_t FrameMemoryFootprint(const unsigned char* ptr);
+
+const char* FrameMemoryModeName(int mode);
+int FrameMemoryModeFromName(const char* name); // -1 if unknown
+
+#endif  // _AVS_FRAMEMEMORY_H
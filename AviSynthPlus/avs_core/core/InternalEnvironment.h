@@ -29,6 +29,7 @@ typedef enum _ELogTicketType
     LOGTICKET_W1008 = 1008, // multiple plugins define the same function
     LOGTICKET_W1009 = 1009, // a filter is using forced alignment
     LOGTICKET_W1010 = 1010, // MT-mode specified for script function
+    LOGTICKET_W1011 = 1011, // large page frame memory not available
 } ELogTicketType;
 
 class OneTimeLogTicket
@@ -57,6 +58,7 @@ public:
     virtual bool __stdcall FilterHasMtMode(const AVSFunction* filter) const = 0;
     virtual MtMode __stdcall GetFilterMTMode(const AVSFunction* filter, bool* is_forced) const = 0; // If filter is "", gets the default MT mode
     virtual void __stdcall SetPrefetcher(Prefetcher *p) = 0;
+    virtual void __stdcall DeclareFrameDependency(const PClip& clip, int n) = 0;
     virtual ClipDataStore* __stdcall ClipData(IClip *clip) = 0;
     virtual MtMode __stdcall GetDefaultMtMode() const = 0;
     virtual void __stdcall SetLogParams(const char *target, int level) = 0;
@@ -65,6 +67,9 @@ public:
     virtual void __stdcall LogMsgOnce(const OneTimeLogTicket &ticket, int level, const char* fmt, ...) = 0;
     virtual void __stdcall LogMsgOnce_valist(const OneTimeLogTicket &ticket, int level, const char* fmt, va_list va) = 0;
     virtual void __stdcall VThrowError(const char* fmt, va_list va) = 0;
+    virtual int __stdcall SetMemoryMode(int mode) = 0; // FrameMemoryMode flags, negative only queries
+    virtual void __stdcall SetFilterProfile(const char* filename) = 0;
+    virtual int __stdcall WriteFilterProfile() = 0; // returns the number of filters written
     virtual PVideoFrame __stdcall SubframePlanarA(PVideoFrame src, int rel_offset, int new_pitch, int new_row_size, int new_height, int rel_offsetU, int rel_offsetV, int new_pitchUV, int rel_offsetA) = 0;
 };
 
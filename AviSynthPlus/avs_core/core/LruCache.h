@@ -2,6 +2,8 @@
 #define AVS_LRUCACHE_H
 
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
 #include <condition_variable>
 #include <memory>
 #include <cassert>
@@ -49,7 +51,8 @@ private:
     V value;
     size_t locks;      // the number of threads waiting on this entry. used to prevent eviction when readers are waiting on it
     size_t ghosted;    // the number of times this entry has entered the ghost list
-    std::condition_variable ready_cond;
+    std::atomic<bool> referenced; // hit on the shared-lock path since the last reordering
+    std::condition_variable_any ready_cond;
     enum LruEntryState state;
 
     LruEntry(const K& key)
@@ -63,6 +66,7 @@ private:
       value = v;
       locks = 0;
       ghosted = 0;
+      referenced = false;
       state = LRU_ENTRY_EMPTY;
     }
 
@@ -81,8 +85,24 @@ private:
 
   CacheType MainCache;
   GhostCacheType Ghosts;
+
+  // Requests for frames that were evicted not long ago, and how many slots
+  // the cache lacked to keep them, on average (x16 fixed point)
+  std::atomic<size_t> GhostHits;
+  std::atomic<size_t> ReuseGap16;
   ObjectPool<entry_type> EntryPool;
-  mutable std::mutex mutex;
+
+  // Hits on committed entries only take this lock shared. Everything that
+  // changes the lists or an entry's state takes it exclusively.
+  mutable std::shared_timed_mutex mutex;
+
+  static bool TakeReference(entry_ptr& entry)
+  {
+    if (!entry->referenced.load(std::memory_order_relaxed))
+      return false;
+    entry->referenced.store(false, std::memory_order_relaxed);
+    return true;
+  }
 
   static bool MainEvictEvent(CacheType* cache, const typename CacheType::Entry& entry, void* userData)
   {
@@ -114,7 +134,9 @@ public:
   LruCache(size_type capacity) :
     GHOSTS_MIN_CAPACITY(50),
     MainCache(capacity, &MainEvictEvent, reinterpret_cast<void*>(this)),
-    Ghosts(GHOSTS_MIN_CAPACITY, typename GhostCacheType::EvictEventType(), reinterpret_cast<void*>(this))
+    Ghosts(GHOSTS_MIN_CAPACITY, typename GhostCacheType::EvictEventType(), reinterpret_cast<void*>(this)),
+    GhostHits(0),
+    ReuseGap16(0)
   {
   }
 
@@ -133,23 +155,54 @@ public:
     return MainCache.capacity();
   }
 
+  size_t ghost_hits() const
+  {
+    return GhostHits;
+  }
+
+  // Average number of extra slots that would have turned a ghost hit into a hit
+  size_t reuse_gap() const
+  {
+    return ReuseGap16 / 16;
+  }
+
   void limits(size_t* min, size_t* max) const
   {
-    std::unique_lock<std::mutex> global_lock(mutex);
+    std::unique_lock<std::shared_timed_mutex> global_lock(mutex);
 
     MainCache.limits(min, max);
   }
 
   void set_limits(size_t min, size_t max)
   {
-    std::unique_lock<std::mutex> global_lock(mutex);
+    std::unique_lock<std::shared_timed_mutex> global_lock(mutex);
 
     MainCache.set_limits(min, max);
   }
 
   LruLookupResult lookup(const K& key, handle *hndl, bool block_for_completion, V& foundItem)
   {
-    std::unique_lock<std::mutex> global_lock(mutex);
+    // Fast path: a committed entry can be read by any number of threads at once.
+    // Instead of moving it to the front of the LRU list we only mark it as
+    // referenced, the next exclusive lookup applies all such marks in one go.
+    {
+      std::shared_lock<std::shared_timed_mutex> read_lock(mutex);
+
+      entry_ptr* entryp = MainCache.find(key);
+      if ((entryp != NULL) && ((*entryp)->state == LRU_ENTRY_AVAILABLE))
+      {
+        entry_ptr entry = *entryp;
+        if (!entry->referenced.load(std::memory_order_relaxed))
+          entry->referenced.store(true, std::memory_order_relaxed);
+        *hndl = handle(entry, this->shared_from_this());
+        foundItem = entry->value;
+        return LRU_LOOKUP_FOUND_AND_READY;
+      }
+    }
+
+    std::unique_lock<std::shared_timed_mutex> global_lock(mutex);
+
+    MainCache.promote(&TakeReference);
 
     bool found;
     entry_ptr* entryp = MainCache.lookup(key, &found);
@@ -191,7 +244,8 @@ public:
     else
     {
       bool ghost_found;
-      auto *g = Ghosts.lookup(key, &ghost_found);
+      size_t ghost_position = 0;
+      auto *g = Ghosts.lookup(key, &ghost_found, &ghost_position);
       assert(g != NULL);
       if (!ghost_found)
       {
@@ -199,6 +253,12 @@ public:
       }
       else if (g->ghosted > 0)
       {
+        // Ghosts are ordered by recency as well: the ones more recent than this
+        // one were evicted (or missed) after it, each of them would have needed a slot.
+        ++GhostHits;
+        size_t gap16 = ReuseGap16.load();
+        while (!ReuseGap16.compare_exchange_weak(gap16, (gap16 * 7 + (ghost_position + 1) * 16) / 8)) {}
+
         MainCache.resize(MainCache.capacity() + 1);
         Ghosts.resize(GHOSTS_MIN_CAPACITY + MainCache.capacity()*2);
       }
@@ -228,7 +288,7 @@ public:
 
   void commit_value(handle *hndl)
   {
-    std::unique_lock<std::mutex> global_lock(mutex);
+    std::unique_lock<std::shared_timed_mutex> global_lock(mutex);
 
     // mark data as ready
     entry_ptr e = hndl->first;
@@ -244,7 +304,7 @@ public:
 
   void rollback(handle *hndl)
   {
-    std::unique_lock<std::mutex> global_lock(mutex);
+    std::unique_lock<std::shared_timed_mutex> global_lock(mutex);
 
     entry_ptr e = hndl->first;
     assert(e->locks > 0);
@@ -37,6 +37,7 @@
 #include "internal.h"
 #include "FilterConstructor.h"
 #include "InternalEnvironment.h"
+#include "FilterProfiler.h"
 #include <cassert>
 #include <mutex>
 
@@ -136,7 +137,8 @@ PVideoFrame __stdcall MTGuard::GetFrame(int n, IScriptEnvironment* env)
     }
   case MT_SERIALIZED:
     {
-      std::lock_guard<std::mutex> lock(*FilterMutex);
+      std::unique_lock<std::mutex> lock(*FilterMutex, std::defer_lock);
+      FilterProfiler::Lock(lock);
       frame = ChildFilters[0]->GetFrame(n, env);
       break;
     }
@@ -216,6 +218,10 @@ int __stdcall MTGuard::SetCacheHints(int cachehints, int frame_range)
   if (CACHE_IS_MTGUARD_REQ == cachehints) {
     return CACHE_IS_MTGUARD_ANS;
   }
+  if (CACHE_GETCHILD_AUDIO_MODE == cachehints || CACHE_GETCHILD_AUDIO_SIZE == cachehints) {
+    // let the parent cache see what the guarded filter wants
+    return ChildFilters[0]->SetCacheHints(cachehints, frame_range);
+  }
 
   return 0;
 }
@@ -4,6 +4,7 @@
 #include <atomic>
 #include <mmintrin.h>
 #include <avisynth.h>
+#include <avs/minmax.h>
 #include "ThreadPool.h"
 #include "ObjectPool.h"
 #include "LruCache.h"
@@ -17,6 +18,13 @@ struct PrefetcherJobParams
   LruCache<size_t, PVideoFrame>::handle cache_handle;
 };
 
+struct PrefetcherDeclaredParams
+{
+  PClip clip;
+  int frame;
+  Prefetcher* prefetcher;
+};
+
 struct PrefetcherPimpl
 {
   PClip child;
@@ -51,6 +59,13 @@ struct PrefetcherPimpl
   // The frame number that GetFrame() has been called with the last time
   int LastRequestedFrame;
 
+  // Prefetch accuracy: wasted frames are the scheduled ones that never got a hit
+  std::atomic<size_t> PrefetchScheduled;
+  std::atomic<size_t> PrefetchHits;
+
+  // Frames fetched because a filter declared them through DeclareFrameDependency()
+  std::atomic<size_t> PrefetchDeclared;
+
   std::shared_ptr<LruCache<size_t, PVideoFrame> > VideoCache;
   std::atomic<int> running_workers;
   std::mutex worker_exception_mutex;
@@ -59,16 +74,19 @@ struct PrefetcherPimpl
   ScriptEnvironmentTLS EnvTlsMainThread;
   InternalEnvironment *EnvI;
 
-  PrefetcherPimpl(const PClip& _child, int _nThreads, IScriptEnvironment2 *env2) :
+  PrefetcherPimpl(const PClip& _child, int _nThreads, ThreadAffinity affinity, IScriptEnvironment2 *env2) :
     child(_child),
     vi(_child->GetVideoInfo()),
     nThreads(_nThreads),
     nPrefetchFrames(_nThreads * 2),
-    ThreadPool(_nThreads),
+    ThreadPool(_nThreads, affinity),
     LockedPattern(1),
     PatternHits(0),
     Pattern(1),
     LastRequestedFrame(0),
+    PrefetchScheduled(0),
+    PrefetchHits(0),
+    PrefetchDeclared(0),
     VideoCache(NULL),
     running_workers(0),
     worker_exception_present(0),
@@ -119,10 +137,34 @@ AVSValue Prefetcher::ThreadWorker(IScriptEnvironment2* env, void* data)
   return AVSValue();
 }
 
-Prefetcher::Prefetcher(const PClip& _child, int _nThreads, IScriptEnvironment *env) :
+AVSValue Prefetcher::DeclaredWorker(IScriptEnvironment2* env, void* data)
+{
+  PrefetcherDeclaredParams *ptr = (PrefetcherDeclaredParams*)data;
+  Prefetcher *prefetcher = ptr->prefetcher;
+
+  try
+  {
+    // The frame ends up in the Cache of the declaring filter's child,
+    // where the filter will pick it up.
+    ptr->clip->GetFrame(ptr->frame, env);
+    #ifdef X86_32
+    _mm_empty();
+    #endif
+  }
+  catch(...)
+  {
+    // Not our frame to report on: the filter gets the error itself when it asks for it.
+  }
+
+  delete ptr;
+  --(prefetcher->_pimpl->running_workers);
+  return AVSValue();
+}
+
+Prefetcher::Prefetcher(const PClip& _child, int _nThreads, ThreadAffinity affinity, IScriptEnvironment *env) :
   _pimpl(NULL)
 {
-  _pimpl = new PrefetcherPimpl(_child, _nThreads, static_cast<IScriptEnvironment2*>(env));
+  _pimpl = new PrefetcherPimpl(_child, _nThreads, affinity, static_cast<IScriptEnvironment2*>(env));
   _pimpl->VideoCache = std::make_shared<LruCache<size_t, PVideoFrame> >(_pimpl->nPrefetchFrames*2);
 }
 
@@ -141,6 +183,11 @@ void Prefetcher::Destroy()
 #endif
     }
 
+    const size_t scheduled = pimpl->PrefetchScheduled;
+    const size_t hits = pimpl->PrefetchHits;
+    pimpl->EnvI->LogMsg(LOGLEVEL_INFO, "Prefetch: %u frames scheduled, %u hits, %u wasted, %u declared frames fetched",
+      (unsigned)scheduled, (unsigned)hits, (unsigned)(scheduled - min(scheduled, hits)), (unsigned)pimpl->PrefetchDeclared);
+
     _pimpl = nullptr;
     delete pimpl;
   }
@@ -157,6 +204,59 @@ size_t Prefetcher::NumPrefetchThreads() const
   return _pimpl->nThreads;
 }
 
+bool Prefetcher::ScheduleFrame(int n, InternalEnvironment* env)
+{
+  PVideoFrame result;
+  LruCache<size_t, PVideoFrame>::handle cache_handle;
+  switch(_pimpl->VideoCache->lookup(n, &cache_handle, false, result))
+  {
+  case LRU_LOOKUP_NOT_FOUND:
+    {
+      PrefetcherJobParams *p = NULL;
+      {
+        std::lock_guard<std::mutex> lock(_pimpl->params_pool_mutex);
+        p = _pimpl->JobParamsPool.Construct();
+      }
+      p->frame = n;
+      p->prefetcher = this;
+      p->cache_handle = cache_handle;
+      ++_pimpl->running_workers;
+      ++_pimpl->PrefetchScheduled;
+      _pimpl->ThreadPool.QueueJob(ThreadWorker, p, env, NULL);
+      return true;
+    }
+  case LRU_LOOKUP_FOUND_AND_READY:      // Fall-through intentional
+  case LRU_LOOKUP_NO_CACHE:             // Fall-through intentional
+  case LRU_LOOKUP_FOUND_BUT_NOTAVAIL:
+    {
+      return false;
+    }
+  default:
+    {
+      assert(0);
+      return false;
+    }
+  }
+}
+
+void Prefetcher::DeclareFrame(const PClip& clip, int n, InternalEnvironment* env)
+{
+  if ((n < 0) || (n >= clip->GetVideoInfo().num_frames))
+    return;
+
+  // Declared frames come on top of the stride prefetching, within the same worker limit
+  if (_pimpl->running_workers >= _pimpl->nPrefetchFrames)
+    return;
+
+  PrefetcherDeclaredParams *p = new PrefetcherDeclaredParams();
+  p->clip = clip;
+  p->frame = n;
+  p->prefetcher = this;
+  ++_pimpl->running_workers;
+  ++_pimpl->PrefetchDeclared;
+  _pimpl->ThreadPool.QueueJob(DeclaredWorker, p, env, NULL);
+}
+
 int __stdcall Prefetcher::SchedulePrefetch(int current_n, int prefetch_start, InternalEnvironment* env)
 {
   int n = prefetch_start;
@@ -166,37 +266,8 @@ int __stdcall Prefetcher::SchedulePrefetch(int current_n, int prefetch_start, In
     if (n >= _pimpl->vi.num_frames)
       break;
 
-    PVideoFrame result;
-    LruCache<size_t, PVideoFrame>::handle cache_handle;
-    switch(_pimpl->VideoCache->lookup(n, &cache_handle, false, result))
-    {
-    case LRU_LOOKUP_NOT_FOUND:
-      {
-        PrefetcherJobParams *p = NULL;
-        {
-          std::lock_guard<std::mutex> lock(_pimpl->params_pool_mutex);
-          p = _pimpl->JobParamsPool.Construct();
-        }
-        p->frame = n;
-        p->prefetcher = this;
-        p->cache_handle = cache_handle;
-        ++_pimpl->running_workers;
-        _pimpl->ThreadPool.QueueJob(ThreadWorker, p, env, NULL);
-        break;
-      }
-    case LRU_LOOKUP_FOUND_AND_READY:      // Fall-through intentional
-    case LRU_LOOKUP_NO_CACHE:             // Fall-through intentional
-    case LRU_LOOKUP_FOUND_BUT_NOTAVAIL:
-      {
-        break;
-      }
-    default:
-      {
-        assert(0);
-        break;
-      }
-    }
-  } // switch
+    ScheduleFrame(n, env);
+  }
 
   return n;
 }
@@ -275,7 +346,6 @@ PVideoFrame __stdcall Prefetcher::GetFrame(int n, IScriptEnvironment* env)
 
 
   // Prefetch 1
-  size_t scheduled_Frames = 0;
   int prefetch_pos = SchedulePrefetch(n, n, envI);
 
   // Get requested frame
@@ -306,6 +376,7 @@ PVideoFrame __stdcall Prefetcher::GetFrame(int n, IScriptEnvironment* env)
   case LRU_LOOKUP_FOUND_AND_READY:
     {
     //result = cache_handle.first->value; // old method, result is filled already
+    ++_pimpl->PrefetchHits;
     break;
     }
   case LRU_LOOKUP_NO_CACHE:
@@ -339,9 +410,24 @@ void __stdcall Prefetcher::GetAudio(void* buf, __int64 start, __int64 count, ISc
 
 int __stdcall Prefetcher::SetCacheHints(int cachehints, int frame_range)
 {
-  if (CACHE_GET_MTMODE == cachehints)
+  switch (cachehints)
+  {
+  case CACHE_GET_MTMODE:
     return MT_NICE_FILTER;
 
+  case CACHE_GET_PREFETCH_SCHEDULED:
+    return (int)_pimpl->PrefetchScheduled;
+
+  case CACHE_GET_PREFETCH_HITS:
+    return (int)_pimpl->PrefetchHits;
+
+  case CACHE_GET_PREFETCH_DECLARED:
+    return (int)_pimpl->PrefetchDeclared;
+
+  default:
+    break;
+  }
+
   return 0;
 }
 
@@ -357,9 +443,18 @@ AVSValue Prefetcher::Create(AVSValue args, void*, IScriptEnvironment* env)
 
   int PrefetchThreads = args[1].AsInt((int)envi->GetProperty(AEP_PHYSICAL_CPUS)+1);
 
+  ThreadAffinity affinity = THREAD_AFFINITY_NONE;
+  const char* affinity_name = args[2].AsString("none");
+  if (!lstrcmpi(affinity_name, "cores"))
+    affinity = THREAD_AFFINITY_CORES;
+  else if (!lstrcmpi(affinity_name, "numa"))
+    affinity = THREAD_AFFINITY_NUMA;
+  else if (lstrcmpi(affinity_name, "none"))
+    env->ThrowError("Prefetch: affinity must be \"none\", \"cores\" or \"numa\".");
+
   if (PrefetchThreads > 0)
   {
-    Prefetcher* prefetcher = new Prefetcher(child, PrefetchThreads, env);
+    Prefetcher* prefetcher = new Prefetcher(child, PrefetchThreads, affinity, env);
     try
     {
       envi->SetPrefetcher(prefetcher);
@@ -2,6 +2,7 @@
 #define _AVS_FILT_PREFETCHER_H
 
 #include <avisynth.h>
+#include "ThreadPool.h"
 
 struct PrefetcherPimpl;
 class InternalEnvironment;
@@ -13,12 +14,15 @@ private:
   PrefetcherPimpl * _pimpl;
 
   static AVSValue ThreadWorker(IScriptEnvironment2* env, void* data);
+  static AVSValue DeclaredWorker(IScriptEnvironment2* env, void* data);
+  bool ScheduleFrame(int n, InternalEnvironment* env);
   int __stdcall SchedulePrefetch(int current_n, int prefetch_start, InternalEnvironment* env);
-  Prefetcher(const PClip& _child, int _nThreads, IScriptEnvironment *env);
+  Prefetcher(const PClip& _child, int _nThreads, ThreadAffinity affinity, IScriptEnvironment *env);
 
 public:
   ~Prefetcher();
   size_t NumPrefetchThreads() const;
+  void DeclareFrame(const PClip& clip, int n, InternalEnvironment* env);
   virtual PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
   virtual bool __stdcall GetParity(int n);
   virtual void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
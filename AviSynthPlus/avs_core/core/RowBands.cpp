@@ -0,0 +1,112 @@
+#include "RowBands.h"
+#include <avisynth.h>
+#include <avs/minmax.h>
+#include <atomic>
+#include <exception>
+#include <mutex>
+
+// Bands shorter than this cost more to hand over than they save.
+static const int ROW_BAND_MIN_ROWS = 32;
+
+// Bands per participating thread. More than one lets the threads that
+// started early pick up the work of those that started late.
+static const int ROW_BANDS_PER_THREAD = 2;
+
+// Set while a thread works on bands. A kernel that ends up in RunRowBands
+// again runs serially instead of waiting on the pool from within the pool.
+static thread_local bool InRowBand = false;
+
+struct RowBandJob
+{
+  const RowBandKernel* Kernel;
+  int Height;
+  int BandRows;
+  int nBands;
+  std::atomic<int> NextBand;
+
+  std::mutex ErrorMutex;
+  std::exception_ptr Error;
+};
+
+static void RunBands(RowBandJob* job)
+{
+  const bool wasInBand = InRowBand;
+  InRowBand = true;
+
+  for (;;)
+  {
+    const int band = job->NextBand++;
+    if (band >= job->nBands)
+      break;
+
+    const int y_begin = band * job->BandRows;
+    const int y_end = min(y_begin + job->BandRows, job->Height);
+    try
+    {
+      (*job->Kernel)(y_begin, y_end);
+    }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> lock(job->ErrorMutex);
+      if (!job->Error)
+        job->Error = std::current_exception();
+      job->NextBand = job->nBands;  // leave the remaining bands alone
+    }
+  }
+
+  InRowBand = wasInBand;
+}
+
+static AVSValue RowBandWorker(IScriptEnvironment2* env, void* data)
+{
+  RunBands(static_cast<RowBandJob*>(data));
+  return AVSValue();
+}
+
+void RunRowBands(IScriptEnvironment* env, int height, int granularity, const RowBandKernel& kernel)
+{
+  if (height <= 0)
+    return;
+  if (granularity < 1)
+    granularity = 1;
+
+  IScriptEnvironment2* env2 = static_cast<IScriptEnvironment2*>(env);
+
+  int nWorkers = 0;
+  if (!InRowBand && (env2->GetProperty(AEP_FILTERCHAIN_THREADS) <= 1))
+    nWorkers = (int)env2->GetProperty(AEP_THREADPOOL_THREADS);
+
+  // Band height: an even share for every thread, but not too short
+  int band_rows = (height + (nWorkers + 1) * ROW_BANDS_PER_THREAD - 1) / ((nWorkers + 1) * ROW_BANDS_PER_THREAD);
+  band_rows = max(band_rows, ROW_BAND_MIN_ROWS);
+  band_rows = (band_rows + granularity - 1) / granularity * granularity;
+
+  const int nBands = (height + band_rows - 1) / band_rows;
+  const int nHelpers = min(nWorkers, nBands - 1);
+  if (nHelpers <= 0)
+  {
+    kernel(0, height);
+    return;
+  }
+
+  RowBandJob job;
+  job.Kernel = &kernel;
+  job.Height = height;
+  job.BandRows = band_rows;
+  job.nBands = nBands;
+  job.NextBand = 0;
+
+  IJobCompletion* completion = env2->NewCompletion(nHelpers);
+  for (int i = 0; i < nHelpers; ++i)
+    env2->ParallelJob(RowBandWorker, &job, completion);
+
+  // The caller takes bands as well. Helpers that only get to run after
+  // all bands are taken return at once.
+  RunBands(&job);
+
+  completion->Wait();
+  completion->Destroy();
+
+  if (job.Error)
+    std::rethrow_exception(job.Error);
+}
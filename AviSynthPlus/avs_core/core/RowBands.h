@@ -0,0 +1,26 @@
+#ifndef _AVS_ROWBANDS_H
+#define _AVS_ROWBANDS_H
+
+#include <functional>
+
+class IScriptEnvironment;
+
+// Processes rows [y_begin, y_end) of a plane.
+typedef std::function<void(int y_begin, int y_end)> RowBandKernel;
+
+// Splits [0, height) into horizontal bands and runs 'kernel' on them, on the
+// calling thread and on the environment's thread pool at the same time.
+// Band borders are multiples of 'granularity' (e.g. the vertical chroma
+// subsampling), only the last band may be shorter.
+//
+// Everything runs on the calling thread when threading would not pay off:
+// small planes, a single core, or when Prefetch already keeps all cores busy
+// with whole frames. Returns after all bands are done. An exception thrown by
+// the kernel is passed on to the caller once the other bands have stopped.
+//
+// The kernel must only write to its own rows of the output. It must not
+// request frames; of the environment only stateless helpers like BitBlt and
+// GetCPUFlags may be used.
+void RunRowBands(IScriptEnvironment* env, int height, int granularity, const RowBandKernel& kernel);
+
+#endif  // _AVS_ROWBANDS_H
@@ -45,6 +45,11 @@ public:
     core = _core;
   }
 
+  InternalEnvironment* GetCore() const
+  {
+    return core;
+  }
+
   /* ---------------------------------------------------------------------------------
    *             T  L  S
    * ---------------------------------------------------------------------------------
@@ -210,6 +215,21 @@ public:
     core->VThrowError(fmt, va);
   }
 
+  virtual int __stdcall SetMemoryMode(int mode)
+  {
+    return core->SetMemoryMode(mode);
+  }
+
+  virtual void __stdcall SetFilterProfile(const char* filename)
+  {
+    core->SetFilterProfile(filename);
+  }
+
+  virtual int __stdcall WriteFilterProfile()
+  {
+    return core->WriteFilterProfile();
+  }
+
   virtual PVideoFrame __stdcall SubframePlanarA(PVideoFrame src, int rel_offset, int new_pitch, int new_row_size, int new_height, int rel_offsetU, int rel_offsetV, int new_pitchUV, int rel_offsetA)
   {
     return core->SubframePlanarA(src, rel_offset, new_pitch, new_row_size, new_height, rel_offsetU, rel_offsetV, new_pitchUV, rel_offsetA);
@@ -377,6 +397,11 @@ public:
     core->SetPrefetcher(p);
   }
 
+  virtual void __stdcall DeclareFrameDependency(const PClip& clip, int n)
+  {
+    core->DeclareFrameDependency(clip, n);
+  }
+
   virtual ClipDataStore* __stdcall ClipData(IClip *clip)
   {
     return core->ClipData(clip);
@@ -76,19 +76,24 @@ public:
     resize(RequestedCapacity);
   }
 
-  V* lookup(const K& key, bool *found)
+  // 'position', if given, receives how many entries were more recent than a found one
+  V* lookup(const K& key, bool *found, size_t *position = NULL)
   {
     // Look for an existing cache entry,
     // and return it when found
+    size_t pos = 0;
     const entry_type it_end =  Cache.end();
     for (
       entry_type it = Cache.begin();
       it != it_end;
-      ++it
+      ++it, ++pos
     )
     {
       if (it->key == key)
       {
+        if (position != NULL)
+          *position = pos;
+
         // Move found element to the front of the list
         if (it != Cache.begin())
           Cache.splice(Cache.begin(), Cache, it);
@@ -124,6 +129,41 @@ public:
     return NULL;
   }
 
+  // Read-only lookup, does not change the recency order.
+  V* find(const K& key)
+  {
+    const entry_type it_end =  Cache.end();
+    for (
+      entry_type it = Cache.begin();
+      it != it_end;
+      ++it
+    )
+    {
+      if (it->key == key)
+        return &(it->value);
+    }
+    return NULL;
+  }
+
+  // Move all entries for which 'referenced' returns true to the front, keeping
+  // their relative order. This applies recency updates that were only recorded
+  // by the caller (see LruCache::lookup) in one batch.
+  template<typename Pred>
+  void promote(Pred referenced)
+  {
+    std::list<Entry> promoted;
+    const entry_type it_end =  Cache.end();
+    for (entry_type it = Cache.begin(); it != it_end; )
+    {
+      entry_type next = it;
+      ++next;
+      if (referenced(it->value))
+        promoted.splice(promoted.end(), Cache, it);
+      it = next;
+    }
+    Cache.splice(Cache.begin(), promoted);
+  }
+
   void remove(const K& key)
   {
     const entry_type it_end =  Cache.end();
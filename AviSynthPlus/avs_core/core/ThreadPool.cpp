@@ -1,7 +1,16 @@
 #include "ThreadPool.h"
 #include "ScriptEnvironmentTLS.h"
+#include <avs/win.h>
+#include <avs/minmax.h>
 #include <cassert>
 #include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <iterator>
 
 struct ThreadPoolGenericItemData
 {
@@ -9,112 +18,232 @@ struct ThreadPoolGenericItemData
   void* Params;
   InternalEnvironment* Environment;
   AVSPromise* Promise;
+  JobCompletion* Completion;
 };
 
-enum ThreadMessagesType{
-  INVALID_MSG,
-  QUEUE_GENERIC_ITEM,
-  THREAD_STOP
-};
-
-struct ThreadMessage
+// Job queue of a single worker. The owner takes its newest job from the back,
+// idle workers steal the oldest ones from the front.
+class WorkerQueue
 {
-  ThreadMessagesType Type;
-  ThreadPoolGenericItemData GenericWorkItemData;
-
-  ThreadMessage() :
-    Type(INVALID_MSG)
-  {}
-  ThreadMessage(ThreadMessagesType type) :
-    Type(type)
-  {}
-  ThreadMessage(ThreadMessagesType type, const ThreadPoolGenericItemData &data) :
-    Type(type), GenericWorkItemData(data)
-  {}
-};
+private:
+  std::deque<ThreadPoolGenericItemData> jobs;
+  std::mutex mutex;
 
-#include "mpmc_bounded_queue.h"
-typedef mpmc_bounded_queue<ThreadMessage> MessageQueue;
+public:
+  void push(const ThreadPoolGenericItemData& item)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.push_back(item);
+  }
 
-static void ThreadFunc(size_t thread_id, MessageQueue *msgQueue)
-{
-  ScriptEnvironmentTLS EnvTLS(thread_id);
+  bool pop(ThreadPoolGenericItemData* item)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (jobs.empty())
+      return false;
+    *item = jobs.back();
+    jobs.pop_back();
+    return true;
+  }
 
-  bool runThread = true;
-  while(runThread)
+  bool steal(ThreadPoolGenericItemData* item)
   {
-    ThreadMessage msg;
-    msgQueue->pop_back(&msg);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (jobs.empty())
+      return false;
+    *item = jobs.front();
+    jobs.pop_front();
+    return true;
+  }
 
-    switch(msg.Type)
+  // Newest job belonging to 'tc'
+  bool take(const JobCompletion* tc, ThreadPoolGenericItemData* item)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = jobs.rbegin(); it != jobs.rend(); ++it)
     {
-    case THREAD_STOP:
-      {
-        runThread = false;
-        break;
-      }
-    case QUEUE_GENERIC_ITEM:
-      {
-        ThreadPoolGenericItemData &data = msg.GenericWorkItemData;
-        EnvTLS.Specialize(data.Environment);
-        if (data.Promise != NULL)
-        {
-          try
-          {
-            data.Promise->set_value(data.Func(&EnvTLS, data.Params));
-          }
-          catch(const AvisynthError&)
-          {
-            data.Promise->set_exception(std::current_exception());
-          }
-          catch(const std::exception&)
-          {
-            data.Promise->set_exception(std::current_exception());
-          }
-          catch(...)
-          {
-            data.Promise->set_exception(std::current_exception());
-            //data.Promise->set_value(AVSValue("An unknown exception was thrown in the thread pool."));
-          }
-        }
-        else
-        {
-          try
-          {
-            data.Func(&EnvTLS, data.Params);
-          } catch(...){}
-        }
-        break;
-      }
-    default:
+      if (it->Completion == tc)
       {
-        assert(0);
-        break;
+        *item = *it;
+        jobs.erase(std::next(it).base());
+        return true;
       }
-    } // switch
-  } //while
-}
+    }
+    return false;
+  }
+};
 
 class ThreadPoolPimpl
 {
 public:
   std::vector<std::thread> Threads;
-  MessageQueue MsgQueue;
+  std::vector<std::unique_ptr<WorkerQueue> > Queues;
+
+  // Sleeping workers wait here until Pending becomes positive.
+  // Pending may drop below zero for a moment, when a job is taken
+  // before its submitter got to count it.
+  std::mutex IdleMutex;
+  std::condition_variable IdleCond;
+  std::atomic<int> Pending;
+  std::atomic<size_t> NextQueue;
+  bool Stop;
 
   ThreadPoolPimpl(size_t nThreads) :
     Threads(),
-    MsgQueue(nThreads * 6)
-  {}
+    Queues(),
+    Pending(0),
+    NextQueue(0),
+    Stop(false)
+  {
+    Queues.reserve(nThreads);
+    for (size_t i = 0; i < nThreads; ++i)
+      Queues.emplace_back(new WorkerQueue());
+  }
+
+  // Own queue first, then steal from the others
+  bool TakeJob(size_t self, ThreadPoolGenericItemData* item)
+  {
+    const size_t nQueues = Queues.size();
+    bool found = Queues[self]->pop(item);
+    for (size_t i = 1; !found && (i < nQueues); ++i)
+      found = Queues[(self + i) % nQueues]->steal(item);
+
+    if (found)
+      --Pending;
+    return found;
+  }
+
+  // A job of 'tc', own queue first
+  bool TakeJob(size_t self, const JobCompletion* tc, ThreadPoolGenericItemData* item)
+  {
+    const size_t nQueues = Queues.size();
+    bool found = false;
+    for (size_t i = 0; !found && (i < nQueues); ++i)
+      found = Queues[(self + i) % nQueues]->take(tc, item);
+
+    if (found)
+      --Pending;
+    return found;
+  }
+
+  // Index of the worker queue belonging to the calling thread, or -1
+  int CallingWorker() const
+  {
+    const std::thread::id self = std::this_thread::get_id();
+    for (size_t i = 0; i < Threads.size(); ++i)
+    {
+      if (Threads[i].get_id() == self)
+        return (int)i;
+    }
+    return -1;
+  }
 };
 
-ThreadPool::ThreadPool(size_t nThreads) :
+// Set for the threads of a pool, so that a waiting worker can find more work
+static thread_local ThreadPoolPimpl* WorkerPool = NULL;
+static thread_local size_t WorkerSelf = 0;
+static thread_local ScriptEnvironmentTLS* WorkerEnv = NULL;
+
+static void RunJob(ThreadPoolGenericItemData &data, ScriptEnvironmentTLS &EnvTLS)
+{
+  EnvTLS.Specialize(data.Environment);
+  if (data.Promise != NULL)
+  {
+    try
+    {
+      data.Promise->set_value(data.Func(&EnvTLS, data.Params));
+    }
+    catch(const AvisynthError&)
+    {
+      data.Promise->set_exception(std::current_exception());
+    }
+    catch(const std::exception&)
+    {
+      data.Promise->set_exception(std::current_exception());
+    }
+    catch(...)
+    {
+      data.Promise->set_exception(std::current_exception());
+      //data.Promise->set_value(AVSValue("An unknown exception was thrown in the thread pool."));
+    }
+  }
+  else
+  {
+    try
+    {
+      data.Func(&EnvTLS, data.Params);
+    } catch(...){}
+  }
+}
+
+static void ThreadFunc(size_t thread_id, ThreadPoolPimpl *pool)
+{
+  ScriptEnvironmentTLS EnvTLS(thread_id);
+
+  // Thread ids start at one, queues at zero
+  const size_t self = thread_id - 1;
+
+  WorkerPool = pool;
+  WorkerSelf = self;
+  WorkerEnv = &EnvTLS;
+
+  ThreadPoolGenericItemData data;
+  for (;;)
+  {
+    if (pool->TakeJob(self, &data))
+    {
+      RunJob(data, EnvTLS);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(pool->IdleMutex);
+    pool->IdleCond.wait(lock, [pool]{ return (pool->Pending > 0) || pool->Stop; });
+    if (pool->Stop && (pool->Pending <= 0))
+      break;
+  }
+}
+
+static void SetWorkerAffinity(std::thread &thread, size_t index, ThreadAffinity affinity)
+{
+  switch (affinity)
+  {
+  case THREAD_AFFINITY_CORES:
+    {
+      // One logical processor per worker, wrapping around when there are more workers
+      const size_t nCores = min((size_t)std::thread::hardware_concurrency(), sizeof(DWORD_PTR) * 8);
+      if (nCores > 0)
+        SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR)1 << (index % nCores));
+      break;
+    }
+  case THREAD_AFFINITY_NUMA:
+    {
+      // Spread workers over the NUMA nodes, each one free to run on any core of its node
+      ULONG highestNode = 0;
+      if (!GetNumaHighestNodeNumber(&highestNode) || (highestNode == 0))
+        break;
+
+      ULONGLONG nodeMask = 0;
+      if (GetNumaNodeProcessorMask((UCHAR)(index % (highestNode + 1)), &nodeMask) && (nodeMask != 0))
+        SetThreadAffinityMask(thread.native_handle(), (DWORD_PTR)nodeMask);
+      break;
+    }
+  case THREAD_AFFINITY_NONE:  // Fall-through intentional
+  default:
+    break;
+  }
+}
+
+ThreadPool::ThreadPool(size_t nThreads, ThreadAffinity affinity) :
   _pimpl(new ThreadPoolPimpl(nThreads))
 {
   _pimpl->Threads.reserve(nThreads);
 
   // i is used as the thread id. Skip id zero because that is reserved for the main thread.
   for (size_t i = 1; i <= nThreads; ++i)
-    _pimpl->Threads.emplace_back(ThreadFunc, i, &(_pimpl->MsgQueue));
+  {
+    _pimpl->Threads.emplace_back(ThreadFunc, i, _pimpl);
+    SetWorkerAffinity(_pimpl->Threads.back(), i - 1, affinity);
+  }
 }
 
 void ThreadPool::QueueJob(ThreadWorkerFuncPtr clb, void* params, InternalEnvironment *env, JobCompletion *tc)
@@ -124,12 +253,42 @@ void ThreadPool::QueueJob(ThreadWorkerFuncPtr clb, void* params, InternalEnviron
   itemData.Params = params;
   itemData.Environment = env;
 
+  itemData.Completion = tc;
+
   if (tc != NULL)
     itemData.Promise = tc->Add();
   else
     itemData.Promise = NULL;
 
-  _pimpl->MsgQueue.push_front(ThreadMessage(QUEUE_GENERIC_ITEM, itemData));
+  // Jobs submitted from a worker stay with it, others are spread round-robin.
+  // Queues are unbounded, so this never blocks.
+  int queue = _pimpl->CallingWorker();
+  if (queue < 0)
+    queue = (int)(_pimpl->NextQueue++ % _pimpl->Queues.size());
+  _pimpl->Queues[queue]->push(itemData);
+
+  {
+    std::lock_guard<std::mutex> lock(_pimpl->IdleMutex);
+    ++_pimpl->Pending;
+  }
+  _pimpl->IdleCond.notify_one();
+}
+
+bool ThreadPool::RunPendingJob(JobCompletion *tc)
+{
+  if ((WorkerPool == NULL) || (tc == NULL))
+    return false;
+
+  // The job was queued by the code waiting for it, so it runs as if that
+  // code had called it directly
+  ThreadPoolGenericItemData data;
+  if (!WorkerPool->TakeJob(WorkerSelf, tc, &data))
+    return false;
+
+  InternalEnvironment *outer = WorkerEnv->GetCore();
+  RunJob(data, *WorkerEnv);
+  WorkerEnv->Specialize(outer);
+  return true;
 }
 
 size_t ThreadPool::NumThreads() const
@@ -139,10 +298,12 @@ size_t ThreadPool::NumThreads() const
 
 ThreadPool::~ThreadPool()
 {
-  for (size_t i = 0; i < _pimpl->Threads.size(); ++i)
   {
-    _pimpl->MsgQueue.push_front(THREAD_STOP);
+    std::lock_guard<std::mutex> lock(_pimpl->IdleMutex);
+    _pimpl->Stop = true;
   }
+  _pimpl->IdleCond.notify_all();
+
   for (size_t i = 0; i < _pimpl->Threads.size(); ++i)
   {
     if (_pimpl->Threads[i].joinable())
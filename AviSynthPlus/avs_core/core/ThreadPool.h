@@ -2,6 +2,7 @@
 #define _AVS_THREADPOOL_H
 
 #include <avisynth.h>
+#include <chrono>
 #include <future>
 
 typedef std::future<AVSValue> AVSFuture;
@@ -47,11 +48,7 @@ public:
     delete [] pairs;
   }
 
-  void __stdcall Wait()
-  {
-    for (size_t i = 0; i < nJobs; ++i)
-      pairs[i].second.wait();
-  }
+  void __stdcall Wait();
   size_t __stdcall Size() const
   {
     return nJobs;
@@ -79,6 +76,13 @@ public:
   }
 };
 
+enum ThreadAffinity
+{
+  THREAD_AFFINITY_NONE,   // Leave scheduling to the OS
+  THREAD_AFFINITY_CORES,  // Pin each worker to one logical processor
+  THREAD_AFFINITY_NUMA    // Spread workers over NUMA nodes
+};
+
 class ThreadPoolPimpl;
 class ThreadPool
 {
@@ -86,11 +90,34 @@ private:
   ThreadPoolPimpl * const _pimpl;
 
 public:
-  ThreadPool(size_t nThreads);
+  ThreadPool(size_t nThreads, ThreadAffinity affinity = THREAD_AFFINITY_NONE);
   ~ThreadPool();
 
   void QueueJob(ThreadWorkerFuncPtr clb, void* params, InternalEnvironment *env, JobCompletion *tc);
   size_t NumThreads() const;
+
+  // Runs one queued job of 'tc' on the calling thread, if that is a worker of
+  // the pool holding it. Returns false if there was none.
+  static bool RunPendingJob(JobCompletion *tc);
 };
 
+inline void __stdcall JobCompletion::Wait()
+{
+  // A waiting worker runs the jobs of this group that nobody has started
+  // yet, otherwise jobs that start jobs of their own could leave every worker
+  // waiting on a queue nobody takes from anymore. Jobs of other groups are
+  // left alone, they could need locks this thread is holding.
+  for (size_t i = 0; i < nJobs; ++i)
+  {
+    while (pairs[i].second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+      if (!ThreadPool::RunPendingJob(this))
+      {
+        pairs[i].second.wait();
+        break;
+      }
+    }
+  }
+}
+
 #endif  // _AVS_THREADPOOL_H
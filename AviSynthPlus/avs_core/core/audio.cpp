@@ -39,8 +39,15 @@
 
 #include "audio.h"
 #include "../convert/convert_audio.h"
+#include "InternalEnvironment.h"
+#include "audio_avx2.h"
 #include <cstdio>
+#include <cstring>
 #include <new>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <emmintrin.h>
 
 #define BIGBUFFSIZE (2048*1024) // Use a 2Mb buffer for EnsureVBRMP3Sync seeking & Normalize scanning
 
@@ -85,7 +92,7 @@ extern const AVSFunction Audio_filters[] = {
                                 { "AmplifydB", BUILTIN_FUNC_PREFIX, "cf+", Amplify::Create_dB },
                                 { "Amplify", BUILTIN_FUNC_PREFIX, "cf+", Amplify::Create },
                                 { "AssumeSampleRate", BUILTIN_FUNC_PREFIX, "ci", AssumeRate::Create },
-                                { "Normalize", BUILTIN_FUNC_PREFIX, "c[volume]f[show]b", Normalize::Create },
+                                { "Normalize", BUILTIN_FUNC_PREFIX, "c[volume]f[show]b[peakfile]s", Normalize::Create },
                                 { "MixAudio", BUILTIN_FUNC_PREFIX, "cc[clip1_factor]f[clip2_factor]f", MixAudio::Create },
                                 { "ResampleAudio", BUILTIN_FUNC_PREFIX, "ci[]i", ResampleAudio::Create },
                                 { "ConvertToMono", BUILTIN_FUNC_PREFIX, "c", ConvertToMono::Create },
@@ -830,141 +837,258 @@ AVSValue __cdecl Amplify::Create_dB(AVSValue args, void*, IScriptEnvironment* en
  ***** Supports int16,float******
  ******************************/
 
-Normalize::Normalize(PClip _child, float _max_factor, bool _showvalues) :
+Normalize::Normalize(PClip _child, float _max_factor, bool _showvalues, const char* _peakfile) :
   GenericVideoFilter(ConvertAudio::Create(_child, SAMPLE_INT16 | SAMPLE_FLOAT, SAMPLE_FLOAT)),
   max_factor(_max_factor),
   showvalues(_showvalues),
   frameno(0),
-  max_volume(-1.0f)
+  max_volume(-1.0f),
+  peakfile(_peakfile ? _peakfile : ""),
+  scanned(false),
+  scan_progress(-1)
 {
 }
 
 
 
-void __stdcall Normalize::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) {
-  if (max_volume < 0.0f) {
-    // Read samples into buffer and test them
-    if (vi.SampleType() == SAMPLE_INT16) {
-      __int64 bcount = count;
-      short* samples = (short*)buf;
-      bool bigbuff=false;
-
-	  if (vi.BytesFromAudioSamples(count) < BIGBUFFSIZE) {
-	    samples = new(std::nothrow) short[BIGBUFFSIZE/sizeof(short)];
-	    if (samples) {
-	      bigbuff=true;
-	      bcount = vi.AudioSamplesFromBytes(BIGBUFFSIZE);
-	    }
-	    else {
-	      samples = (short*)buf; // malloc failed just reuse clients buffer
-	    }
-	  }
+/* Peak scan
+ *
+ * The stream is read in order in chunks of 'bcount' samples, on the thread
+ * that asked for audio first. The filters below are not required to serve
+ * audio to several threads at once, so the reads can't be spread over the
+ * thread pool; a matching peak file skips them altogether. Per chunk the
+ * peaks and their first position are kept, merging them in chunk order gives
+ * the same result as scanning the whole stream at once. An int16 scan stops
+ * at the first full scale sample, as the serial scan did.
+ */
 
-      const __int64 passes = vi.num_audio_samples / bcount;
-	  __int64 negpeaksampleno=-1, pospeaksampleno=-1;
-      int i_pos_volume = 0;
-      int i_neg_volume = 0;
-      const int chanXbcount = (int)bcount * vi.AudioChannels();
-
-      for (__int64 i = 0; i < passes; i++) {
-        child->GetAudio(samples, bcount*i, bcount, env);
-        for (int j = 0; j < chanXbcount; j++) {
-		  const int sample=samples[j];
-          if (sample < i_neg_volume) {	// Cope with MIN_SHORT
-		    i_neg_volume = sample;
-		    negpeaksampleno = chanXbcount*i+j;
-			if (sample <= -32767) {
-			  i = passes;
-			  break;
-			}
-		  }
-		  else if (sample > i_pos_volume) {
-			i_pos_volume = sample;
-			pospeaksampleno = chanXbcount*i+j;
-			if (sample == 32767) {
-			  i = passes;
-			  break;
-			}
-		  }
-        }
-      }
-	  // Remaining samples
-	  if ((i_pos_volume != 32767) && (i_neg_volume > -32767)) {
-		const __int64 rem_samples = vi.num_audio_samples % bcount;
-		const int chanXremcount = (int)rem_samples * vi.AudioChannels();
-
-		child->GetAudio(samples, bcount*passes, rem_samples, env);
-		for (int j = 0; j < chanXremcount; j++) {
-		  const int sample=samples[j];
-		  if (sample < i_neg_volume) {	// Cope with MIN_SHORT
-			i_neg_volume = sample;
-			negpeaksampleno = chanXbcount*passes+j;
-		  }
-		  else if (sample > i_pos_volume) {
-			i_pos_volume = sample;
-			pospeaksampleno = chanXbcount*passes+j;
-		  }
-		}
-	  }
-	  if (bigbuff) delete[] samples;
+struct NormalizeChunkPeak {
+  int neg, pos;                 // int16
+  __int64 negsampleno, possampleno;
+  bool fullscale;
+  float peak;                   // float
+  __int64 peaksampleno;
+};
 
-	  i_pos_volume = -i_pos_volume; // Remember -ve has 1 more range than +ve, i.e. -32768
-	  if (i_neg_volume < i_pos_volume) {
-	    i_pos_volume = i_neg_volume;
-	    frameno = vi.FramesFromAudioSamples(negpeaksampleno / vi.AudioChannels());
-	  }
-	  else {
-	    frameno = vi.FramesFromAudioSamples(pospeaksampleno / vi.AudioChannels());
-	  }
-      max_volume = float(i_pos_volume * (-1.0/32768.0));
-      max_factor = max_factor / max_volume;
+struct NormalizeScan {
+  VideoInfo vi;
+  __int64 bcount;
+  __int64 nChunks;
 
-    } else if (vi.SampleType() == SAMPLE_FLOAT) {  // Float
-      __int64 bcount = count;
-      SFLOAT* samples = (SFLOAT*)buf;
-      bool bigbuff=false;
-
-	  if (vi.BytesFromAudioSamples(count) < BIGBUFFSIZE) {
-	    samples = new(std::nothrow) SFLOAT[BIGBUFFSIZE/sizeof(SFLOAT)];
-	    if (samples) {
-	      bigbuff=true;
-	      bcount = vi.AudioSamplesFromBytes(BIGBUFFSIZE);
-	    }
-	    else {
-	      samples = (SFLOAT*)buf; // malloc failed just reuse clients buffer
-	    }
-	  }
+  __int64 StopChunk;            // last chunk scanned
 
-      const int chanXbcount = (int)bcount * vi.AudioChannels();
-      const __int64 passes = vi.num_audio_samples / bcount;
-	  __int64 peaksampleno=-1;
-
-      for (__int64 i = 0;i < passes;i++) {
-        child->GetAudio(samples, bcount*i, bcount, env);
-        for (int j = 0;j < chanXbcount;j++) {
-		  const SFLOAT sample = fabsf(samples[j]);
-          if (sample > max_volume) {
-		    max_volume = sample;
-			peaksampleno = chanXbcount*i+j;
-		  }
+  std::vector<NormalizeChunkPeak> Peaks;
+};
+
+static void ScanChunk(NormalizeScan* scan, __int64 chunk, const void* buf) {
+  const VideoInfo& vi = scan->vi;
+  const bool last = (chunk == scan->nChunks - 1) && (vi.num_audio_samples % scan->bcount != 0);
+  const __int64 first = chunk * scan->bcount * vi.AudioChannels();
+  const int n = (int)(min(scan->bcount, vi.num_audio_samples - chunk * scan->bcount) * vi.AudioChannels());
+  NormalizeChunkPeak& p = scan->Peaks[(size_t)chunk];
+
+  if (vi.SampleType() == SAMPLE_INT16) {
+    const short* samples = (const short*)buf;
+    p.neg = 0; p.pos = 0;
+    p.negsampleno = -1; p.possampleno = -1;
+    p.fullscale = false;
+    for (int j = 0; j < n; j++) {
+      const int sample = samples[j];
+      if (sample < p.neg) {	// Cope with MIN_SHORT
+        p.neg = sample;
+        p.negsampleno = first + j;
+        if (sample <= -32767 && !last) {
+          p.fullscale = true;
+          break;
         }
       }
-      // Remaining samples
-      const __int64 rem_samples = vi.num_audio_samples % bcount;
-      const int chanXremcount = (int)rem_samples * vi.AudioChannels();
-
-      child->GetAudio(samples, bcount*passes, rem_samples, env);
-      for (int j = 0;j < chanXremcount;j++) {
-		const SFLOAT sample = fabsf(samples[j]);
-        if (sample > max_volume) {
-		  max_volume = sample;
-		  peaksampleno = chanXbcount*passes+j;
-		}
+      else if (sample > p.pos) {
+        p.pos = sample;
+        p.possampleno = first + j;
+        if (sample == 32767 && !last) {
+          p.fullscale = true;
+          break;
+        }
+      }
+    }
+  } else {
+    const SFLOAT* samples = (const SFLOAT*)buf;
+    p.peak = -1.0f;
+    p.peaksampleno = -1;
+    for (int j = 0; j < n; j++) {
+      const SFLOAT sample = fabsf(samples[j]);
+      if (sample > p.peak) {
+        p.peak = sample;
+        p.peaksampleno = first + j;
+      }
+    }
+  }
+}
+
+void Normalize::ScanPeak(__int64 count, IScriptEnvironment* env) {
+  NormalizeScan scan;
+  scan.vi = vi;
+  // chunk size as the serial scan had it: at least the big buffer
+  scan.bcount = (vi.BytesFromAudioSamples(count) < BIGBUFFSIZE) ? vi.AudioSamplesFromBytes(BIGBUFFSIZE) : count;
+  scan.nChunks = (vi.num_audio_samples + scan.bcount - 1) / scan.bcount;
+  scan.StopChunk = scan.nChunks - 1;
+  scan.Peaks.resize((size_t)scan.nChunks);
+  scan_progress = 0;
+
+  try
+  {
+    std::unique_ptr<char[]> buf(new char[(size_t)vi.BytesFromAudioSamples(scan.bcount)]);
+    for (__int64 chunk = 0; chunk < scan.nChunks; chunk++)
+    {
+      const __int64 n = min(scan.bcount, vi.num_audio_samples - chunk * scan.bcount);
+      child->GetAudio(buf.get(), chunk * scan.bcount, n, env);
+      ScanChunk(&scan, chunk, buf.get());
+
+      const int previous = scan_progress;
+      const int percent = (int)((chunk + 1) * 100 / scan.nChunks);
+      scan_progress = percent;
+      if (percent / 10 > previous / 10)
+        static_cast<InternalEnvironment*>(env)->LogMsg(LOGLEVEL_INFO, "Normalize: scanned %d%% of the audio", percent);
+
+      if (scan.Peaks[(size_t)chunk].fullscale) {
+        scan.StopChunk = chunk;
+        break;
+      }
+    }
+  }
+  catch (...)
+  {
+    scan_progress = -1;
+    throw;
+  }
+
+  const __int64 nMerge = min(scan.nChunks, scan.StopChunk + 1);
+  if (vi.SampleType() == SAMPLE_INT16) {
+    __int64 negpeaksampleno=-1, pospeaksampleno=-1;
+    int i_pos_volume = 0;
+    int i_neg_volume = 0;
+    for (__int64 k = 0; k < nMerge; k++) {
+      const NormalizeChunkPeak& p = scan.Peaks[(size_t)k];
+      if (p.neg < i_neg_volume) {
+        i_neg_volume = p.neg;
+        negpeaksampleno = p.negsampleno;
+      }
+      if (p.pos > i_pos_volume) {
+        i_pos_volume = p.pos;
+        pospeaksampleno = p.possampleno;
+      }
+    }
+
+    i_pos_volume = -i_pos_volume; // Remember -ve has 1 more range than +ve, i.e. -32768
+    if (i_neg_volume < i_pos_volume) {
+      i_pos_volume = i_neg_volume;
+      frameno = vi.FramesFromAudioSamples(negpeaksampleno / vi.AudioChannels());
+    }
+    else {
+      frameno = vi.FramesFromAudioSamples(pospeaksampleno / vi.AudioChannels());
+    }
+    max_volume = float(i_pos_volume * (-1.0/32768.0));
+  } else {
+    float peak = -1.0f;
+    __int64 peaksampleno=-1;
+    for (__int64 k = 0; k < nMerge; k++) {
+      const NormalizeChunkPeak& p = scan.Peaks[(size_t)k];
+      if (p.peak > peak) {
+        peak = p.peak;
+        peaksampleno = p.peaksampleno;
       }
-	  if (bigbuff) delete[] samples;
+    }
+    frameno = vi.FramesFromAudioSamples(peaksampleno / vi.AudioChannels());
+    max_volume = peak;
+  }
+  scan_progress = 100;
+}
+
+/* Peak file
+ *
+ * One line of text: a magic word, the clip signature, the peak and the frame
+ * it was found at. The signature covers the audio format and length and
+ * blocks of samples spread evenly over the whole stream, from its first to
+ * its last sample. That is cheap to read and tells apart different sources
+ * and edits, unless an edit keeps the length and falls between two blocks.
+ */
+
+static const char NormalizePeakMagic[] = "AvsNormalizePeak2";
+static const int PEAK_SIGNATURE_BLOCKS = 64;
+static const int PEAK_SIGNATURE_SAMPLES = 4096; // per block
+
+static unsigned __int64 fnv1a(unsigned __int64 h, const void* data, size_t size) {
+  const unsigned char* p = (const unsigned char*)data;
+  for (size_t i = 0; i < size; i++) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+unsigned __int64 Normalize::Signature(IScriptEnvironment* env) {
+  unsigned __int64 h = 0xcbf29ce484222325ULL;
+  const int format[3] = { vi.SampleType(), vi.AudioChannels(), vi.audio_samples_per_second };
+  h = fnv1a(h, format, sizeof(format));
+  h = fnv1a(h, &vi.num_audio_samples, sizeof(vi.num_audio_samples));
+
+  const __int64 count = min((__int64)PEAK_SIGNATURE_SAMPLES, vi.num_audio_samples);
+  const size_t bytes = (size_t)vi.BytesFromAudioSamples(count);
+  std::unique_ptr<char[]> buf(new char[bytes + 1]);
+  const __int64 span = vi.num_audio_samples - count;
+  for (int i = 0; i < PEAK_SIGNATURE_BLOCKS; i++) {
+    child->GetAudio(buf.get(), span * i / (PEAK_SIGNATURE_BLOCKS - 1), count, env);
+    h = fnv1a(h, buf.get(), bytes);
+  }
+  return h;
+}
+
+bool Normalize::LoadPeak(unsigned __int64 signature) {
+  FILE* f = fopen(peakfile.c_str(), "r");
+  if (!f)
+    return false;
+
+  char magic[32];
+  unsigned long long file_signature;
+  double peak;
+  int frame;
+  const bool ok = (fscanf(f, "%31s %llx %lf %d", magic, &file_signature, &peak, &frame) == 4)
+    && !strcmp(magic, NormalizePeakMagic) && (file_signature == signature);
+  fclose(f);
+  if (!ok)
+    return false;
+
+  max_volume = (float)peak;
+  frameno = frame;
+  return true;
+}
 
-	  frameno = vi.FramesFromAudioSamples(peaksampleno / vi.AudioChannels());
+void Normalize::SavePeak(unsigned __int64 signature) {
+  // not being able to write the file only costs a rescan next time
+  FILE* f = fopen(peakfile.c_str(), "w");
+  if (!f)
+    return;
+  fprintf(f, "%s %016llx %.9g %d\n", NormalizePeakMagic, (unsigned long long)signature, (double)max_volume, frameno);
+  fclose(f);
+}
+
+void __stdcall Normalize::GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env) {
+  if (!scanned) {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    if (!scanned) {
+      unsigned __int64 signature = 0;
+      bool loaded = false;
+      if (!peakfile.empty()) {
+        signature = Signature(env);
+        loaded = LoadPeak(signature);
+      }
+      if (!loaded) {
+        ScanPeak(count, env);
+        if (!peakfile.empty())
+          SavePeak(signature);
+      }
       max_factor = max_factor / max_volume;
+      scanned = true;
     }
   }
 
@@ -1030,7 +1154,10 @@ PVideoFrame __stdcall Normalize::GetFrame(int n, IScriptEnvironment* env) {
     env->MakeWritable(&src);
     char text[400];
 
-    if (max_volume < 0) {
+    const int progress = scan_progress;
+    if (!scanned && progress >= 0) {
+      sprintf(text, "Normalize: Scanning audio, %d%% done", progress);
+    } else if (!scanned) {
       sprintf(text, "Normalize: Result not yet calculated!");
     } else {
       double maxdb = 8.685889638 * log(max_factor);
@@ -1047,7 +1174,7 @@ PVideoFrame __stdcall Normalize::GetFrame(int n, IScriptEnvironment* env) {
 
 AVSValue __cdecl Normalize::Create(AVSValue args, void*, IScriptEnvironment* env) {
 
-  return new Normalize(args[0].AsClip(), args[1].AsFloatf(1.0f), args[2].AsBool(false));}
+  return new Normalize(args[0].AsClip(), args[1].AsFloatf(1.0f), args[2].AsBool(false), args[3].AsString(NULL));}
 
 
 /*****************************
@@ -1175,6 +1302,8 @@ ResampleAudio::ResampleAudio(PClip _child, int _target_rate_n, int _target_rate_
 {
   srcbuffer  = 0;
   fsrcbuffer = 0;
+  bank_step  = 0;
+  bank_taps  = 0;
 
   if (vi.audio_samples_per_second == 0) {
     skip_conversion = true;
@@ -1249,6 +1378,204 @@ ResampleAudio::ResampleAudio(PClip _child, int _target_rate_n, int _target_rate_
 
   double dh = min(double(Npc), factor * Npc);  /* Filter sampling period */
   dhb = int(dh * (1 << Na) + 0.5);
+
+  BuildPolyphaseBanks();
+}
+
+
+/* Polyphase resampling
+ *
+ * FilterUD reads the filter taps of an output sample at Ho, Ho+dhb,
+ * Ho+2*dhb, ... in the table, interpolating between the filter points with
+ * Ho & Amask. When dhb is a multiple of Amask+1 (all upsampling, and
+ * downsampling by ratios like 2:1) every tap of a wing has the same
+ * interpolation weight, so the taps only depend on Ho >> Na: they are laid
+ * out once per phase and an output sample becomes two dot products over
+ * contiguous memory. The int16 path sums exactly the same integer terms as
+ * FilterUD and gives the same output; the float path differs only by the
+ * order of the additions.
+ */
+
+// Zeroed samples around each channel plane, the banks are padded to a
+// multiple of 16 taps and may read past the real ones
+static const int POLYPHASE_GUARD = 16;
+
+// sum over 'taps' of (coef + delta * a) * x, taps a multiple of 16
+static float resample_audio_dot_sse2(const float* coef, const float* delta, float a, const float* x, int taps) {
+  const __m128 fa = _mm_set1_ps(a);
+  __m128 acc0 = _mm_setzero_ps();
+  __m128 acc1 = _mm_setzero_ps();
+  for (int i = 0; i < taps; i += 8) {
+    __m128 c0 = _mm_add_ps(_mm_loadu_ps(coef + i),     _mm_mul_ps(_mm_loadu_ps(delta + i),     fa));
+    __m128 c1 = _mm_add_ps(_mm_loadu_ps(coef + i + 4), _mm_mul_ps(_mm_loadu_ps(delta + i + 4), fa));
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(c0, _mm_loadu_ps(x + i)));
+    acc1 = _mm_add_ps(acc1, _mm_mul_ps(c1, _mm_loadu_ps(x + i + 4)));
+  }
+  acc0 = _mm_add_ps(acc0, acc1);
+  acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+  acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+  return _mm_cvtss_f32(acc0);
+}
+
+// int16 version of the above, with FilterUD's rounding of the interpolated
+// coefficient. 'delta' holds pairs of (delta, 1 << (Na-1)).
+static __int64 resample_audio_dot_int16_sse2(const int* coef, const short* delta, int a, const short* x, int taps) {
+  const __m128i fa = _mm_set1_epi32((1 << 16) | a); // delta*a + round*1
+  __m128i acc = _mm_setzero_si128();
+  for (int i = 0; i < taps; i += 8) {
+    __m128i c0 = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(delta + 2*i)),     fa), Na);
+    __m128i c1 = _mm_srai_epi32(_mm_madd_epi16(_mm_loadu_si128((const __m128i*)(delta + 2*i + 8)), fa), Na);
+    c0 = _mm_add_epi32(c0, _mm_loadu_si128((const __m128i*)(coef + i)));
+    c1 = _mm_add_epi32(c1, _mm_loadu_si128((const __m128i*)(coef + i + 4)));
+    // interpolated coefficients stay within +-32767, so a pair of products
+    // fits in 32 bits; sum them up in 64 bits like FilterUD
+    __m128i p = _mm_madd_epi16(_mm_packs_epi32(c0, c1), _mm_loadu_si128((const __m128i*)(x + i)));
+    __m128i sign = _mm_srai_epi32(p, 31);
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(p, sign));
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(p, sign));
+  }
+  acc = _mm_add_epi64(acc, _mm_unpackhi_epi64(acc, acc));
+  __int64 v;
+  _mm_storel_epi64((__m128i*)&v, acc);
+  return v;
+}
+
+void ResampleAudio::BuildPolyphaseBanks() {
+  bank_step = 0;
+  if (dhb % (Amask + 1) != 0)
+    return;
+
+  const int step = dhb >> Na;
+  const int taps = ((Nwing + step - 1) / step + 15) & ~15;
+  const bool isint16 = vi.IsSampleType(SAMPLE_INT16);
+
+  for (int w = 0; w < 2; w++) {
+    // The right wing drops the last filter point and, at phase 0, skips a
+    // whole step: one phase more, Ho == dhb.
+    const int phases = step + w;
+    const int End = Nwing - w;
+    if (isint16) {
+      ibank[w].assign((size_t)phases * taps, 0);
+      ibankd[w].assign((size_t)phases * taps * 2, 0);
+    }
+    else
+      fbank[w].assign((size_t)phases * taps * 2, 0.0f);
+
+    for (int p = 0; p < phases; p++) {
+      for (int k = 0; p + k * step < End; k++) {
+        const int h = p + k * step;
+        const int j = w ? k : taps - 1 - k;
+        if (isint16) {
+          const int d = Imp[h + 1] - Imp[h];
+          if (d < -32768 || d > 32767) { // does not happen with makeFilter's tables
+            ibank[0].clear(); ibank[1].clear();
+            ibankd[0].clear(); ibankd[1].clear();
+            return;
+          }
+          ibank[w][(size_t)p * taps + j] = Imp[h];
+          ibankd[w][((size_t)p * taps + j) * 2]     = (short)d;
+          ibankd[w][((size_t)p * taps + j) * 2 + 1] = 1 << (Na - 1);
+        }
+        else {
+          fbank[w][(size_t)p * taps * 2 + j]        = fImp[h];
+          fbank[w][(size_t)p * taps * 2 + taps + j] = fImp[h + 1] - fImp[h];
+        }
+      }
+    }
+  }
+  bank_taps = taps;
+  bank_step = step;
+}
+
+void ResampleAudio::PolyphaseInt16(const short* src, short* dst, __int64 count, __int64 source_samples, __int64 pos, int cpu) {
+  const int ch = vi.AudioChannels();
+  const int taps = bank_taps;
+  const size_t stride = (size_t)source_samples + 2 * POLYPHASE_GUARD;
+  if (iplanar.size() < stride * ch)
+    iplanar.resize(stride * ch);
+
+  for (int q = 0; q < ch; q++) {
+    short* plane = &iplanar[q * stride];
+    std::fill(plane, plane + POLYPHASE_GUARD, (short)0);
+    for (__int64 i = 0; i < source_samples; i++)
+      plane[POLYPHASE_GUARD + i] = src[i * ch + q];
+    std::fill(plane + POLYPHASE_GUARD + source_samples, plane + stride, (short)0);
+  }
+
+  __int64 (*dot)(const int*, const short*, int, const short*, int) = resample_audio_dot_int16_sse2;
+  if (cpu & CPUF_AVX2)
+    dot = resample_audio_dot_int16_avx2;
+
+  unsigned dtberror = 0;
+  for (__int64 i = 0; i < count; i++) {
+    const size_t n0 = (size_t)(pos >> Np) + POLYPHASE_GUARD;
+    const unsigned HoL = ((unsigned)(pos & Pmask) * (unsigned)dhb) >> Np;
+    const unsigned PhR = (unsigned)(-pos) & Pmask;
+    const unsigned HoR = ((PhR * (unsigned)dhb) >> Np) + (PhR == 0 ? dhb : 0);
+    const size_t bL = (size_t)(HoL >> Na) * taps;
+    const size_t bR = (size_t)(HoR >> Na) * taps;
+
+    for (int q = 0; q < ch; q++) {
+      const short* x = &iplanar[q * stride + n0];
+      __int64 v64 = dot(&ibank[0][bL], &ibankd[0][bL * 2], HoL & Amask, x - taps + 1, taps);
+      v64 += dot(&ibank[1][bR], &ibankd[1][bR * 2], HoR & Amask, x + 1, taps);
+      v64 += 1 << (Nh - 1);                                        /* Round only once!                 */
+      int v32 = int(v64 >> Nh);                                    /* Make guard bits once!            */
+      v32 *= LpScl;                                                /* Normalize for unity filter gain  */
+      *dst++ = IntToShort(v32, NLpScl);                            /* strip guard bits, deposit output */
+    }
+    if ((dtberror += dtbe) >= (1u << 31)) { // Don't be a creep ;-)
+      dtberror -= (1u << 31);
+      pos += dtb + 1;
+    }
+    else {
+      pos += dtb;
+    }
+  }
+}
+
+void ResampleAudio::PolyphaseFloat(const SFLOAT* src, SFLOAT* dst, __int64 count, __int64 source_samples, __int64 pos, int cpu) {
+  const int ch = vi.AudioChannels();
+  const int taps = bank_taps;
+  const size_t stride = (size_t)source_samples + 2 * POLYPHASE_GUARD;
+  if (fplanar.size() < stride * ch)
+    fplanar.resize(stride * ch);
+
+  for (int q = 0; q < ch; q++) {
+    SFLOAT* plane = &fplanar[q * stride];
+    std::fill(plane, plane + POLYPHASE_GUARD, 0.0f);
+    for (__int64 i = 0; i < source_samples; i++)
+      plane[POLYPHASE_GUARD + i] = src[i * ch + q];
+    std::fill(plane + POLYPHASE_GUARD + source_samples, plane + stride, 0.0f);
+  }
+
+  float (*dot)(const float*, const float*, float, const float*, int) = resample_audio_dot_sse2;
+  if (cpu & CPUF_AVX2)
+    dot = resample_audio_dot_avx2;
+
+  unsigned dtberror = 0;
+  for (__int64 i = 0; i < count; i++) {
+    const size_t n0 = (size_t)(pos >> Np) + POLYPHASE_GUARD;
+    const unsigned HoL = ((unsigned)(pos & Pmask) * (unsigned)dhb) >> Np;
+    const unsigned PhR = (unsigned)(-pos) & Pmask;
+    const unsigned HoR = ((PhR * (unsigned)dhb) >> Np) + (PhR == 0 ? dhb : 0);
+    const SFLOAT* bL = &fbank[0][(size_t)(HoL >> Na) * taps * 2];
+    const SFLOAT* bR = &fbank[1][(size_t)(HoR >> Na) * taps * 2];
+    const float aL = fAmasktab[HoL & Amask];
+    const float aR = fAmasktab[HoR & Amask];
+
+    for (int q = 0; q < ch; q++) {
+      const SFLOAT* x = &fplanar[q * stride + n0];
+      *dst++ = dot(bL, bL + taps, aL, x - taps + 1, taps) + dot(bR, bR + taps, aR, x + 1, taps);
+    }
+    if ((dtberror += dtbe) >= (1u << 31)) { // Don't be a creep ;-)
+      dtberror -= (1u << 31);
+      pos += dtb + 1;
+    }
+    else {
+      pos += dtb;
+    }
+  }
 }
 
 
@@ -1296,6 +1623,9 @@ void __stdcall ResampleAudio::GetAudio(void* buf, __int64 start, __int64 count,
 
 	short* dst_end = &dst[count * ch];
 
+	if (bank_step && (env->GetCPUFlags() & CPUF_SSE2))
+	  PolyphaseInt16(srcbuffer, dst, count, source_samples, pos, env->GetCPUFlags());
+	else
 #if defined(X86_32) && defined(MSVC)
 	if (env->GetCPUFlags() & CPUF_MMX)
   {
@@ -1440,6 +1770,11 @@ nofix:
 
 	SFLOAT* dst_end = &dst[count * ch];
 
+	if (bank_step && (env->GetCPUFlags() & CPUF_SSE2)) {
+	  PolyphaseFloat(fsrcbuffer, dst, count, source_samples, pos, env->GetCPUFlags());
+	  return;
+	}
+
 	while (dst < dst_end) {
 	  for (int q = 0; q < ch; q++) {
 		SFLOAT* Xp = &fsrcbuffer[(pos >> Np) * ch];
@@ -1460,6 +1795,24 @@ nofix:
 }
 
 
+int __stdcall ResampleAudio::SetCacheHints(int cachehints, int frame_range) {
+
+  // Encoders pull overlapping chunks, let the parent cache keep our output
+
+  switch (cachehints) {
+    case CACHE_GETCHILD_AUDIO_MODE: // Parent Cache asking Child for desired audio cache mode
+      return CACHE_AUDIO_AUTO;
+
+    case CACHE_GETCHILD_AUDIO_SIZE: // Parent Cache asking Child for desired audio cache size
+      return 1024*1024;
+
+    default:
+      break;
+  }
+  return 0;
+}
+
+
 AVSValue __cdecl ResampleAudio::Create(AVSValue args, void*, IScriptEnvironment* env) {
   return new ResampleAudio(args[0].AsClip(), args[1].AsInt(), args[2].AsInt(1), env);
 }
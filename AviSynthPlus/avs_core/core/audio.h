@@ -36,6 +36,10 @@
 
 #include <avisynth.h>
 #include <cmath>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
 
 
 
@@ -258,7 +262,7 @@ class Normalize : public GenericVideoFilter
  **/
 {
 public:
-  Normalize(PClip _child, float _max_factor, bool _showvalues);
+  Normalize(PClip _child, float _max_factor, bool _showvalues, const char* _peakfile);
   void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
   PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
 
@@ -266,10 +270,20 @@ public:
 
 
 private:
+  void ScanPeak(__int64 count, IScriptEnvironment* env);
+  unsigned __int64 Signature(IScriptEnvironment* env);
+  bool LoadPeak(unsigned __int64 signature);
+  void SavePeak(unsigned __int64 signature);
+
   float max_factor;
   float max_volume;
   int   frameno;
   bool showvalues;
+
+  std::string peakfile;         // sidecar file with the peak, empty: always scan
+  std::mutex scan_mutex;
+  std::atomic<bool> scanned;
+  std::atomic<int> scan_progress; // percent, -1 before the scan
 };
 
 class MixAudio : public GenericVideoFilter
@@ -305,6 +319,7 @@ public:
     { delete[]  srcbuffer;
       delete[] fsrcbuffer; }
   void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironment* env);
+  int __stdcall SetCacheHints(int cachehints, int frame_range);
 
   static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env);
 
@@ -314,6 +329,10 @@ private:
   __int64 FilterUD(short  *Xp, short Ph, short Inc);
   SFLOAT  FilterUD(SFLOAT *Xp, short Ph, short Inc);
 
+  void BuildPolyphaseBanks();
+  void PolyphaseInt16(const short* src, short* dst, __int64 count, __int64 source_samples, __int64 pos, int cpu);
+  void PolyphaseFloat(const SFLOAT* src, SFLOAT* dst, __int64 count, __int64 source_samples, __int64 pos, int cpu);
+
   const double factor;
   int Xoff, dtb, dhb;
   unsigned dtbe;
@@ -328,6 +347,18 @@ private:
 
   __int64 last_start, last_samples;
 
+  // Polyphase banks, per wing ([0] left, [1] right) and phase: bank_taps
+  // coefficients and their deltas to the next filter point. The left wing
+  // is stored backwards so both wings run forward over the input.
+  int bank_step;   // phases of the left wing, 0 if there are no banks
+  int bank_taps;   // multiple of 16
+  std::vector<SFLOAT> fbank[2];
+  std::vector<int>    ibank[2];
+  std::vector<short>  ibankd[2]; // pairs of (delta, rounding)
+
+  std::vector<SFLOAT> fplanar;   // source split into channels
+  std::vector<short>  iplanar;
+
   union { // Share storage
 	SFLOAT fImp[Nwing+1];
 	short Imp[Nwing+1];
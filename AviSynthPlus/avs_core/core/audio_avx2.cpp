@@ -0,0 +1,84 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+// experimental simd includes for avx2 compiled files
+#if defined (__GNUC__) && ! defined (__INTEL_COMPILER)
+#include <x86intrin.h>
+// x86intrin.h includes header files for whatever instruction
+// sets are specified on the compiler command line, such as: xopintrin.h, fma4intrin.h
+#else
+#include <immintrin.h> // MS version of immintrin.h covers AVX, AVX2 and FMA3
+#endif // __GNUC__
+
+#include "audio_avx2.h"
+#include "internal.h"
+#include "audio.h"
+
+float resample_audio_dot_avx2(const float* coef, const float* delta, float a, const float* x, int taps) {
+  const __m256 fa = _mm256_set1_ps(a);
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  for (int i = 0; i < taps; i += 16) {
+    __m256 c0 = _mm256_add_ps(_mm256_loadu_ps(coef + i),     _mm256_mul_ps(_mm256_loadu_ps(delta + i),     fa));
+    __m256 c1 = _mm256_add_ps(_mm256_loadu_ps(coef + i + 8), _mm256_mul_ps(_mm256_loadu_ps(delta + i + 8), fa));
+    acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(c0, _mm256_loadu_ps(x + i)));
+    acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(c1, _mm256_loadu_ps(x + i + 8)));
+  }
+  acc0 = _mm256_add_ps(acc0, acc1);
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+__int64 resample_audio_dot_int16_avx2(const int* coef, const short* delta, int a, const short* x, int taps) {
+  const __m256i fa = _mm256_set1_epi32((1 << 16) | a); // delta*a + round*1
+  __m256i acc = _mm256_setzero_si256();
+  for (int i = 0; i < taps; i += 16) {
+    __m256i c0 = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(delta + 2*i)),      fa), Na);
+    __m256i c1 = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(delta + 2*i + 16)), fa), Na);
+    c0 = _mm256_add_epi32(c0, _mm256_loadu_si256((const __m256i*)(coef + i)));
+    c1 = _mm256_add_epi32(c1, _mm256_loadu_si256((const __m256i*)(coef + i + 8)));
+    // packs works per lane, put the taps back in order
+    __m256i c = _mm256_permute4x64_epi64(_mm256_packs_epi32(c0, c1), 0xD8);
+    __m256i p = _mm256_madd_epi16(c, _mm256_loadu_si256((const __m256i*)(x + i)));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(p)));
+    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(p, 1)));
+  }
+  __m128i s = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  s = _mm_add_epi64(s, _mm_unpackhi_epi64(s, s));
+  __int64 v;
+  _mm_storel_epi64((__m128i*)&v, s);
+  return v;
+}
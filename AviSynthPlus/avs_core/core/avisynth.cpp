@@ -58,6 +58,8 @@
 #include <cassert>
 #include "MTGuard.h"
 #include "cache.h"
+#include "FrameMemory.h"
+#include "FilterProfiler.h"
 #include <clocale>
 
 #ifndef YieldProcessor // low power spin idle
@@ -384,15 +386,19 @@ VideoFrameBuffer::VideoFrameBuffer(size_t size) :
 #else
 VideoFrameBuffer::VideoFrameBuffer(int size) :
 #endif
-#ifdef _DEBUG
-  data(new BYTE[size+16]),
-#else
-  data(new BYTE[size]),
-#endif
+  data(NULL),
   data_size(size),
   sequence_number(0),
   refcount(0)
   {
+  bool degraded;
+#ifdef _DEBUG
+  data = FrameMemoryAlloc(size+16, FRAME_MEMORY_HEAP, degraded);
+#else
+  data = FrameMemoryAlloc(size, FRAME_MEMORY_HEAP, degraded);
+#endif
+  if (data == NULL)
+    throw std::bad_alloc();
 
 #ifdef _DEBUG
   int *pInt=(int *)(data+size);
@@ -418,7 +424,7 @@ VideoFrameBuffer::VideoFrameBuffer(int size) :
 VideoFrameBuffer::~VideoFrameBuffer() {
 //  _ASSERTE(refcount == 0);
   InterlockedIncrement(&sequence_number); // HACK : Notify any children with a pointer, this buffer has changed!!!
-  if (data) delete[] data;
+  if (data) FrameMemoryFree(data);
   data = nullptr; // and mark it invalid!!
   data_size = 0;   // and don't forget to set the size to 0 as well!
 }
@@ -709,6 +715,9 @@ public:
   void __stdcall AtExit(IScriptEnvironment::ShutdownFunc function, void* user_data);
   PVideoFrame __stdcall Subframe(PVideoFrame src, int rel_offset, int new_pitch, int new_row_size, int new_height);
   int __stdcall SetMemoryMax(int mem);
+  int __stdcall SetMemoryMode(int mode);
+  void __stdcall SetFilterProfile(const char* filename);
+  int __stdcall WriteFilterProfile();
   int __stdcall SetWorkingDir(const char * newdir);
   AVSC_CC ~ScriptEnvironment();
   void* __stdcall ManageCache(int key, void* data);
@@ -738,6 +747,7 @@ public:
   virtual int __stdcall IncrImportDepth();
   virtual int __stdcall DecrImportDepth();
   virtual void __stdcall SetPrefetcher(Prefetcher *p);
+  virtual void __stdcall DeclareFrameDependency(const PClip& clip, int n);
   virtual void __stdcall AdjustMemoryConsumption(size_t amount, bool minus);
   virtual bool __stdcall Invoke(AVSValue *result, const char* name, const AVSValue& args, const char* const* arg_names=0);
   virtual void __stdcall SetFilterMTMode(const char* filter, MtMode mode, bool force);
@@ -785,6 +795,7 @@ private:
   void EnsureMemoryLimit(size_t request);
   unsigned __int64 memory_max;
   std::atomic<unsigned __int64> memory_used;
+  int frame_memory_mode;
   std::unordered_map<IClip*, ClipDataStore> clip_data;
 
   void ExportBuiltinFilters();
@@ -813,7 +824,15 @@ private:
   };
   typedef std::vector<DebugTimestampedFrame> VideoFrameArrayType;
   typedef std::map<VideoFrameBuffer *, VideoFrameArrayType> FrameBufferRegistryType;
-  typedef std::map<size_t, FrameBufferRegistryType> FrameRegistryType2; // post r1825 P.F.
+  // One entry per frame size class. Every buffer in a class has exactly the class size,
+  // so any free one of them can serve any request that rounds to that class.
+  struct FrameSizeClass
+  {
+    FrameBufferRegistryType buffers;
+    VideoFrameBuffer *last_hit; // search key only, the buffer may already be gone
+    FrameSizeClass() : last_hit(NULL) {}
+  };
+  typedef std::map<size_t, FrameSizeClass> FrameRegistryType2; // post r1825 P.F.
   typedef mapped_list<Cache*> CacheRegistryType;
 
 
@@ -833,6 +852,7 @@ private:
   typedef std::vector<MTGuard*> MTGuardRegistryType;
   MTGuardRegistryType MTGuardRegistry;
   Prefetcher *prefetcher;
+  FilterProfiler *filter_profiler;
 
   // Members used to reconstruct Association between Invoke() calls and filter instances
   std::stack<MtModeEvaluator*> invoke_stack;
@@ -900,6 +920,7 @@ ScriptEnvironment::ScriptEnvironment()
     ImportDepth(0),
     FrontCache(NULL),
     prefetcher(NULL),
+    filter_profiler(NULL),
     BufferPool(this)
 {
   try {
@@ -922,6 +943,7 @@ ScriptEnvironment::ScriptEnvironment()
     const bool isX64 = sizeof(void *) == 8;
     memory_max = min(memory_max, (isX64 ? 4096 : 1024)*(1024*1024ull));  // at start, cap memory usage to 1GB(x86)/4GB (x64)
     memory_used = 0ull;
+    frame_memory_mode = FRAME_MEMORY_HEAP;
 
     global_var_table = new VarTable(0, 0);
     var_table = new VarTable(0, global_var_table);
@@ -989,6 +1011,10 @@ ScriptEnvironment::~ScriptEnvironment() {
 
   _RPT0(0, "~ScriptEnvironment() called.\n");
 
+  // Write the profile while the caches can still be asked for their counters
+  if (filter_profiler && filter_profiler->Write() < 0)
+    LogMsg(LOGLEVEL_WARNING, "Could not write the filter profile.");
+
   closing = true;
 
   // Before we start to pull the world apart
@@ -1021,7 +1047,7 @@ ScriptEnvironment::~ScriptEnvironment() {
   it != end_it;
     ++it)
   {
-    for (FrameBufferRegistryType::iterator it2 = (it->second).begin(), end_it2 = (it->second).end();
+    for (FrameBufferRegistryType::iterator it2 = (it->second.buffers).begin(), end_it2 = (it->second.buffers).end();
     it2 != end_it2;
       ++it2)
     {
@@ -1053,6 +1079,7 @@ ScriptEnvironment::~ScriptEnvironment() {
       LogMsg(LOGLEVEL_WARNING, "A plugin or the host application might be causing memory leaks.");
   }
 
+  delete filter_profiler;
   delete plugin_manager;
   delete [] vsprintf_buf;
 
@@ -1225,6 +1252,18 @@ void __stdcall ScriptEnvironment::SetPrefetcher(Prefetcher *p)
   }
 }
 
+void __stdcall ScriptEnvironment::DeclareFrameDependency(const PClip& clip, int n)
+{
+  // Only a running Prefetcher has threads to fetch the frame ahead of time
+  if (prefetcher)
+    prefetcher->DeclareFrame(clip, n, this);
+}
+
+void DeclareFrameDependency(const PClip& clip, int n, IScriptEnvironment* env)
+{
+  static_cast<InternalEnvironment*>(env)->DeclareFrameDependency(clip, n);
+}
+
 void __stdcall ScriptEnvironment::AdjustMemoryConsumption(size_t amount, bool minus)
 {
   if (minus)
@@ -1376,6 +1415,8 @@ size_t  __stdcall ScriptEnvironment::GetProperty(AvsEnvProperty prop)
     return thread_pool->NumThreads();
   case AEP_VERSION:
     return AVS_SEQREV;
+  case AEP_FILTER_PROFILE:
+    return (filter_profiler != NULL) ? filter_profiler->Count() : 0;
   default:
     this->ThrowError("Invalid property request.");
     return std::numeric_limits<size_t>::max();
@@ -1427,6 +1468,33 @@ int ScriptEnvironment::SetMemoryMax(int mem) {
   return (int)(memory_max/1048576ull);
 }
 
+int ScriptEnvironment::SetMemoryMode(int mode) {
+
+  if (mode >= 0)  /* If mode is negative, we should just return current setting */
+    frame_memory_mode = mode & (FRAME_MEMORY_LARGE_PAGES | FRAME_MEMORY_NUMA);
+
+  return frame_memory_mode;
+}
+
+void ScriptEnvironment::SetFilterProfile(const char* filename) {
+  std::unique_lock<std::recursive_mutex> env_lock(memory_mutex);
+
+  if (filter_profiler != NULL)
+    ThrowError("SetFilterProfile: profiling is already enabled.");
+
+  filter_profiler = new FilterProfiler(filename);
+}
+
+int ScriptEnvironment::WriteFilterProfile() {
+  if (filter_profiler == NULL)
+    ThrowError("WriteFilterProfile: profiling is not enabled, call SetFilterProfile() first.");
+
+  const int written = filter_profiler->Write();
+  if (written < 0)
+    ThrowError("WriteFilterProfile: could not write the filter profile.");
+  return written;
+}
+
 int ScriptEnvironment::SetWorkingDir(const char * newdir) {
   return SetCurrentDirectory(newdir) ? 0 : 1;
 }
@@ -1525,6 +1593,25 @@ bool ScriptEnvironment::SetGlobalVar(const char* name, const AVSValue& val) {
   return global_var_table->Set(name, val);
 }
 
+// Frame buffers are handed out in size classes: the old fixed steps up to 4K,
+// above that eight classes per power of two. This keeps the number of distinct
+// buffer sizes small while wasting at most 1/8 of a buffer, instead of the 1/2
+// that reusing any free buffer up to 1.5x bigger used to allow.
+static size_t GetFrameSizeClass(size_t size)
+{
+  if (size <= 64) return 64;
+  if (size <= 256) return 256;
+  if (size <= 512) return 512;
+  if (size <= 1024) return 1024;
+  if (size <= 2048) return 2048;
+  if (size <= 4096) return 4096;
+
+  size_t step = 4096 / 8;
+  while (step * 16 < size)
+    step <<= 1;
+  return (size + step - 1) & ~(step - 1);
+}
+
 VideoFrame* ScriptEnvironment::AllocateFrame(size_t vfb_size)
 {
   if (vfb_size > (size_t)std::numeric_limits<int>::max())
@@ -1537,7 +1624,31 @@ VideoFrame* ScriptEnvironment::AllocateFrame(size_t vfb_size)
   VideoFrameBuffer* vfb = NULL;
   try
   {
-    vfb = new VideoFrameBuffer((int)vfb_size);
+    if (frame_memory_mode == FRAME_MEMORY_HEAP)
+    {
+      vfb = new VideoFrameBuffer((int)vfb_size);
+    }
+    else
+    {
+      // The VideoFrameBuffer constructors only know about the heap,
+      // large page and NUMA backed buffers are filled in here.
+      vfb = new VideoFrameBuffer();
+      vfb->refcount = 0;
+      bool degraded;
+      vfb->data = FrameMemoryAlloc(vfb_size, frame_memory_mode, degraded);
+      if (vfb->data == NULL)
+      {
+        delete vfb;
+        return NULL;
+      }
+      vfb->data_size = (int)vfb_size;
+
+      if (degraded)
+      {
+        OneTimeLogTicket ticket(LOGTICKET_W1011);
+        LogMsgOnce(ticket, LOGLEVEL_WARNING, "SetMemoryMode: large pages are not available, using normal pages instead. The account running Avisynth needs the 'Lock pages in memory' right.");
+      }
+    }
   }
   catch(const std::bad_alloc&)
   {
@@ -1555,11 +1666,11 @@ VideoFrame* ScriptEnvironment::AllocateFrame(size_t vfb_size)
     return NULL;
   }
 
-  memory_used+=vfb_size;
+  memory_used += FrameMemoryFootprint(vfb->data);
 
   // automatically inserts keys if they not exist!
   // no locking here, calling method have done it already
-  FrameRegistry2[vfb_size][vfb].push_back(DebugTimestampedFrame(newFrame));
+  FrameRegistry2[vfb_size].buffers[vfb].push_back(DebugTimestampedFrame(newFrame));
 
   //_RPT1(0, "ScriptEnvironment::AllocateFrame %Iu frame=%p vfb=%p %I64d\n", vfb_size, newFrame, newFrame->vfb, memory_used); // P.F.
 
@@ -1587,8 +1698,8 @@ void ScriptEnvironment::ListFrameRegistry(size_t min_size, size_t max_size, bool
     ++it)
   {
     size1++;
-    _RPT3(0, ">>>> IterateLevel #2 [%3d]: Vfb count for size %7Iu is %7Iu\n", size1, it->first, it->second.size());
-    for (FrameBufferRegistryType::iterator it2 = it->second.begin(), end_it2 = it->second.end();
+    _RPT3(0, ">>>> IterateLevel #2 [%3d]: Vfb count for size %7Iu is %7Iu\n", size1, it->first, it->second.buffers.size());
+    for (FrameBufferRegistryType::iterator it2 = it->second.buffers.begin(), end_it2 = it->second.buffers.end();
       it2 != end_it2;
       ++it2)
     {
@@ -1663,107 +1774,62 @@ VideoFrame* ScriptEnvironment::GetNewFrame(size_t vfb_size)
    *   Try to return an unused but already allocated instance
    * -----------------------------------------------------------
    */
-   // prevent fragmentation of vfb buffer list many different small-sized vfb's
-  if (vfb_size < 64) vfb_size = 64;
-  else if (vfb_size < 256) vfb_size = 256;
-  else if (vfb_size < 512) vfb_size = 512;
-  else if (vfb_size < 1024) vfb_size = 1024;
-  else if (vfb_size < 2048) vfb_size = 2048;
-  else if (vfb_size < 4096) vfb_size = 4096;
+   // Requests are rounded up to a size class (see GetFrameSizeClass), so a free
+   // buffer is found by looking at a single registry entry instead of every size
+   // within reach of the request.
+  vfb_size = GetFrameSizeClass(vfb_size);
+  FilterProfiler::AddAllocation(vfb_size);
 
 #ifdef _DEBUG
   std::chrono::time_point<std::chrono::high_resolution_clock> t_start, t_end; // std::chrono::time_point<std::chrono::system_clock> t_start, t_end;
   t_start = std::chrono::high_resolution_clock::now();
 #endif
 
-  // FrameRegistry2 is like: map<key1, map<key2, vector<VideoFrame *>> >
-  // typedef std::vector<VideoFrame*> VideoFrameArrayType;
-  // typedef std::map<VideoFrameBuffer *, VideoFrameArrayType> FrameBufferRegistryType;
-  // typedef std::map<size_t, FrameBufferRegistryType> FrameRegistryType2;
-  // [vfb_size = 10000][vfb = 0x111111111] [frame = 0x129837192(,timestamp=xxx)]
+  // FrameRegistry2 is like: map<size_class, {map<vfb, vector<VideoFrame *>>, last_hit}>
+  // [vfb_size = 10240][vfb = 0x111111111] [frame = 0x129837192(,timestamp=xxx)]
   //                                       [frame = 0x012312122(,timestamp=xxx)]
-  //                                       [frame = 0x232323232(,timestamp=xxx)]
   //                   [vfb = 0x222222222] [frame = 0x333333333(,timestamp=xxx)]
-  //                                       [frame = 0x444444444(,timestamp=xxx)]
-  // Which is better?
-  // - found exact vfb_size or
-  // - allow reusing existing vfb's with size up to size_to_find*1.5 THIS ONE!
-  // - allow to occupy any buffer that is bigger than the requested size
-  //for (FrameRegistryType2::iterator it = FrameRegistry2.lower_bound(vfb_size), end_it = FrameRegistry2.upper_bound(vfb_size); // exact! no-go. special service clips can fragment it
-  //for (FrameRegistryType2::iterator it = FrameRegistry2.lower_bound(vfb_size), end_it = FrameRegistry2.end(); // vfb_size or bigger, so a 100K size would claim a 1.5M space.
-  for (FrameRegistryType2::iterator it = FrameRegistry2.lower_bound(vfb_size), end_it = FrameRegistry2.upper_bound(vfb_size * 3 / 2); // vfb_size or at most 1.5* bigger
-      it != end_it;
-    ++it)
+  //                   last_hit = 0x111111111
+  FrameRegistryType2::iterator it = FrameRegistry2.find(vfb_size);
+  if (it != FrameRegistry2.end())
   {
-    for (FrameBufferRegistryType::iterator it2 = it->second.begin(), end_it2 = it->second.end();
-      it2 != end_it2;
-      ++it2)
+    FrameSizeClass &size_class = it->second;
+    FrameBufferRegistryType &buffers = size_class.buffers;
+    // Resume after the buffer handed out last time, so that successive requests
+    // rotate through the class instead of rescanning the busy buffers at its start.
+    FrameBufferRegistryType::iterator it2 = buffers.upper_bound(size_class.last_hit);
+    for (size_t remaining = buffers.size(); remaining > 0; --remaining, ++it2)
     {
+      if (it2 == buffers.end())
+        it2 = buffers.begin();
+
       VideoFrameBuffer *vfb = it2->first; // same for all map content, the key is vfb pointer
-      if (0 == vfb->refcount) // vfb refcount check
+      if (0 != vfb->refcount) // vfb refcount check
+        continue;
+
+      // when a vfb is free (refcount==0) then all its frames are free as well:
+      // keep the first one and delete the others, no 4-5k frame list count per a single vfb.
+      VideoFrameArrayType &frames = it2->second;
+      VideoFrame *frame = frames.front().frame;
+      assert(0 == frame->refcount);
+      for (VideoFrameArrayType::iterator it3 = frames.begin() + 1, end_it3 = frames.end(); it3 != end_it3; ++it3)
       {
-        size_t videoFrameListSize = it2->second.size();
-        VideoFrame *frame_found;
-        bool found = false;
-        for (VideoFrameArrayType::iterator it3 = it2->second.begin(), end_it3 = it2->second.end();
-          it3 != end_it3;
-          /*++it3 not here, because of the delete*/)
-        {
-          VideoFrame *frame = it3->frame;
-
-          // sanity check if its refcount is zero
-          // because when a vfb is free (refcount==0) then all its parent frames should also be free
-          assert(0 == frame->refcount);
-
-          if (!found)
-          {
-            InterlockedIncrement(&(frame->vfb->refcount)); // same as &(vfb->refcount)
-#ifdef _DEBUG
-            char buf[256];
-            t_end = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double> elapsed_seconds = t_end - t_start;
-            _snprintf(buf, 255, "ScriptEnvironment::GetNewFrame NEW METHOD EXACT hit! VideoFrameListSize=%7Iu GotSize=%7Iu FrReg.Size=%6Iu vfb=%p frame=%p SeekTime:%f\n", videoFrameListSize, vfb_size, FrameRegistry2.size(), vfb, frame, elapsed_seconds.count());
-            _RPT0(0, buf);
-#ifdef SIZETMOD
-            _RPT5(0, "                                          frame %p RowSize=%d Height=%d Pitch=%d Offset=%7Iu\n", frame, frame->GetRowSize(), frame->GetHeight(), frame->GetPitch(), frame->GetOffset()); // P.F.
-#else
-            _RPT5(0, "                                          frame %p RowSize=%d Height=%d Pitch=%d Offset=%d\n", frame, frame->GetRowSize(), frame->GetHeight(), frame->GetPitch(), frame->GetOffset()); // P.F.
-#endif
-#endif
-            // only 1 frame in list -> no delete
-            if (videoFrameListSize <= 1)
-            {
-              _RPT1(0, "ScriptEnvironment::GetNewFrame returning frame. VideoFrameListSize was 1\n", videoFrameListSize); // P.F.
+        assert(0 == it3->frame->refcount);
+        delete it3->frame;
+      }
+      frames.erase(frames.begin() + 1, frames.end());
 #ifdef _DEBUG
-              it3->timestamp = std::chrono::high_resolution_clock::now(); // refresh timestamp!
+      frames.front().timestamp = std::chrono::high_resolution_clock::now(); // refresh timestamp!
+      t_end = std::chrono::high_resolution_clock::now();
+      std::chrono::duration<double> elapsed_seconds = t_end - t_start;
+      _RPT4(0, "ScriptEnvironment::GetNewFrame hit! GotSize=%7Iu vfb=%p frame=%p SeekTime:%f\n", vfb_size, vfb, frame, elapsed_seconds.count());
 #endif
-              return frame; // return immediately
-              break;
-            }
-            // more than X: just registered the frame found, and erase all other frames from list plus delete frame objects also
-            frame_found = frame;
-            found = true;
-            ++it3;
-          }
-          else {
-            // if the first frame to this vfb was already found, then we free all others and delete it from the list
-            // Benefit: no 4-5k frame list count per a single vfb.
-            //_RPT4(0, "ScriptEnvironment::GetNewFrame Delete one frame %p RowSize=%d Height=%d Pitch=%d Offset=%d\n", frame, frame->GetRowSize(), frame->GetHeight(), frame->GetPitch(), frame->GetOffset()); // P.F.
-            delete frame;
-            ++it3;
-          }
-        } // for it3
-        if (found)
-        {
-          _RPT1(0, "ScriptEnvironment::GetNewFrame returning frame_found. clearing frames. List count: it2->second.size(): %7zu \n", it2->second.size());
-          it2->second.clear();
-          it2->second.reserve(16); // initial capacity set to 16, avoid reallocation when 1st, 2nd, etc.. elements pushed later (possible speedup)
-          it2->second.push_back(DebugTimestampedFrame(frame_found)); // keep only the first
-          return frame_found;
-        }
-      }
-    } // for it2
-  } // for it
+
+      InterlockedIncrement(&(vfb->refcount));
+      size_class.last_hit = vfb;
+      return frame;
+    }
+  }
   _RPT3(0, "ScriptEnvironment::GetNewFrame, no free entry in FrameRegistry. Requested vfb size=%Iu memused=%I64d memmax=%I64d\n", vfb_size, memory_used.load(), memory_max);
 
 #ifdef _DEBUG
@@ -1792,14 +1858,14 @@ VideoFrame* ScriptEnvironment::GetNewFrame(size_t vfb_size)
     it != end_it;
     ++it)
   {
-    for (FrameBufferRegistryType::iterator it2 = (it->second).begin(), end_it2 = (it->second).end();
+    for (FrameBufferRegistryType::iterator it2 = (it->second.buffers).begin(), end_it2 = (it->second.buffers).end();
       it2 != end_it2;
       /*++it2: not here: may delete iterator position */)
     {
       VideoFrameBuffer *vfb = it2->first;
       if (0 == vfb->refcount) // vfb refcount check
       {
-        memory_used -= vfb->GetDataSize(); // frame->vfb->GetDataSize();
+        memory_used -= FrameMemoryFootprint(vfb->data);
         delete vfb;
         const VideoFrameArrayType::iterator end_it3 = it2->second.end(); // const
         for (VideoFrameArrayType::iterator it3 = it2->second.begin();
@@ -1812,7 +1878,7 @@ VideoFrame* ScriptEnvironment::GetNewFrame(size_t vfb_size)
         }
         // delete array belonging to this vfb in one step
         it2->second.clear(); // clear frame list
-        it2 = (it->second).erase(it2); // clear current vfb
+        it2 = (it->second.buffers).erase(it2); // clear current vfb
       }
       else ++it2;
     }
@@ -1888,27 +1954,36 @@ void ScriptEnvironment::EnsureMemoryLimit(size_t request)
 
   int shrinkcount = 0;
 
-  const CacheRegistryType::iterator end_cit = CacheRegistry.end();
-  for (
-    CacheRegistryType::iterator cit = CacheRegistry.begin();
-    (memory_need > memory_max) && (cit != end_cit);
-    ++cit
-    )
+  if (memory_need > memory_max)
   {
     // Oh darn. We'd need more memory than we are allowed to use.
     // Let's reduce the amount of caching.
 
-    // We try to shrink least recently used caches first.
+    // We shrink the caches whose frames save the least recompute time per
+    // byte first, least recently used first among equals, until the frames
+    // they give up cover what is missing.
 
-    Cache* cache = *cit;
-    int cache_size = cache->SetCacheHints(CACHE_GET_SIZE, 0);
-    if (cache_size != 0)
+    std::vector<std::pair<double, Cache*> > candidates;
+    for (Cache* cache : CacheRegistry)
+      candidates.push_back(std::make_pair(cache->GetSlotValue(), cache));
+    std::stable_sort(candidates.begin(), candidates.end(),
+      [](const std::pair<double, Cache*> &a, const std::pair<double, Cache*> &b) { return a.first < b.first; });
+
+    const unsigned __int64 missing = memory_need - memory_max;
+    unsigned __int64 released = 0;
+    for (size_t i = 0; (i < candidates.size()) && (released < missing); ++i)
     {
-      _RPT2(0, "ScriptEnvironment::EnsureMemoryLimit shrink cache. cache=%p new size=%d\n", (void *)cache, cache_size - 1);
-      cache->SetCacheHints(CACHE_SET_MAX_CAPACITY, cache_size - 1);
-      shrinkcount++;
-    } // if
-  } // for cit
+      Cache* cache = candidates[i].second;
+      int cache_size = cache->SetCacheHints(CACHE_GET_SIZE, 0);
+      if (cache_size != 0)
+      {
+        _RPT2(0, "ScriptEnvironment::EnsureMemoryLimit shrink cache. cache=%p new size=%d\n", (void *)cache, cache_size - 1);
+        cache->SetCacheHints(CACHE_SET_MAX_CAPACITY, cache_size - 1);
+        released += cache->GetFrameBytes();
+        shrinkcount++;
+      } // if
+    } // for i
+  }
 
   if (shrinkcount != 0)
   {
@@ -1932,7 +2007,7 @@ void ScriptEnvironment::EnsureMemoryLimit(size_t request)
       it != end_it;
       ++it)
     {
-      for (FrameBufferRegistryType::iterator it2 = (it->second).begin(), end_it2 = (it->second).end();
+      for (FrameBufferRegistryType::iterator it2 = (it->second.buffers).begin(), end_it2 = (it->second.buffers).end();
         it2 != end_it2;
         /*++it2: not here: may delete iterator position */)
       {
@@ -1940,7 +2015,7 @@ void ScriptEnvironment::EnsureMemoryLimit(size_t request)
         if (0 == vfb->refcount) // vfb refcount check
         {
           _RPT2(0, "ScriptEnvironment::EnsureMemoryLimit v2 req=%Iu freed=%d\n", request, vfb->GetDataSize()); // P.F.
-          memory_used -= vfb->GetDataSize();
+          memory_used -= FrameMemoryFootprint(vfb->data);
           VideoFrameBuffer *_vfb = vfb;
           delete vfb;
           ++freed_vfb_count;
@@ -1964,7 +2039,7 @@ void ScriptEnvironment::EnsureMemoryLimit(size_t request)
           }
           // delete array belonging to this vfb in one step
           it2->second.clear(); // clear frame list
-          it2 = (it->second).erase(it2); // clear vfb entry
+          it2 = (it->second.buffers).erase(it2); // clear vfb entry
         }
         else ++it2;
       }
@@ -2254,7 +2329,7 @@ PVideoFrame __stdcall ScriptEnvironment::Subframe(PVideoFrame src, int rel_offse
 #endif
   // automatically inserts if not exists!
   assert(NULL != subframe);
-  FrameRegistry2[vfb_size][src->GetFrameBuffer()].push_back(DebugTimestampedFrame(subframe)); // insert with timestamp!
+  FrameRegistry2[vfb_size].buffers[src->GetFrameBuffer()].push_back(DebugTimestampedFrame(subframe)); // insert with timestamp!
 
   return subframe;
 }
@@ -2275,7 +2350,7 @@ PVideoFrame __stdcall ScriptEnvironment::SubframePlanar(PVideoFrame src, int rel
 #endif
   // automatically inserts if not exists!
   assert(subframe != NULL);
-  FrameRegistry2[vfb_size][src->GetFrameBuffer()].push_back(DebugTimestampedFrame(subframe)); // insert with timestamp!
+  FrameRegistry2[vfb_size].buffers[src->GetFrameBuffer()].push_back(DebugTimestampedFrame(subframe)); // insert with timestamp!
 
   return subframe;
 }
@@ -2296,7 +2371,7 @@ PVideoFrame __stdcall ScriptEnvironment::SubframePlanar(PVideoFrame src, int rel
     _RPT1(0, "ScScriptEnvironment::SubFramePlanar(2) memory mutext lock: %p\n", (void *)&memory_mutex);
 #endif
     assert(subframe != NULL);
-    FrameRegistry2[vfb_size][src->GetFrameBuffer()].push_back(DebugTimestampedFrame(subframe)); // insert with timestamp!
+    FrameRegistry2[vfb_size].buffers[src->GetFrameBuffer()].push_back(DebugTimestampedFrame(subframe)); // insert with timestamp!
 
     return subframe;
 }
@@ -2357,18 +2432,33 @@ void* ScriptEnvironment::ManageCache(int key, void* data) {
 
     if ((memory_used > memory_max) || (memory_max - memory_used < memory_max*0.1f))
     {
-      // If we don't have enough free reserves, take away a cache slot from
-      // a cache instance that hasn't been used since long.
-
+      // If we don't have enough free reserves, the slot has to come from another
+      // cache: the one whose frames save the least recompute time per byte,
+      // and only if that is less than what the new slot would save here.
+      // Among equals the one that hasn't been used since longest loses.
+
+      Cache* victim = NULL;
+      int victim_size = 0;
+      double victim_value = cache->GetSlotValue();
       for (Cache* old_cache : CacheRegistry)
       {
-        int osize = cache->SetCacheHints(CACHE_GET_SIZE, 0);
-        if (osize != 0)
+        if (old_cache == cache)
+          continue;
+        int osize = old_cache->SetCacheHints(CACHE_GET_SIZE, 0);
+        if (osize == 0)
+          continue;
+        double ovalue = old_cache->GetSlotValue();
+        if (ovalue < victim_value)
         {
-          old_cache->SetCacheHints(CACHE_SET_MAX_CAPACITY, osize - 1);
-          break;
+          victim = old_cache;
+          victim_size = osize;
+          victim_value = ovalue;
         }
       } // for cit
+
+      if (victim == NULL)
+        return 0;
+      victim->SetCacheHints(CACHE_SET_MAX_CAPACITY, victim_size - 1);
     }
 #ifdef _DEBUG
     _RPT2(0, "ScriptEnvironment::ManageCache increase capacity to %d cache_id=%s\n", cache_cap + 1, cache->FuncName.c_str());
@@ -2812,6 +2902,8 @@ success:;
 
             PClip guard = MTGuard::Create(mtmode, clip, std::move(funcCtor), this);
             *result = Cache::Create(guard, NULL, this);
+            if (filter_profiler != NULL)
+              *result = filter_profiler->Wrap(result->AsClip(), f->canon_name);
 
 #ifdef USE_MT_GUARDEXIT
             // 170531: concept introduced in r2069 is not working
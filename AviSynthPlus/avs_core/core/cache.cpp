@@ -35,8 +35,11 @@
 #include "cache.h"
 #include "internal.h"
 #include "LruCache.h"
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstdio>
+#include <mutex>
 
 #ifdef X86_32
 #include <mmintrin.h>
@@ -49,6 +52,9 @@ extern const AVSFunction Cache_filters[] = {
   { 0 }
 };
 
+// Largest size CACHE_AUDIO_AUTO grows the audio cache to
+static const size_t AUDIO_AUTO_MAX_SIZE = 8*1024*1024;
+
 
 struct CachePimpl
 {
@@ -57,21 +63,60 @@ struct CachePimpl
 
   // Video cache
   std::shared_ptr<LruCache<size_t, PVideoFrame> > VideoCache;
+  std::atomic<size_t> FrameHits;
+  std::atomic<size_t> FrameMisses;
+
+  // Cost of a miss, for the cache budget in ScriptEnvironment::ManageCache
+  std::atomic<__int64> RecomputeNs;   // running average of child GetFrame time
+  std::atomic<size_t> FrameBytes;     // size of the last frame buffer produced
+
+  void CountMiss(const std::chrono::high_resolution_clock::time_point &start, const PVideoFrame &frame)
+  {
+    const __int64 elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    // Misses of several threads can end at the same time, none of them may get lost
+    __int64 average = RecomputeNs.load();
+    while (!RecomputeNs.compare_exchange_weak(average, (average * 7 + elapsed) / 8)) {}
+    if (frame)
+      FrameBytes = frame->GetFrameBuffer()->GetDataSize();
+  }
 
   // Audio cache
+  // Ring buffer holding AudioCount samples from AudioStart on,
+  // the first of them stored in slot AudioHead.
+  std::mutex AudioMutex;
   CachePolicyHint AudioPolicy;
   char* AudioCache;
   size_t SampleSize;
   size_t MaxSampleCount;
+  __int64 AudioStart;
+  size_t AudioCount;
+  size_t AudioHead;
+  int AudioReadAhead;         // -1: a quarter of the cache
+  __int64 AudioLastStart;     // previous request, for sequential access detection
+  __int64 AudioExpectedNext;
+  size_t AudioHits;
+  size_t AudioMisses;
 
   CachePimpl(const PClip& _child) :
     child(_child),
     vi(_child->GetVideoInfo()),
     VideoCache(std::make_shared<LruCache<size_t, PVideoFrame> >(0)),
-    AudioPolicy(CACHE_AUDIO),
+    FrameHits(0),
+    FrameMisses(0),
+    RecomputeNs(0),
+    FrameBytes(0),
+    AudioPolicy(CACHE_AUDIO_NONE),
     AudioCache(NULL),
     SampleSize(0),
-    MaxSampleCount(0)
+    MaxSampleCount(0),
+    AudioStart(0),
+    AudioCount(0),
+    AudioHead(0),
+    AudioReadAhead(-1),
+    AudioLastStart(-1),
+    AudioExpectedNext(-1),
+    AudioHits(0),
+    AudioMisses(0)
   {
     SampleSize = vi.BytesPerAudioSample();
   }
@@ -81,6 +126,68 @@ struct CachePimpl
       free(AudioCache);
     AudioCache = NULL;
   }
+
+  void ResetAudio()
+  {
+    AudioStart = 0;
+    AudioCount = 0;
+    AudioHead = 0;
+  }
+
+  // Only make bigger. Cached content is dropped, ring order does not survive realloc.
+  void ResizeAudio(size_t bytes)
+  {
+    if (bytes/SampleSize <= MaxSampleCount)
+      return;
+
+    char * NewAudioCache = (char*)realloc(AudioCache, bytes);
+    if (NewAudioCache == NULL)
+    {
+      throw std::bad_alloc();
+    }
+    AudioCache = NewAudioCache;
+    MaxSampleCount = bytes/SampleSize;
+    ResetAudio();
+  }
+
+  void FreeAudio()
+  {
+    free(AudioCache);
+    AudioCache = NULL;
+    MaxSampleCount = 0;
+    ResetAudio();
+  }
+
+  // Fetch 'count' samples following the cached range from the child,
+  // overwriting the oldest ones if the ring is full. count <= MaxSampleCount.
+  void AppendAudio(size_t count, IScriptEnvironment* env)
+  {
+    if (AudioCount + count > MaxSampleCount) {
+      const size_t drop = AudioCount + count - MaxSampleCount;
+      AudioHead = (AudioHead + drop) % MaxSampleCount;
+      AudioStart += drop;
+      AudioCount -= drop;
+    }
+
+    size_t slot = (AudioHead + AudioCount) % MaxSampleCount;
+    while (count > 0) {
+      const size_t chunk = min(count, MaxSampleCount - slot);
+      child->GetAudio(AudioCache + slot*SampleSize, AudioStart + AudioCount, chunk, env);
+      AudioCount += chunk;
+      count -= chunk;
+      slot = 0;
+    }
+  }
+
+  // Copy a range lying completely inside the cache
+  void ReadAudio(void* buf, __int64 start, size_t count) const
+  {
+    const size_t slot = (AudioHead + (size_t)(start - AudioStart)) % MaxSampleCount;
+    const size_t first = min(count, MaxSampleCount - slot);
+    memcpy(buf, AudioCache + slot*SampleSize, first*SampleSize);
+    if (first < count)
+      memcpy((char*)buf + first*SampleSize, AudioCache, (count - first)*SampleSize);
+  }
 };
 
 
@@ -90,6 +197,13 @@ Cache::Cache(const PClip& _child, IScriptEnvironment* env) :
 {
   _pimpl = new CachePimpl(_child);
   env->ManageCache(MC_RegisterCache, reinterpret_cast<void*>(this));
+
+  // Let the child ask for an audio cache
+  if (_child->GetVersion() >= 5) {
+    const int audio_mode = _child->SetCacheHints(CACHE_GETCHILD_AUDIO_MODE, 0);
+    if (audio_mode == CACHE_AUDIO || audio_mode == CACHE_AUDIO_AUTO)
+      SetCacheHints(audio_mode, _child->SetCacheHints(CACHE_GETCHILD_AUDIO_SIZE, 0));
+  }
   _RPT5(0, "Cache::Cache registered. cache_id=%p child=%p w=%d h=%d VideoCacheSize=%Iu\n", (void *)this, (void *)_child, _pimpl->vi.width, _pimpl->vi.height, _pimpl->VideoCache->size()); // P.F.
 }
 
@@ -132,10 +246,13 @@ PVideoFrame __stdcall Cache::GetFrame(int n, IScriptEnvironment* env)
   {
   case LRU_LOOKUP_NOT_FOUND:
     {
+      ++_pimpl->FrameMisses;
       try
       {
+        const std::chrono::high_resolution_clock::time_point t_child = std::chrono::high_resolution_clock::now();
         //cache_handle.first->value = _pimpl->child->GetFrame(n, env);
         result = _pimpl->child->GetFrame(n, env); // P.F. fill result immediately
+        _pimpl->CountMiss(t_child, result);
         cache_handle.first->value = result; // not after commit!
   #ifdef X86_32
         _mm_empty();
@@ -185,6 +302,7 @@ PVideoFrame __stdcall Cache::GetFrame(int n, IScriptEnvironment* env)
     }
   case LRU_LOOKUP_FOUND_AND_READY:
     {
+      ++_pimpl->FrameHits;
       // theoretically cache_handle here may point to wrong entry,
       // because the lock in lookup is released before this readout
       // solution:
@@ -203,7 +321,10 @@ PVideoFrame __stdcall Cache::GetFrame(int n, IScriptEnvironment* env)
     }
   case LRU_LOOKUP_NO_CACHE:
     {
+      ++_pimpl->FrameMisses;
+      const std::chrono::high_resolution_clock::time_point t_child = std::chrono::high_resolution_clock::now();
       result = _pimpl->child->GetFrame(n, env);
+      _pimpl->CountMiss(t_child, result);
 #ifdef _DEBUG	
       t_end = std::chrono::high_resolution_clock::now();
       std::chrono::duration<double> elapsed_seconds = t_end - t_start;
@@ -264,11 +385,55 @@ void __stdcall Cache::GetAudio(void* buf, __int64 start, __int64 count, IScriptE
     // -----------------------------------------------------------
     //          Caching
     // -----------------------------------------------------------
-    
-    // TODO: implement audio cache
 
+    std::unique_lock<std::mutex> lock(_pimpl->AudioMutex);
+
+    // Auto mode: make room for requests larger than the cache
+    if (_pimpl->AudioPolicy == CACHE_AUDIO_AUTO && (size_t)count > _pimpl->MaxSampleCount
+      && (size_t)count*2*_pimpl->SampleSize <= AUDIO_AUTO_MAX_SIZE)
+      _pimpl->ResizeAudio((size_t)count*2*_pimpl->SampleSize);
+
+    if ((_pimpl->AudioPolicy != CACHE_AUDIO && _pimpl->AudioPolicy != CACHE_AUDIO_AUTO)
+      || (size_t)count > _pimpl->MaxSampleCount)
+    {
+      if (_pimpl->AudioCache != NULL)
+        ++_pimpl->AudioMisses;
+      lock.unlock();
+      _pimpl->child->GetAudio(buf, start, count, env);
+      return;
+    }
+
+    const __int64 end = start + count;
+    const __int64 cache_end = _pimpl->AudioStart + _pimpl->AudioCount;
+
+    if (start >= _pimpl->AudioStart && end <= cache_end) {
+      ++_pimpl->AudioHits;
+    }
+    else {
+      ++_pimpl->AudioMisses;
+
+      // Request starts inside or right after the previous one
+      const bool sequential = (start >= _pimpl->AudioLastStart) && (start <= _pimpl->AudioExpectedNext);
 
-    _pimpl->child->GetAudio(buf, start, count, env);
+      if (start < _pimpl->AudioStart || start > cache_end)
+      {  // Not a continuation of the cached range, restart at 'start'
+        _pimpl->ResetAudio();
+        _pimpl->AudioStart = start;
+      }
+
+      size_t readahead = 0;
+      if (sequential) {
+        readahead = _pimpl->AudioReadAhead >= 0 ? (size_t)_pimpl->AudioReadAhead : _pimpl->MaxSampleCount/4;
+        readahead = min(readahead, _pimpl->MaxSampleCount - (size_t)count);
+        readahead = (size_t)min((__int64)readahead, vi->num_audio_samples - end);
+      }
+
+      _pimpl->AppendAudio((size_t)(end - (_pimpl->AudioStart + _pimpl->AudioCount)) + readahead, env);
+    }
+
+    _pimpl->AudioLastStart = start;
+    _pimpl->AudioExpectedNext = end;
+    _pimpl->ReadAudio(buf, start, (size_t)count);
 }
 
 const VideoInfo& __stdcall Cache::GetVideoInfo()
@@ -398,14 +563,17 @@ int __stdcall Cache::SetCacheHints(int cachehints, int frame_range)
       break;
 
     /*********************************************
-        TODO AUDIO
+        AUDIO
     *********************************************/
 
     case CACHE_AUDIO:
     case CACHE_AUDIO_AUTO:
+    {
       if (!_pimpl->vi.HasAudio())
         break;
 
+      std::lock_guard<std::mutex> lock(_pimpl->AudioMutex);
+
       // Range means for audio.
       // 0 == Create a default buffer (256kb).
       // Positive. Allocate X bytes for cache.
@@ -416,27 +584,19 @@ int __stdcall Cache::SetCacheHints(int cachehints, int frame_range)
         frame_range=256*1024;
       }
 
-      if (frame_range/_pimpl->SampleSize > _pimpl->MaxSampleCount) { // Only make bigger
-        char * NewAudioCache = (char*)realloc(_pimpl->AudioCache, frame_range);
-        if (NewAudioCache == NULL)
-        {
-          throw std::bad_alloc();
-        }
-        _pimpl->AudioCache = NewAudioCache;
-
-        _pimpl->MaxSampleCount = frame_range/_pimpl->SampleSize;
-      }
-
+      _pimpl->ResizeAudio(frame_range);
       _pimpl->AudioPolicy = (CachePolicyHint)cachehints;
       break;
+    }
 
     case CACHE_AUDIO_NONE:
     case CACHE_AUDIO_NOTHING:
-      free(_pimpl->AudioCache);
-      _pimpl->AudioCache = NULL;
-      _pimpl->MaxSampleCount = 0;
+    {
+      std::lock_guard<std::mutex> lock(_pimpl->AudioMutex);
+      _pimpl->FreeAudio();
       _pimpl->AudioPolicy = (CachePolicyHint)cachehints;
       break;
+    }
 
     case CACHE_GET_AUDIO_POLICY: // Get the current audio policy.
       return _pimpl->AudioPolicy;
@@ -444,6 +604,34 @@ int __stdcall Cache::SetCacheHints(int cachehints, int frame_range)
     case CACHE_GET_AUDIO_SIZE: // Get the current audio cache size.
       return (int)(_pimpl->SampleSize * _pimpl->MaxSampleCount);
 
+    case CACHE_SET_AUDIO_READAHEAD:
+      _pimpl->AudioReadAhead = max(frame_range, -1);
+      break;
+
+    case CACHE_GET_AUDIO_READAHEAD:
+      return _pimpl->AudioReadAhead;
+
+    case CACHE_GET_AUDIO_HITS:
+      return (int)_pimpl->AudioHits;
+
+    case CACHE_GET_AUDIO_MISSES:
+      return (int)_pimpl->AudioMisses;
+
+    case CACHE_GET_FRAME_HITS:
+      return (int)_pimpl->FrameHits;
+
+    case CACHE_GET_FRAME_MISSES:
+      return (int)_pimpl->FrameMisses;
+
+    case CACHE_GET_GHOST_HITS:
+      return (int)_pimpl->VideoCache->ghost_hits();
+
+    case CACHE_GET_REUSE_GAP:
+      return (int)_pimpl->VideoCache->reuse_gap();
+
+    case CACHE_GET_RECOMPUTE_COST:
+      return (int)(_pimpl->RecomputeNs / 1000);
+
     case CACHE_PREFETCH_AUDIO_BEGIN:    // Begin queue request to prefetch audio (take critical section).
     case CACHE_PREFETCH_AUDIO_STARTLO:  // Set low 32 bits of start.
     case CACHE_PREFETCH_AUDIO_STARTHI:  // Set high 32 bits of start.
@@ -459,6 +647,31 @@ int __stdcall Cache::SetCacheHints(int cachehints, int frame_range)
   return 0;
 }
 
+double Cache::GetSlotValue() const
+{
+  // What one more slot is worth, in recompute time saved per byte and access:
+  // the share of requests that were ghost hits, times their cost, spread over
+  // the slots it takes to actually catch them.
+  const size_t accesses = _pimpl->FrameHits + _pimpl->FrameMisses;
+  const size_t bytes = _pimpl->FrameBytes;
+  if ((accesses == 0) || (bytes == 0))
+    return 0.0;
+
+  const double ghost_rate = (double)_pimpl->VideoCache->ghost_hits() / accesses;
+  const double slots = 1.0 + _pimpl->VideoCache->reuse_gap();
+  return ghost_rate * _pimpl->RecomputeNs / (slots * bytes);
+}
+
+size_t Cache::GetFrameBytes() const
+{
+  return _pimpl->FrameBytes;
+}
+
+const PClip& Cache::GetChild() const
+{
+  return _pimpl->child;
+}
+
 AVSValue __cdecl Cache::Create(AVSValue args, void*, IScriptEnvironment* env)
 {
   PClip p = 0;
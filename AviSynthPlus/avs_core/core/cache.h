@@ -62,6 +62,13 @@ public:
   bool __stdcall GetParity(int n);
   int __stdcall SetCacheHints(int cachehints,int frame_range);
 
+  // Statistics for the cache budget, see ScriptEnvironment::ManageCache
+  double GetSlotValue() const;
+  size_t GetFrameBytes() const;
+
+  // The clip whose frames are cached
+  const PClip& GetChild() const;
+
   static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env);
   static bool __stdcall IsCache(const PClip& c);
 
@@ -108,6 +108,12 @@ PClip new_Splice(PClip _child1, PClip _child2, bool realign_sound, IScriptEnviro
 PClip new_SeparateFields(PClip _child, IScriptEnvironment* env);
 PClip new_AssumeFrameBased(PClip _child);
 
+/* Declares that frame 'n' of 'clip' will be needed for an upcoming output frame.
+   The script's Prefetcher, if any, fetches it ahead of time on one of its threads,
+   on top of its usual stride prefetching. Does nothing without Prefetch().
+*/
+void DeclareFrameDependency(const PClip& clip, int n, IScriptEnvironment* env);
+
 
 /* Used to clip/clamp a byte to the 0-255 range.
    Uses a look-up table internally for performance.
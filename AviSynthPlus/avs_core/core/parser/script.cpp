@@ -47,6 +47,7 @@
 #include "../internal.h"
 #include "../Prefetcher.h"
 #include "../InternalEnvironment.h"
+#include "../FrameMemory.h"
 #include <map>
 
 
@@ -200,6 +201,7 @@ extern const AVSFunction Script_functions[] = {
   { "Assert", BUILTIN_FUNC_PREFIX, "s", AssertEval },
 
   { "SetMemoryMax", BUILTIN_FUNC_PREFIX, "[]i", SetMemoryMax },
+  { "SetMemoryMode", BUILTIN_FUNC_PREFIX, "[]s", SetMemoryMode },
 
   { "SetWorkingDir", BUILTIN_FUNC_PREFIX, "s", SetWorkingDir },
   { "Exist",         BUILTIN_FUNC_PREFIX, "s", Exist },
@@ -241,8 +243,10 @@ extern const AVSFunction Script_functions[] = {
   { "InternalFunctionExists", BUILTIN_FUNC_PREFIX, "s", InternalFunctionExists  },
 
   { "SetFilterMTMode",  BUILTIN_FUNC_PREFIX, "si[force]b", SetFilterMTMode  },
-  { "Prefetch",         BUILTIN_FUNC_PREFIX, "c[threads]i", Prefetcher::Create },
+  { "Prefetch",         BUILTIN_FUNC_PREFIX, "c[threads]i[affinity]s", Prefetcher::Create },
   { "SetLogParams",     BUILTIN_FUNC_PREFIX, "[target]s[level]i", SetLogParams },
+  { "SetFilterProfile", BUILTIN_FUNC_PREFIX, "s", SetFilterProfile },
+  { "WriteFilterProfile", BUILTIN_FUNC_PREFIX, "", WriteFilterProfile },
   { "LogMsg",              BUILTIN_FUNC_PREFIX, "si", LogMsg },
 
   { "IsY",       BUILTIN_FUNC_PREFIX, "c", IsY },
@@ -629,6 +633,18 @@ AVSValue ScriptFileUtf8(AVSValue args, void*, IScriptEnvironment* env) { return
 AVSValue ScriptDirUtf8(AVSValue args, void*, IScriptEnvironment* env) { return env->GetVarDef("$ScriptDirUtf8$"); }
 
 AVSValue SetMemoryMax(AVSValue args, void*, IScriptEnvironment* env) { return env->SetMemoryMax(args[0].AsInt(0)); }
+AVSValue SetMemoryMode(AVSValue args, void*, IScriptEnvironment* env)
+{
+  InternalEnvironment *envi = static_cast<InternalEnvironment*>(env);
+  int mode = -1;
+  if (args[0].Defined())
+  {
+    mode = FrameMemoryModeFromName(args[0].AsString());
+    if (mode < 0)
+      env->ThrowError("SetMemoryMode: mode must be \"heap\", \"largepages\", \"numa\" or \"largepages+numa\".");
+  }
+  return FrameMemoryModeName(envi->SetMemoryMode(mode));
+}
 AVSValue SetWorkingDir(AVSValue args, void*, IScriptEnvironment* env) { return env->SetWorkingDir(args[0].AsString()); }
 
 AVSValue Muldiv(AVSValue args, void*, IScriptEnvironment* env) { return int(MulDiv(args[0].AsInt(), args[1].AsInt(), args[2].AsInt())); }
@@ -1567,6 +1583,19 @@ AVSValue SetLogParams(AVSValue args, void*, IScriptEnvironment* env)
     return AVSValue();
 }
 
+AVSValue SetFilterProfile(AVSValue args, void*, IScriptEnvironment* env)
+{
+  InternalEnvironment *envi = static_cast<InternalEnvironment*>(env);
+  envi->SetFilterProfile(args[0].AsString());
+  return AVSValue();
+}
+
+AVSValue WriteFilterProfile(AVSValue args, void*, IScriptEnvironment* env)
+{
+  InternalEnvironment *envi = static_cast<InternalEnvironment*>(env);
+  return envi->WriteFilterProfile();
+}
+
 AVSValue LogMsg(AVSValue args, void*, IScriptEnvironment* env)
 {
     if ((args.ArraySize() != 2) || !args[0].IsString() || !args[1].IsInt())
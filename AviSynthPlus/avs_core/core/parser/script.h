@@ -81,6 +81,7 @@ AVSValue Apply(AVSValue args, void*, IScriptEnvironment* env) ;
 AVSValue Import(AVSValue args, void*, IScriptEnvironment* env);
 
 AVSValue SetMemoryMax(AVSValue args, void*, IScriptEnvironment* env);
+AVSValue SetMemoryMode(AVSValue args, void*, IScriptEnvironment* env);
 
 AVSValue SetWorkingDir(AVSValue args, void*, IScriptEnvironment* env);
 
@@ -247,6 +248,8 @@ AVSValue InternalFunctionExists (AVSValue args, void*, IScriptEnvironment* env);
 
 AVSValue SetFilterMTMode (AVSValue args, void*, IScriptEnvironment* env);
 AVSValue SetLogParams(AVSValue args, void*, IScriptEnvironment* env);
+AVSValue SetFilterProfile(AVSValue args, void*, IScriptEnvironment* env);
+AVSValue WriteFilterProfile(AVSValue args, void*, IScriptEnvironment* env);
 AVSValue LogMsg(AVSValue args, void*, IScriptEnvironment* env);
 
 AVSValue IsY(AVSValue args, void*, IScriptEnvironment* env);
@@ -40,6 +40,7 @@
 #include <avs/win.h>
 #include <avs/minmax.h>
 #include "../../core/internal.h"
+#include "../../core/InternalEnvironment.h"
 
 extern const AVSFunction Conditional_filters[] = {
   {  "ConditionalSelect", BUILTIN_FUNC_PREFIX, "csc+[show]b", ConditionalSelect::Create },
@@ -59,6 +60,46 @@ extern const AVSFunction Conditional_filters[] = {
 #define W_DIVISOR 5  // Width divisor for onscreen messages
 
 
+/********************************
+ * Cached runtime expression
+ *
+ * Parses the expression once per calling
+ * environment and reparses only when the
+ * source string changes.
+ ********************************/
+
+CachedExpression::~CachedExpression()
+{
+  if (parses == 0)
+    return;
+  static_cast<InternalEnvironment*>(env)->LogMsg(LOGLEVEL_INFO, "%s: expression parsed %u times, %u parses avoided",
+    filename, (unsigned)parses, (unsigned)reuses);
+}
+
+PExpression CachedExpression::Get(const char* source, IScriptEnvironment* env)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(env);
+    if (it != entries.end() && it->second.source == source) {
+      ++reuses;
+      return it->second.exp;
+    }
+  }
+
+  // Parse outside the lock; may throw, in which case nothing is cached
+  ScriptParser parser(env, source, filename);
+  PExpression exp = parser.Parse();
+  ++parses;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  Entry& entry = entries[env];
+  entry.source = source;
+  entry.exp = exp;
+  return exp;
+}
+
+
 /********************************
  * Conditional Select
  *
@@ -70,7 +111,8 @@ ConditionalSelect::ConditionalSelect(PClip _child, const char _expression[],
                                      int _num_args, PClip *_child_array,
                                      bool _show, IScriptEnvironment* env) :
   GenericVideoFilter(_child), expression(_expression),
-  num_args(_num_args), child_array(_child_array), show(_show) {
+  num_args(_num_args), child_array(_child_array), show(_show),
+  exp_cache("[Conditional Select, Expression]", env) {
     
   for (int i=0; i<num_args; i++) {
     const VideoInfo& vin = child_array[i]->GetVideoInfo();
@@ -110,8 +152,7 @@ PVideoFrame __stdcall ConditionalSelect::GetFrame(int n, IScriptEnvironment* env
   AVSValue result;
 
   try {
-    ScriptParser parser(env, expression, "[Conditional Select, Expression]");
-    PExpression exp = parser.Parse();
+    PExpression exp = exp_cache.Get(expression, env);
     result = exp->Evaluate(env);
 
     if (!result.IsInt())
@@ -200,7 +241,8 @@ ConditionalFilter::ConditionalFilter(PClip _child, PClip _source1, PClip _source
                                      AVSValue  _condition1, AVSValue  _evaluator, AVSValue  _condition2,
                                      bool _show, IScriptEnvironment* env) :
   GenericVideoFilter(_child), source1(_source1), source2(_source2),
-  eval1(_condition1), eval2(_condition2), show(_show) {
+  eval1(_condition1), eval2(_condition2), show(_show),
+  exp_cache1("[Conditional Filter, Expresion 1]", env), exp_cache2("[Conditional Filter, Expression 2]", env) {
     
     evaluator = NONE;
 
@@ -261,12 +303,10 @@ PVideoFrame __stdcall ConditionalFilter::GetFrame(int n, IScriptEnvironment* env
   AVSValue e1_result;
   AVSValue e2_result;
   try {
-    ScriptParser parser(env, eval1.AsString(), "[Conditional Filter, Expresion 1]");
-    PExpression exp = parser.Parse();
+    PExpression exp = exp_cache1.Get(eval1.AsString(), env);
     e1_result = exp->Evaluate(env);
 
-    ScriptParser parser2(env, eval2.AsString(), "[Conditional Filter, Expression 2]");
-    exp = parser2.Parse();
+    exp = exp_cache2.Get(eval2.AsString(), env);
     e2_result = exp->Evaluate(env);
   } catch (const AvisynthError &error) {    
     const char* error_msg = error.msg;  
@@ -419,7 +459,8 @@ AVSValue __cdecl ConditionalFilter::Create(AVSValue args, void* user_data, IScri
  **************************/
 
 ScriptClip::ScriptClip(PClip _child, AVSValue  _script, bool _show, bool _only_eval, bool _eval_after_frame, IScriptEnvironment* env) :
-  GenericVideoFilter(_child), script(_script), show(_show), only_eval(_only_eval), eval_after(_eval_after_frame) {
+  GenericVideoFilter(_child), script(_script), show(_show), only_eval(_only_eval), eval_after(_eval_after_frame),
+  exp_cache("[ScriptClip]", env) {
 
 }
 
@@ -462,8 +503,7 @@ PVideoFrame __stdcall ScriptClip::GetFrame(int n, IScriptEnvironment* env) {
   if (eval_after) eval_return = child->GetFrame(n,env);
 
   try {
-    ScriptParser parser(env, script.AsString(), "[ScriptClip]");
-    PExpression exp = parser.Parse();
+    PExpression exp = exp_cache.Get(script.AsString(), env);
     result = exp->Evaluate(env);
   } catch (const AvisynthError &error) {    
     const char* error_msg = error.msg;  
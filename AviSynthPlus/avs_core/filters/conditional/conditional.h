@@ -35,6 +35,39 @@
 
 
 #include <avisynth.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include "../../core/parser/expression.h"
+
+
+class CachedExpression
+/**
+  * Keeps the parsed form of a runtime expression so that it is not
+  * tokenized again on every frame. Trees are kept per environment: each
+  * prefetch thread calls in with its own thread-local environment and
+  * Expression reference counts are not thread safe.
+ **/
+{
+public:
+  CachedExpression(const char* _filename, IScriptEnvironment* _env) : filename(_filename), env(_env), parses(0), reuses(0) {}
+  ~CachedExpression();
+  PExpression Get(const char* source, IScriptEnvironment* env);
+
+private:
+  struct Entry {
+    std::string source;
+    PExpression exp;
+  };
+
+  const char* const filename;
+  IScriptEnvironment* const env; // the counters are logged here when done
+  std::mutex mutex;
+  std::map<IScriptEnvironment*, Entry> entries;
+  std::atomic<size_t> parses;
+  std::atomic<size_t> reuses; // parses avoided
+};
 
 
 class ConditionalSelect : public GenericVideoFilter
@@ -51,6 +84,7 @@ private:
   const int num_args;
   PClip *child_array;
   const bool show;
+  CachedExpression exp_cache;
 };
 
 
@@ -80,6 +114,8 @@ private:
   AVSValue eval1;
   AVSValue eval2;
   bool show;
+  CachedExpression exp_cache1;
+  CachedExpression exp_cache2;
 };
 
 class ScriptClip : public GenericVideoFilter
@@ -96,4 +132,5 @@ private:
   bool show;
   bool only_eval;
   bool eval_after;
+  CachedExpression exp_cache;
 };
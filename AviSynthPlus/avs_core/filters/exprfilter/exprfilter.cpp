@@ -75,11 +75,15 @@
 #include <memory>
 #include <cmath>
 #include <unordered_map>
+#include <mutex>
 
 #include <avisynth.h>
 #include <avs/win.h>
 #include <stdlib.h>
 #include "../core/internal.h"
+#include "../../core/InternalEnvironment.h"
+#include "../../core/RowBands.h"
+#include "../../core/cache.h"
 #include "../../convert/convert_planar.h" // fill_plane
 #include "avs/alignment.h"
 
@@ -2075,6 +2079,28 @@ struct ExprEval : public jitasm::function<void, ExprEval, uint8_t *, const intpt
           andps(t1.second, CPTR(elfloat_one));
         }
       }
+      else if (iter.op == opQuantize) {
+        // same clamping and rounding as opStore8..16
+        const int elstore = elstore8 + (iter.e.ival - 8) / 2;
+        if (processSingle) {
+          auto &t1 = stack1.back();
+          maxps(t1, zero);
+          minps(t1, CPTR(elstore));
+          cvtps2dq(t1, t1);
+          cvtdq2ps(t1, t1);
+        }
+        else {
+          auto &t1 = stack.back();
+          maxps(t1.first, zero);
+          maxps(t1.second, zero);
+          minps(t1.first, CPTR(elstore));
+          minps(t1.second, CPTR(elstore));
+          cvtps2dq(t1.first, t1.first);
+          cvtps2dq(t1.second, t1.second);
+          cvtdq2ps(t1.first, t1.first);
+          cvtdq2ps(t1.second, t1.second);
+        }
+      }
       else if (iter.op == opAnd) {
         if (processSingle) {
           LogicOp_Single(andps)
@@ -2836,6 +2862,28 @@ struct ExprEvalAvx2 : public jitasm::function<void, ExprEvalAvx2, uint8_t *, con
           vandps(t1.second, t1.second, CPTR_AVX(elfloat_one));
         }
       }
+      else if (iter.op == opQuantize) {
+        // same clamping and rounding as opStore8..16
+        const int elstore = elstore8 + (iter.e.ival - 8) / 2;
+        if (processSingle) {
+          auto &t1 = stack1.back();
+          vmaxps(t1, t1, zero);
+          vminps(t1, t1, CPTR_AVX(elstore));
+          vcvtps2dq(t1, t1);
+          vcvtdq2ps(t1, t1);
+        }
+        else {
+          auto &t1 = stack.back();
+          vmaxps(t1.first, t1.first, zero);
+          vmaxps(t1.second, t1.second, zero);
+          vminps(t1.first, t1.first, CPTR_AVX(elstore));
+          vminps(t1.second, t1.second, CPTR_AVX(elstore));
+          vcvtps2dq(t1.first, t1.first);
+          vcvtps2dq(t1.second, t1.second);
+          vcvtdq2ps(t1.first, t1.first);
+          vcvtdq2ps(t1.second, t1.second);
+        }
+      }
       else if (iter.op == opAnd) {
         if (processSingle) {
           LogicOp_Single_Avx(vandps);
@@ -3153,7 +3201,7 @@ generated epilog example (new):
 ********************************************************************/
 
 extern const AVSFunction Exprfilter_filters[] = {
-  { "Expr", BUILTIN_FUNC_PREFIX, "c+s+[format]s[optAvx2]b[optSingleMode]b[optSSE2]b", Exprfilter::Create },
+  { "Expr", BUILTIN_FUNC_PREFIX, "c+s+[format]s[optAvx2]b[optSingleMode]b[optSSE2]b[lut]i[fuse]b", Exprfilter::Create },
   { 0 }
 };
 
@@ -3248,10 +3296,458 @@ AVSValue __cdecl Exprfilter::Create(AVSValue args, void* , IScriptEnvironment* e
   }
   next_paramindex++;
 
-  return new Exprfilter(children, expressions, newformat, optAvx2, optSingleMode, optSSE2, env);
+  // 0: never use lookup tables, 1: when the expression allows (default), 2: always, error if not possible
+  const int lutMode = args[next_paramindex].AsInt(lutAuto);
+  if (lutMode < lutOff || lutMode > lutForce)
+    env->ThrowError("Expr: lut must be 0, 1 or 2");
+  next_paramindex++;
+
+  // Computing Expr inputs in place only pays if nothing else needs their frames,
+  // which cannot be told here, so it must be asked for.
+  const bool fuse = args[next_paramindex].AsBool(false);
+  next_paramindex++;
+
+  return new Exprfilter(children, expressions, newformat, optAvx2, optSingleMode, optSSE2, lutMode, fuse, env);
+
+}
+
+
+// Evaluates the expression on rows [y_begin, y_end) of a plane, pixel by pixel,
+// with its own stack and variables.
+static void processPlaneC(const ExprOp *vops, size_t maxStackSize, int numInputs, const uint8_t * const *srcp_orig, const int *src_stride,
+  uint8_t *dstp_plane, int dst_stride, int w, int h, const float *internal_vars, int y_begin, int y_end)
+{
+  std::vector<float> stackVector(maxStackSize);
+  float *stack = stackVector.data();
+  float stacktop = 0;
+  float variable_area[MAX_USER_VARIABLES] = {}; // place for expr variables A..Z
+
+  const uint8_t *srcp[MAX_EXPR_INPUTS];
+  for (int i = 0; i < numInputs; i++)
+    srcp[i] = srcp_orig[i] + src_stride[i] * y_begin;
+  uint8_t *dstp = dstp_plane + dst_stride * y_begin;
+
+  for (int y = y_begin; y < y_end; y++) {
+    for (int x = 0; x < w; x++) {
+      int si = 0;
+      int i = -1;
+      while (true) {
+        i++;
+        switch (vops[i].op) {
+        case opLoadSpatialX:
+          stack[si] = stacktop;
+          stacktop = (float)x;
+          ++si;
+          break;
+        case opLoadSpatialY:
+          stack[si] = stacktop;
+          stacktop = (float)y;
+          ++si;
+          break;
+        case opLoadInternalVar:
+          stack[si] = stacktop;
+          stacktop = internal_vars[vops[i].e.ival];
+          ++si;
+          break;
+        case opLoadSrc8:
+          stack[si] = stacktop;
+          stacktop = srcp[vops[i].e.ival][x];
+          ++si;
+          break;
+        case opLoadSrc16:
+          stack[si] = stacktop;
+          stacktop = reinterpret_cast<const uint16_t *>(srcp[vops[i].e.ival])[x];
+          ++si;
+          break;
+        case opLoadSrcF32:
+          stack[si] = stacktop;
+          stacktop = reinterpret_cast<const float *>(srcp[vops[i].e.ival])[x];
+          ++si;
+          break;
+        case opLoadRelSrc8:
+          stack[si] = stacktop;
+          {
+            const int newx = x + vops[i].dx;
+            const int newy = y + vops[i].dy;
+            const int clipIndex = vops[i].e.ival;
+            const uint8_t* srcp2 = srcp_orig[clipIndex] + max(0, min(newy, h - 1)) * src_stride[clipIndex];
+            stacktop = srcp2[max(0, min(newx, w - 1))];
+          }
+          ++si;
+          break;
+        case opLoadRelSrc16:
+          stack[si] = stacktop;
+          {
+            const int newx = x + vops[i].dx;
+            const int newy = y + vops[i].dy;
+            const int clipIndex = vops[i].e.ival;
+            const uint16_t* srcp2 = reinterpret_cast<const uint16_t *>(srcp_orig[clipIndex] + max(0, min(newy, h - 1)) * src_stride[clipIndex]);
+            stacktop = srcp2[max(0, min(newx, w - 1))];
+          }
+          ++si;
+          break;
+        case opLoadRelSrcF32:
+          stack[si] = stacktop;
+          {
+            const int newx = x + vops[i].dx;
+            const int newy = y + vops[i].dy;
+            const int clipIndex = vops[i].e.ival;
+            const float* srcp2 = reinterpret_cast<const float *>(srcp_orig[clipIndex] + max(0, min(newy, h - 1)) * src_stride[clipIndex]);
+            stacktop = srcp2[max(0, min(newx, w - 1))];
+          }
+          ++si;
+          break;
+        case opLoadConst:
+          stack[si] = stacktop;
+          stacktop = vops[i].e.fval;
+          ++si;
+          break;
+        case opLoadVar:
+          stack[si] = stacktop;
+          stacktop = variable_area[vops[i].e.ival];
+          ++si;
+          break;
+        case opDup:
+          stack[si] = stacktop;
+          stacktop = stack[si - vops[i].e.ival];
+          ++si;
+          break;
+        case opSwap:
+          std::swap(stacktop, stack[si - vops[i].e.ival]);
+          break;
+        case opAdd:
+          --si;
+          stacktop += stack[si];
+          break;
+        case opSub:
+          --si;
+          stacktop = stack[si] - stacktop;
+          break;
+        case opMul:
+          --si;
+          stacktop *= stack[si];
+          break;
+        case opDiv:
+          --si;
+          stacktop = stack[si] / stacktop;
+          break;
+        case opFmod:
+          --si;
+          stacktop = std::fmod(stack[si], stacktop);
+          break;
+        case opMax:
+          --si;
+          stacktop = std::max(stacktop, stack[si]);
+          break;
+        case opMin:
+          --si;
+          stacktop = std::min(stacktop, stack[si]);
+          break;
+        case opExp:
+          stacktop = std::exp(stacktop);
+          break;
+        case opLog:
+          stacktop = std::log(stacktop);
+          break;
+        case opPow:
+          --si;
+          stacktop = std::pow(stack[si], stacktop);
+          break;
+        case opSqrt:
+          stacktop = std::sqrt(stacktop);
+          break;
+        case opAbs:
+          stacktop = std::abs(stacktop);
+          break;
+        case opSin:
+          stacktop = std::sin(stacktop);
+          break;
+        case opCos:
+          stacktop = std::cos(stacktop);
+          break;
+        case opTan:
+          stacktop = std::tan(stacktop);
+          break;
+        case opAsin:
+          stacktop = std::asin(stacktop);
+          break;
+        case opAcos:
+          stacktop = std::acos(stacktop);
+          break;
+        case opAtan:
+          stacktop = std::atan(stacktop);
+          break;
+        case opGt:
+          --si;
+          stacktop = (stack[si] > stacktop) ? 1.0f : 0.0f;
+          break;
+        case opLt:
+          --si;
+          stacktop = (stack[si] < stacktop) ? 1.0f : 0.0f;
+          break;
+        case opEq:
+          --si;
+          stacktop = (stack[si] == stacktop) ? 1.0f : 0.0f;
+          break;
+        case opNotEq:
+          --si;
+          stacktop = (stack[si] != stacktop) ? 1.0f : 0.0f;
+          break;
+        case opLE:
+          --si;
+          stacktop = (stack[si] <= stacktop) ? 1.0f : 0.0f;
+          break;
+        case opGE:
+          --si;
+          stacktop = (stack[si] >= stacktop) ? 1.0f : 0.0f;
+          break;
+        case opTernary:
+          si -= 2;
+          stacktop = (stack[si] > 0) ? stack[si + 1] : stacktop;
+          break;
+        case opAnd:
+          --si;
+          stacktop = (stacktop > 0 && stack[si] > 0) ? 1.0f : 0.0f;
+          break;
+        case opOr:
+          --si;
+          stacktop = (stacktop > 0 || stack[si] > 0) ? 1.0f : 0.0f;
+          break;
+        case opXor:
+          --si;
+          stacktop = ((stacktop > 0) != (stack[si] > 0)) ? 1.0f : 0.0f;
+          break;
+        case opNeg:
+          stacktop = (stacktop > 0) ? 0.0f : 1.0f;
+          break;
+        case opQuantize:
+          // same clamping and rounding as opStore8..16
+          stacktop = (float)(int)(std::max(0.0f, std::min(stacktop, (float)((1 << vops[i].e.ival) - 1))) + 0.5f);
+          break;
+        case opStore8:
+          dstp[x] = (uint8_t)(std::max(0.0f, std::min(stacktop, 255.0f)) + 0.5f);
+          goto loopend;
+        case opStore10:
+          reinterpret_cast<uint16_t *>(dstp)[x] = (uint16_t)(std::max(0.0f, std::min(stacktop, 1023.0f)) + 0.5f);
+          goto loopend;
+        case opStore12:
+          reinterpret_cast<uint16_t *>(dstp)[x] = (uint16_t)(std::max(0.0f, std::min(stacktop, 4095.0f)) + 0.5f);
+          goto loopend;
+        case opStore14:
+          reinterpret_cast<uint16_t *>(dstp)[x] = (uint16_t)(std::max(0.0f, std::min(stacktop, 16383.0f)) + 0.5f);
+          goto loopend;
+        case opStore16:
+          reinterpret_cast<uint16_t *>(dstp)[x] = (uint16_t)(std::max(0.0f, std::min(stacktop, 65535.0f)) + 0.5f);
+          goto loopend;
+        case opStoreF32:
+          reinterpret_cast<float *>(dstp)[x] = stacktop;
+          goto loopend;
+        case opStoreVar:
+          variable_area[vops[i].e.ival] = stacktop;
+          break;
+        case opStoreAndPopVar:
+          variable_area[vops[i].e.ival] = stacktop;
+          --si;
+          if(si >= 0)
+            stacktop = stack[si];
+          break;
+        }
+      }
+    loopend:;
+    }
+    dstp += dst_stride;
+    for (int i = 0; i < numInputs; i++)
+      srcp[i] += src_stride[i];
+  }
+}
+
 
+/********************************************************************
+***** Lookup tables                                             *****
+********************************************************************/
+
+// An expression that reads nothing but the current pixel of one 8-12 bit
+// clip, or of two 8 bit clips, gives the same result for the same input
+// values. Such planes are evaluated once for every possible input at
+// construction time and then only looked up.
+static bool findLutInputs(const std::vector<ExprOp> &ops, const VideoInfo **vi, int *lutClip, int *lutDims)
+{
+  int nclips = 0;
+  bool varStored[MAX_USER_VARIABLES] = {};
+
+  for (size_t i = 0; i < ops.size(); i++) {
+    switch (ops[i].op) {
+    case opLoadSrc8:
+    case opLoadSrc16: {
+      const int clip = ops[i].e.ival;
+      if (nclips >= 1 && lutClip[0] == clip)
+        break;
+      if (nclips >= 2 && lutClip[1] == clip)
+        break;
+      if (nclips == 2)
+        return false;
+      lutClip[nclips++] = clip;
+      break;
+    }
+    case opLoadSrcF32: case opLoadSrcF16:
+    case opLoadRelSrc8: case opLoadRelSrc16: case opLoadRelSrcF32:
+    case opLoadSpatialX: case opLoadSpatialY:
+    case opLoadInternalVar:
+      return false;
+    case opStoreVar:
+    case opStoreAndPopVar:
+      varStored[ops[i].e.ival] = true;
+      break;
+    case opLoadVar:
+      // a variable not set earlier for the same pixel holds the previous pixel's value
+      if (!varStored[ops[i].e.ival])
+        return false;
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (nclips == 1) {
+    *lutDims = 1;
+    return vi[lutClip[0]]->BitsPerComponent() <= 12;
+  }
+  if (nclips == 2) {
+    *lutDims = 2;
+    return vi[lutClip[0]]->BitsPerComponent() == 8 && vi[lutClip[1]]->BitsPerComponent() == 8;
+  }
+  return false; // constant, already a fill
 }
 
+// Size of the made-up planes a table is computed from. 10-12 bit inputs
+// cover the whole 16 bit range, out of range samples get what the
+// evaluator would make of them.
+static void lutRampSize(const ExprData &d, int plane, const VideoInfo **vi, int *width, int *height)
+{
+  *width = vi[d.lutClip[plane][0]]->ComponentSize() == 1 ? 256 : 65536;
+  *height = d.lutDims[plane] == 2 ? 256 : 1;
+}
+
+// Runs the plane's program on made-up planes that hold every input value
+// once. The table then holds exactly what the JIT code, or the C path when
+// pixels_per_iter is 0, would store.
+static void buildLut(ExprData &d, int plane, const VideoInfo **vi, int pixels_per_iter)
+{
+  const int clip0 = d.lutClip[plane][0];
+  const int pixelsize0 = vi[clip0]->ComponentSize();
+  const int pixelsize_out = d.vi.ComponentSize();
+  int size0, height;
+  lutRampSize(d, plane, vi, &size0, &height);
+
+  const uint8_t *srcp[MAX_EXPR_INPUTS] = {};
+  int src_stride[MAX_EXPR_INPUTS] = {};
+
+  // the JIT code loads and stores aligned
+  const int ALIGN = 64;
+  auto aligned = [](std::vector<uint8_t> &v) { return v.data() + ((ALIGN - ((uintptr_t)v.data() & (ALIGN - 1))) & (ALIGN - 1)); };
+
+  // lutClip[0]: one row with all values, the same for every row
+  std::vector<uint8_t> values0(size0 * pixelsize0 + ALIGN);
+  uint8_t *values0p = aligned(values0);
+  for (int v = 0; v < size0; v++) {
+    if (pixelsize0 == 1)
+      values0p[v] = (uint8_t)v;
+    else
+      reinterpret_cast<uint16_t *>(values0p)[v] = (uint16_t)v;
+  }
+  srcp[clip0] = values0p;
+
+  // lutClip[1]: row y is filled with y
+  std::vector<uint8_t> values1;
+  if (d.lutDims[plane] == 2) {
+    const int clip1 = d.lutClip[plane][1];
+    values1.resize(256 * 256 + ALIGN);
+    uint8_t *values1p = aligned(values1);
+    for (int y = 0; y < 256; y++)
+      std::fill_n(values1p + y * 256, 256, (uint8_t)y);
+    srcp[clip1] = values1p;
+    src_stride[clip1] = 256;
+  }
+
+  const int dst_stride = size0 * pixelsize_out;
+  std::vector<uint8_t> table((size_t)dst_stride * height + ALIGN);
+  uint8_t *dstp = aligned(table);
+
+#ifdef VS_TARGET_CPU_X86
+  if (pixels_per_iter > 0) {
+    intptr_t ptroffsets[1 + 1 + MAX_EXPR_INPUTS] = {};
+    ptroffsets[RWPTR_START_OF_OUTPUT] = pixelsize_out * pixels_per_iter;
+    ptroffsets[RWPTR_START_OF_XCOUNTER] = pixels_per_iter;
+    for (int i = 0; i < d.numInputs; i++)
+      ptroffsets[RWPTR_START_OF_INPUTS + i] = srcp[i] ? vi[i]->ComponentSize() * pixels_per_iter : 0;
+
+    alignas(32) const uint8_t *rwptrs[RWPTR_SIZE] = {};
+    for (int y = 0; y < height; y++) {
+      rwptrs[RWPTR_START_OF_OUTPUT] = dstp + dst_stride * y;
+      rwptrs[RWPTR_START_OF_XCOUNTER] = 0;
+      for (int i = 0; i < d.numInputs; i++) {
+        rwptrs[i + RWPTR_START_OF_INPUTS] = srcp[i] ? srcp[i] + src_stride[i] * y : nullptr;
+        rwptrs[i + RWPTR_START_OF_STRIDES] = reinterpret_cast<const uint8_t *>((intptr_t)src_stride[i]);
+      }
+      d.proc[plane](rwptrs, ptroffsets, size0 / pixels_per_iter, y);
+    }
+  }
+  else
+#endif
+  {
+    const float internal_vars[6] = {};
+    processPlaneC(d.ops[plane].data(), d.maxStackSize, d.numInputs, srcp, src_stride,
+      dstp, dst_stride, size0, height, internal_vars, 0, height);
+  }
+
+  d.lut[plane].assign(dstp, dstp + (size_t)dst_stride * height);
+}
+
+template<typename pixel_t, typename lut_t>
+static void applyLut1D(uint8_t *dstp, int dst_stride, const uint8_t *srcp, int src_stride, int w, int y_begin, int y_end, const lut_t *lut)
+{
+  dstp += dst_stride * y_begin;
+  srcp += src_stride * y_begin;
+  for (int y = y_begin; y < y_end; y++) {
+    const pixel_t *s = reinterpret_cast<const pixel_t *>(srcp);
+    lut_t *dst = reinterpret_cast<lut_t *>(dstp);
+    for (int x = 0; x < w; x++)
+      dst[x] = lut[s[x]];
+    dstp += dst_stride;
+    srcp += src_stride;
+  }
+}
+
+template<typename lut_t>
+static void applyLut2D(uint8_t *dstp, int dst_stride, const uint8_t *srcp0, int src_stride0, const uint8_t *srcp1, int src_stride1, int w, int y_begin, int y_end, const lut_t *lut)
+{
+  dstp += dst_stride * y_begin;
+  srcp0 += src_stride0 * y_begin;
+  srcp1 += src_stride1 * y_begin;
+  for (int y = y_begin; y < y_end; y++) {
+    lut_t *dst = reinterpret_cast<lut_t *>(dstp);
+    for (int x = 0; x < w; x++)
+      dst[x] = lut[srcp0[x] | (srcp1[x] << 8)];
+    dstp += dst_stride;
+    srcp0 += src_stride0;
+    srcp1 += src_stride1;
+  }
+}
+
+template<typename lut_t>
+static void applyLut(const ExprData &d, int plane, uint8_t *dstp, int dst_stride, const uint8_t * const *srcp, const int *src_stride, int w, int y_begin, int y_end)
+{
+  const lut_t *lut = reinterpret_cast<const lut_t *>(d.lut[plane].data());
+  const int clip0 = d.lutClip[plane][0];
+  if (d.lutDims[plane] == 2) {
+    const int clip1 = d.lutClip[plane][1];
+    applyLut2D<lut_t>(dstp, dst_stride, srcp[clip0], src_stride[clip0], srcp[clip1], src_stride[clip1], w, y_begin, y_end, lut);
+  }
+  else if (d.node[clip0]->GetVideoInfo().ComponentSize() == 1)
+    applyLut1D<uint8_t, lut_t>(dstp, dst_stride, srcp[clip0], src_stride[clip0], w, y_begin, y_end, lut);
+  else
+    applyLut1D<uint16_t, lut_t>(dstp, dst_stride, srcp[clip0], src_stride[clip0], w, y_begin, y_end, lut);
+}
 
 PVideoFrame __stdcall Exprfilter::GetFrame(int n, IScriptEnvironment *env) {
   // ExprData d class variable already filled 
@@ -3267,10 +3763,8 @@ PVideoFrame __stdcall Exprfilter::GetFrame(int n, IScriptEnvironment *env) {
 
   PVideoFrame dst = env->NewVideoFrame(d.vi);
 
-  const uint8_t *srcp[MAX_EXPR_INPUTS] = {};
   const uint8_t *srcp_orig[MAX_EXPR_INPUTS] = {}; // for C
   int src_stride[MAX_EXPR_INPUTS] = {};
-  float variable_area[MAX_USER_VARIABLES] = {}; // for C, place for expr variables A..Z
 
   const float framecount = (float)n; // max precision: 2^24 (16M) frames (32 bit float precision)
   const float relative_time = (float)((double)n / vi.num_frames); // 0 <= time < 1
@@ -3291,6 +3785,7 @@ PVideoFrame __stdcall Exprfilter::GetFrame(int n, IScriptEnvironment *env) {
 
     if (d.plane[plane] == poProcess) {
       if (optSSE2 && d.planeOptSSE2[plane]) {
+        const uint8_t *srcp[MAX_EXPR_INPUTS] = {};
         for (int i = 0; i < numInputs; i++) {
           if (d.node[i]) {
             if (d.clipsUsed[i]) {
@@ -3314,279 +3809,78 @@ PVideoFrame __stdcall Exprfilter::GetFrame(int n, IScriptEnvironment *env) {
 
         ExprData::ProcessLineProc proc = d.proc[plane];
 
-        alignas(32) const uint8_t *rwptrs[RWPTR_SIZE];
-        *reinterpret_cast<float *>(&rwptrs[RWPTR_START_OF_INTERNAL_VARIABLES + INTERNAL_VAR_CURRENT_FRAME]) = (float)framecount;
-        *reinterpret_cast<float *>(&rwptrs[RWPTR_START_OF_INTERNAL_VARIABLES + INTERNAL_VAR_RELTIME]) = (float)relative_time;
-        for (int y = 0; y < h; y++) {
-          rwptrs[RWPTR_START_OF_OUTPUT] = dstp + dst_stride * y;
-          rwptrs[RWPTR_START_OF_XCOUNTER] = 0; // xcounter internal variable
-          for (int i = 0; i < numInputs; i++) {
-            rwptrs[i + RWPTR_START_OF_INPUTS] = srcp[i] + src_stride[i] * y; // input pointers 1..Nth
-            rwptrs[i + RWPTR_START_OF_STRIDES] = reinterpret_cast<const uint8_t *>((intptr_t)src_stride[i]);
+        // lines are independent, bands of them run in parallel, each with its own pointer/variable area
+        RunRowBands(env, h, 1, [&](int y_begin, int y_end) {
+          alignas(32) const uint8_t *rwptrs[RWPTR_SIZE];
+          *reinterpret_cast<float *>(&rwptrs[RWPTR_START_OF_INTERNAL_VARIABLES + INTERNAL_VAR_CURRENT_FRAME]) = (float)framecount;
+          *reinterpret_cast<float *>(&rwptrs[RWPTR_START_OF_INTERNAL_VARIABLES + INTERNAL_VAR_RELTIME]) = (float)relative_time;
+          for (int y = y_begin; y < y_end; y++) {
+            rwptrs[RWPTR_START_OF_OUTPUT] = dstp + dst_stride * y;
+            rwptrs[RWPTR_START_OF_XCOUNTER] = 0; // xcounter internal variable
+            for (int i = 0; i < numInputs; i++) {
+              rwptrs[i + RWPTR_START_OF_INPUTS] = srcp[i] + src_stride[i] * y; // input pointers 1..Nth
+              rwptrs[i + RWPTR_START_OF_STRIDES] = reinterpret_cast<const uint8_t *>((intptr_t)src_stride[i]);
+            }
+            proc(rwptrs, ptroffsets, nfulliterations, y); // parameters are put directly in registers
           }
-          proc(rwptrs, ptroffsets, nfulliterations, y); // parameters are put directly in registers
-        }
+        });
       }
       else {
         // C version
-        std::vector<float> stackVector(d.maxStackSize);
         for (int i = 0; i < numInputs; i++) {
           if (d.node[i]) {
             if (d.clipsUsed[i]) {
-              srcp[i] = src[i]->GetReadPtr(plane_enum);
-              srcp_orig[i] = srcp[i];
+              srcp_orig[i] = src[i]->GetReadPtr(plane_enum);
               src_stride[i] = src[i]->GetPitch(plane_enum);
             }
             else {
-              srcp[i] = nullptr;
               srcp_orig[i] = nullptr;
               src_stride[i] = 0;
             }
           }
         }
 
-        uint8_t *dstp = dst->GetWritePtr(plane_enum);
+        uint8_t *dstp_plane = dst->GetWritePtr(plane_enum);
         int dst_stride = dst->GetPitch(plane_enum);
         int h = d.vi.height >> d.vi.GetPlaneHeightSubsampling(plane_enum);
         int w = d.vi.width >> d.vi.GetPlaneWidthSubsampling(plane_enum);
 
         const ExprOp *vops = d.ops[plane].data();
-        float *stack = stackVector.data();
-        float stacktop = 0;
 
         float internal_vars[6];
         internal_vars[INTERNAL_VAR_CURRENT_FRAME] = (float)framecount;
         internal_vars[INTERNAL_VAR_RELTIME] = (float)relative_time;
 
-        for (int y = 0; y < h; y++) {
-          for (int x = 0; x < w; x++) {
-            int si = 0;
-            int i = -1;
-            while (true) {
-              i++;
-              switch (vops[i].op) {
-              case opLoadSpatialX:
-                stack[si] = stacktop;
-                stacktop = (float)x;
-                ++si;
-                break;
-              case opLoadSpatialY:
-                stack[si] = stacktop;
-                stacktop = (float)y;
-                ++si;
-                break;
-              case opLoadInternalVar:
-                stack[si] = stacktop;
-                stacktop = internal_vars[vops[i].e.ival];
-                ++si;
-                break;
-              case opLoadSrc8:
-                stack[si] = stacktop;
-                stacktop = srcp[vops[i].e.ival][x];
-                ++si;
-                break;
-              case opLoadSrc16:
-                stack[si] = stacktop;
-                stacktop = reinterpret_cast<const uint16_t *>(srcp[vops[i].e.ival])[x];
-                ++si;
-                break;
-              case opLoadSrcF32:
-                stack[si] = stacktop;
-                stacktop = reinterpret_cast<const float *>(srcp[vops[i].e.ival])[x];
-                ++si;
-                break;
-              case opLoadRelSrc8:
-                stack[si] = stacktop;
-                {
-                  const int newx = x + vops[i].dx;
-                  const int newy = y + vops[i].dy;
-                  const int clipIndex = vops[i].e.ival;
-                  const uint8_t* srcp2 = srcp_orig[clipIndex] + max(0, min(newy, h - 1)) * src_stride[clipIndex];
-                  stacktop = srcp2[max(0, min(newx, w - 1))];
-                }
-                ++si;
-                break;
-              case opLoadRelSrc16:
-                stack[si] = stacktop;
-                {
-                  const int newx = x + vops[i].dx;
-                  const int newy = y + vops[i].dy;
-                  const int clipIndex = vops[i].e.ival;
-                  const uint16_t* srcp2 = reinterpret_cast<const uint16_t *>(srcp_orig[clipIndex] + max(0, min(newy, h - 1)) * src_stride[clipIndex]);
-                  stacktop = srcp2[max(0, min(newx, w - 1))];
-                }
-                ++si;
-                break;
-              case opLoadRelSrcF32:
-                stack[si] = stacktop;
-                {
-                  const int newx = x + vops[i].dx;
-                  const int newy = y + vops[i].dy;
-                  const int clipIndex = vops[i].e.ival;
-                  const float* srcp2 = reinterpret_cast<const float *>(srcp_orig[clipIndex] + max(0, min(newy, h - 1)) * src_stride[clipIndex]);
-                  stacktop = srcp2[max(0, min(newx, w - 1))];
-                }
-                ++si;
-                break;
-              case opLoadConst:
-                stack[si] = stacktop;
-                stacktop = vops[i].e.fval;
-                ++si;
-                break;
-              case opLoadVar:
-                stack[si] = stacktop;
-                stacktop = variable_area[vops[i].e.ival];
-                ++si;
-                break;
-              case opDup:
-                stack[si] = stacktop;
-                stacktop = stack[si - vops[i].e.ival];
-                ++si;
-                break;
-              case opSwap:
-                std::swap(stacktop, stack[si - vops[i].e.ival]);
-                break;
-              case opAdd:
-                --si;
-                stacktop += stack[si];
-                break;
-              case opSub:
-                --si;
-                stacktop = stack[si] - stacktop;
-                break;
-              case opMul:
-                --si;
-                stacktop *= stack[si];
-                break;
-              case opDiv:
-                --si;
-                stacktop = stack[si] / stacktop;
-                break;
-              case opFmod:
-                --si;
-                stacktop = std::fmod(stack[si], stacktop);
-                break;
-              case opMax:
-                --si;
-                stacktop = std::max(stacktop, stack[si]);
-                break;
-              case opMin:
-                --si;
-                stacktop = std::min(stacktop, stack[si]);
-                break;
-              case opExp:
-                stacktop = std::exp(stacktop);
-                break;
-              case opLog:
-                stacktop = std::log(stacktop);
-                break;
-              case opPow:
-                --si;
-                stacktop = std::pow(stack[si], stacktop);
-                break;
-              case opSqrt:
-                stacktop = std::sqrt(stacktop);
-                break;
-              case opAbs:
-                stacktop = std::abs(stacktop);
-                break;
-              case opSin:
-                stacktop = std::sin(stacktop);
-                break;
-              case opCos:
-                stacktop = std::cos(stacktop);
-                break;
-              case opTan:
-                stacktop = std::tan(stacktop);
-                break;
-              case opAsin:
-                stacktop = std::asin(stacktop);
-                break;
-              case opAcos:
-                stacktop = std::acos(stacktop);
-                break;
-              case opAtan:
-                stacktop = std::atan(stacktop);
-                break;
-              case opGt:
-                --si;
-                stacktop = (stack[si] > stacktop) ? 1.0f : 0.0f;
-                break;
-              case opLt:
-                --si;
-                stacktop = (stack[si] < stacktop) ? 1.0f : 0.0f;
-                break;
-              case opEq:
-                --si;
-                stacktop = (stack[si] == stacktop) ? 1.0f : 0.0f;
-                break;
-              case opNotEq:
-                --si;
-                stacktop = (stack[si] != stacktop) ? 1.0f : 0.0f;
-                break;
-              case opLE:
-                --si;
-                stacktop = (stack[si] <= stacktop) ? 1.0f : 0.0f;
-                break;
-              case opGE:
-                --si;
-                stacktop = (stack[si] >= stacktop) ? 1.0f : 0.0f;
-                break;
-              case opTernary:
-                si -= 2;
-                stacktop = (stack[si] > 0) ? stack[si + 1] : stacktop;
-                break;
-              case opAnd:
-                --si;
-                stacktop = (stacktop > 0 && stack[si] > 0) ? 1.0f : 0.0f;
-                break;
-              case opOr:
-                --si;
-                stacktop = (stacktop > 0 || stack[si] > 0) ? 1.0f : 0.0f;
-                break;
-              case opXor:
-                --si;
-                stacktop = ((stacktop > 0) != (stack[si] > 0)) ? 1.0f : 0.0f;
-                break;
-              case opNeg:
-                stacktop = (stacktop > 0) ? 0.0f : 1.0f;
-                break;
-              case opStore8:
-                dstp[x] = (uint8_t)(std::max(0.0f, std::min(stacktop, 255.0f)) + 0.5f);
-                goto loopend;
-              case opStore10:
-                reinterpret_cast<uint16_t *>(dstp)[x] = (uint16_t)(std::max(0.0f, std::min(stacktop, 1023.0f)) + 0.5f);
-                goto loopend;
-              case opStore12:
-                reinterpret_cast<uint16_t *>(dstp)[x] = (uint16_t)(std::max(0.0f, std::min(stacktop, 4095.0f)) + 0.5f);
-                goto loopend;
-              case opStore14:
-                reinterpret_cast<uint16_t *>(dstp)[x] = (uint16_t)(std::max(0.0f, std::min(stacktop, 16383.0f)) + 0.5f);
-                goto loopend;
-              case opStore16:
-                reinterpret_cast<uint16_t *>(dstp)[x] = (uint16_t)(std::max(0.0f, std::min(stacktop, 65535.0f)) + 0.5f);
-                goto loopend;
-              case opStoreF32:
-                reinterpret_cast<float *>(dstp)[x] = stacktop;
-                goto loopend;
-              case opStoreVar:
-                variable_area[vops[i].e.ival] = stacktop;
-                break;
-              case opStoreAndPopVar:
-                variable_area[vops[i].e.ival] = stacktop;
-                --si;
-                if(si >= 0)
-                  stacktop = stack[si];
-                break;
-              }
-            }
-          loopend:;
-          }
-          dstp += dst_stride;
-          for (int i = 0; i < numInputs; i++)
-            srcp[i] += src_stride[i];
+        // lines are independent, bands of them run in parallel, each with its own stack and variables
+        RunRowBands(env, h, 1, [&](int y_begin, int y_end) {
+          processPlaneC(vops, d.maxStackSize, numInputs, srcp_orig, src_stride, dstp_plane, dst_stride, w, h, internal_vars, y_begin, y_end);
+        });
+      }
+    }
+    else if (d.plane[plane] == poLut) {
+      for (int i = 0; i < numInputs; i++) {
+        if (d.node[i] && d.clipsUsed[i]) {
+          srcp_orig[i] = src[i]->GetReadPtr(plane_enum);
+          src_stride[i] = src[i]->GetPitch(plane_enum);
+        }
+        else {
+          srcp_orig[i] = nullptr;
+          src_stride[i] = 0;
         }
       }
+
+      uint8_t *dstp = dst->GetWritePtr(plane_enum);
+      const int dst_stride = dst->GetPitch(plane_enum);
+      const int h = d.vi.height >> d.vi.GetPlaneHeightSubsampling(plane_enum);
+      const int w = d.vi.width >> d.vi.GetPlaneWidthSubsampling(plane_enum);
+
+      RunRowBands(env, h, 1, [&](int y_begin, int y_end) {
+        switch (d.vi.ComponentSize()) {
+        case 1: applyLut<uint8_t>(d, plane, dstp, dst_stride, srcp_orig, src_stride, w, y_begin, y_end); break;
+        case 2: applyLut<uint16_t>(d, plane, dstp, dst_stride, srcp_orig, src_stride, w, y_begin, y_end); break;
+        default: applyLut<float>(d, plane, dstp, dst_stride, srcp_orig, src_stride, w, y_begin, y_end); break;
+        }
+      });
     }
     // avs+: copy plane here
     else if (d.plane[plane] == poCopy) {
@@ -4261,6 +4555,7 @@ static int numOperands(uint32_t op) {
         case opNeg:
         case opExp:
         case opLog:
+        case opQuantize:
         case opStoreVar:
         case opStoreAndPopVar:
         case opSin:
@@ -4370,7 +4665,6 @@ static void findBranches(std::vector<ExprOp> &ops, size_t pos, size_t *start1, s
     }
 }
 
-/*
 #define PAIR(x) { x, #x }
 static std::unordered_map<uint32_t, std::string> op_strings = {
         PAIR(opLoadSrc8),
@@ -4383,10 +4677,10 @@ static std::unordered_map<uint32_t, std::string> op_strings = {
         PAIR(opLoadSpatialX),
         PAIR(opLoadSpatialY),
         PAIR(opLoadConst),
-        PAIR(opLoadInternalVars),
-        PAIR(opLoadVar)
-        PAIR(opLoadAndPopVar)
-        PAIR(opStoreVar)
+        PAIR(opLoadInternalVar),
+        PAIR(opLoadVar),
+        PAIR(opStoreAndPopVar),
+        PAIR(opStoreVar),
         PAIR(opStore8),
         PAIR(opStore10),
         PAIR(opStore12),
@@ -4418,32 +4712,34 @@ static std::unordered_map<uint32_t, std::string> op_strings = {
         PAIR(opNeg),
         PAIR(opExp),
         PAIR(opLog),
-        PAIR(opPow)
-        PAIR(opSin)
-        PAIR(opCos)
-        PAIR(opTan)
-        PAIR(opAsin)
-        PAIR(opAcos)
-        PAIR(opAtan)
+        PAIR(opPow),
+        PAIR(opSin),
+        PAIR(opCos),
+        PAIR(opTan),
+        PAIR(opAsin),
+        PAIR(opAcos),
+        PAIR(opAtan),
+        PAIR(opQuantize)
       };
 #undef PAIR
 
-
-static void printExpression(const std::vector<ExprOp> &ops) {
-    fprintf(stderr, "Expression: '");
+// Logs the program of a plane after optimization at debug level, its
+// length is the number of operations run per pixel.
+static void printExpression(int plane, const std::vector<ExprOp> &ops, IScriptEnvironment *env) {
+    std::ostringstream s;
+    s.imbue(std::locale::classic());
 
     for (size_t i = 0; i < ops.size(); i++) {
-        fprintf(stderr, " %s", op_strings[ops[i].op].c_str());
+        s << ' ' << op_strings[ops[i].op];
 
         if (ops[i].op == opLoadConst)
-            fprintf(stderr, "(%.3f)", ops[i].e.fval);
-        else if (isLoadOp(ops[i].op))
-            fprintf(stderr, "(%d)", ops[i].e.ival);
+            s << '(' << ops[i].e.fval << ')';
+        else if (isLoadOp(ops[i].op) || ops[i].op == opDup || ops[i].op == opSwap || ops[i].op == opStoreVar || ops[i].op == opStoreAndPopVar || ops[i].op == opQuantize)
+            s << '(' << ops[i].e.ival << ')';
     }
 
-    fprintf(stderr, "'\n");
+    static_cast<InternalEnvironment*>(env)->LogMsg(LOGLEVEL_DEBUG, "Expr: plane %d, %d ops:%s", plane + 1, (int)ops.size(), s.str().c_str());
 }
-*/
 
 static void foldConstants(std::vector<ExprOp> &ops) {
     for (size_t i = 0; i < ops.size(); i++) {
@@ -4492,11 +4788,18 @@ static void foldConstants(std::vector<ExprOp> &ops) {
           // optimize Mul 1 Div 1
         case opMul: case opDiv:
           if (ops[i - 1].op == opLoadConst) {
+            int exponent;
             if (ops[i - 1].e.fval == 1.0f) {
               // replace mul 1 or div 1 with nothing
               ops.erase(ops.begin() + i - 1, ops.begin() + i + 1);
               i -= 2;
             }
+            else if (ops[i].op == opDiv && std::isfinite(ops[i - 1].e.fval) &&
+              std::abs(std::frexp(ops[i - 1].e.fval, &exponent)) == 0.5f && exponent > -125 && exponent < 126) {
+              // replace div 2^n with mul 2^-n, the reciprocal is exact
+              ops[i - 1].e.fval = 1.0f / ops[i - 1].e.fval;
+              ops[i].op = opMul;
+            }
           }
           break;
           // optimize Add 0 or Sub 0
@@ -4594,9 +4897,443 @@ static void foldConstants(std::vector<ExprOp> &ops) {
     }
 }
 
+// Operation of the expression graph built by eliminateCommonSubexpressions.
+// Equal operations on equal operands are the same node.
+struct ExprNode {
+    ExprOp op;
+    int operand[3];
+    int uses;
+    int var; // user variable holding the value once computed, or -1
+};
+
+static bool isCommutative(uint32_t op) {
+    // exact for floats; not min/max: their NaN handling depends on the order
+    return op == opAdd || op == opMul;
+}
+
+static int findOrAddNode(std::vector<ExprNode> &nodes, const ExprOp &op, const int *operand, int n) {
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const ExprNode &node = nodes[i];
+        // the argument only counts for loads and opQuantize, folding may leave garbage in that of other operations
+        if (node.op.op == op.op && ((n > 0 && op.op != opQuantize) || (node.op.e.ival == op.e.ival && node.op.dx == op.dx && node.op.dy == op.dy)) &&
+          std::equal(operand, operand + n, node.operand))
+            return (int)i;
+    }
+    ExprNode node = { op, { -1, -1, -1 }, 0, -1 };
+    std::copy(operand, operand + n, node.operand);
+    nodes.push_back(node);
+    return (int)nodes.size() - 1;
+}
+
+static void countUses(std::vector<ExprNode> &nodes, int n) {
+    if (nodes[n].uses++ > 0)
+        return; // operands of a shared node are counted once
+    for (int i = 0; i < numOperands(nodes[n].op.op); i++)
+        countUses(nodes, nodes[n].operand[i]);
+}
+
+static void emitNode(std::vector<ExprNode> &nodes, int n, std::vector<ExprOp> &ops, int &nextVar) {
+    ExprNode &node = nodes[n];
+    if (node.var >= 0) {
+        ops.push_back(ExprOp(opLoadVar, node.var));
+        return;
+    }
+    for (int i = 0; i < numOperands(node.op.op); i++)
+        emitNode(nodes, node.operand[i], ops, nextVar);
+    ops.push_back(node.op);
+    // loads are as cheap as reading a variable, the rest is kept if needed again
+    if (node.uses > 1 && !isLoadOp(node.op.op) && nextVar < MAX_USER_VARIABLES) {
+        node.var = nextVar++;
+        ops.push_back(ExprOp(opStoreVar, node.var));
+    }
+}
+
+// Turns the stack program into a graph and writes it back, computing every
+// distinct subexpression once. Values needed more than once are kept in
+// user variables. dup/swap and the user's own variables are resolved while
+// building the graph, so only operations that are actually needed for the
+// result survive. Results are the same as those of the original program.
+static void eliminateCommonSubexpressions(std::vector<ExprOp> &ops) {
+    if (ops.size() < 2)
+        return;
+
+    std::vector<ExprNode> nodes;
+    std::vector<int> stack;
+    int varNode[MAX_USER_VARIABLES];
+    std::fill_n(varNode, MAX_USER_VARIABLES, -1);
+
+    for (size_t i = 0; i < ops.size() - 1; i++) { // last one is the store
+        const ExprOp &op = ops[i];
+        switch (op.op) {
+        case opDup:
+            stack.push_back(stack[stack.size() - 1 - op.e.ival]);
+            break;
+        case opSwap:
+            std::swap(stack.back(), stack[stack.size() - 1 - op.e.ival]);
+            break;
+        case opLoadVar:
+            // not stored before for this pixel: the value of the previous pixel, keep the program as it is
+            if (varNode[op.e.ival] < 0)
+                return;
+            stack.push_back(varNode[op.e.ival]);
+            break;
+        case opStoreVar:
+            varNode[op.e.ival] = stack.back();
+            break;
+        case opStoreAndPopVar:
+            varNode[op.e.ival] = stack.back();
+            stack.pop_back();
+            break;
+        default: {
+            const int n = numOperands(op.op);
+            int operand[3];
+            for (int j = n - 1; j >= 0; j--) {
+                operand[j] = stack.back();
+                stack.pop_back();
+            }
+            if (isCommutative(op.op) && operand[0] > operand[1])
+                std::swap(operand[0], operand[1]);
+
+            if ((op.op == opMax || op.op == opMin) && operand[0] == operand[1])
+                stack.push_back(operand[0]); // max(a, a) = a
+            else if (op.op == opTernary && operand[1] == operand[2])
+                stack.push_back(operand[1]); // same value for both branches, condition not needed
+            else
+                stack.push_back(findOrAddNode(nodes, op, operand, n));
+            break;
+        }
+        }
+    }
+
+    const int root = stack.back();
+    countUses(nodes, root);
+
+    std::vector<ExprOp> optimized;
+    int nextVar = 0;
+    emitNode(nodes, root, optimized, nextVar);
+    optimized.push_back(ops.back());
+
+    if (optimized.size() < ops.size())
+        ops.swap(optimized);
+}
+
+// Stack depth needed to run the program
+static size_t stackDepth(const std::vector<ExprOp> &ops) {
+    size_t depth = 0, maxDepth = 0;
+    for (size_t i = 0; i < ops.size(); i++) {
+        const uint32_t op = ops[i].op;
+        if (op == opDup || isLoadOp(op))
+            depth++;
+        else if (op == opStoreAndPopVar)
+            depth--;
+        else if (op != opSwap && numOperands(op) > 1)
+            depth -= numOperands(op) - 1;
+        maxDepth = std::max(depth, maxDepth);
+    }
+    return maxDepth;
+}
+
+#ifdef VS_TARGET_CPU_X86
+ExprCode::ExprCode(const void *src, size_t _size) : size(_size) {
+#ifdef VS_TARGET_OS_WINDOWS
+  code = VirtualAlloc(nullptr, size, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+#else
+  code = mmap(nullptr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANON | MAP_PRIVATE, 0, 0);
+  if (code == MAP_FAILED)
+    code = nullptr;
+#endif
+  if (!code)
+    throw std::runtime_error("Could not allocate memory for the compiled expression");
+  memcpy(code, src, size);
+#ifdef VS_TARGET_OS_WINDOWS
+  FlushInstructionCache(GetCurrentProcess(), code, size);
+#endif
+}
+
+ExprCode::~ExprCode() {
+#ifdef VS_TARGET_OS_WINDOWS
+  VirtualFree(code, 0, MEM_RELEASE);
+#else
+  munmap(code, size);
+#endif
+}
+
+// Compiled routines of the whole process. Scripts often use the same
+// expression many times, and reloading a script creates all instances
+// again: those find their code here instead of compiling it once more.
+// Routines no instance uses are dropped once the cache grows beyond
+// EXPR_CODE_CACHE_MAX bytes.
+static const size_t EXPR_CODE_CACHE_MAX = 16 * 1024 * 1024;
+static std::mutex exprCodeMutex;
+static std::unordered_map<std::string, std::shared_ptr<ExprCode>> exprCodeCache;
+static size_t exprCodeCacheSize = 0;
+
+// The generated code depends on the optimized program, which includes the
+// pixel types of the loads and of the store, and on the parameters of the
+// code generator.
+static std::string exprCodeKey(const std::vector<ExprOp> &ops, int numInputs, int cpuFlags, int planewidth, int planeheight, bool singleMode, bool avx2) {
+  const int params[] = { numInputs, cpuFlags, planewidth, planeheight, singleMode, avx2 };
+  std::string key(reinterpret_cast<const char *>(params), sizeof(params));
+  for (size_t i = 0; i < ops.size(); i++) {
+    const int op[] = { (int)ops[i].op, ops[i].e.ival, ops[i].dx, ops[i].dy };
+    key.append(reinterpret_cast<const char *>(op), sizeof(op));
+  }
+  return key;
+}
+
+static std::shared_ptr<ExprCode> getExprCode(std::vector<ExprOp> &ops, int numInputs, int cpuFlags, int planewidth, int planeheight, bool singleMode, bool avx2) {
+  const std::string key = exprCodeKey(ops, numInputs, cpuFlags, planewidth, planeheight, singleMode, avx2);
+  {
+    std::lock_guard<std::mutex> lock(exprCodeMutex);
+    auto it = exprCodeCache.find(key);
+    if (it != exprCodeCache.end())
+      return it->second;
+  }
+
+  std::shared_ptr<ExprCode> code;
+  if (avx2) {
+    ExprEvalAvx2 ExprObj(ops, numInputs, cpuFlags, planewidth, planeheight, singleMode);
+    if (ExprObj.GetCode(true) && ExprObj.GetCodeSize()) // PF modded jitasm. true: epilog with vmovaps, and vzeroupper
+      code = std::make_shared<ExprCode>(ExprObj.GetCode(), ExprObj.GetCodeSize());
+  }
+  else {
+    ExprEval ExprObj(ops, numInputs, cpuFlags, planewidth, planeheight, singleMode);
+    if (ExprObj.GetCode() && ExprObj.GetCodeSize())
+      code = std::make_shared<ExprCode>(ExprObj.GetCode(), ExprObj.GetCodeSize());
+  }
+  if (!code)
+    return code;
+
+  std::lock_guard<std::mutex> lock(exprCodeMutex);
+  auto inserted = exprCodeCache.emplace(key, code);
+  if (!inserted.second)
+    return inserted.first->second; // compiled by another thread meanwhile
+  exprCodeCacheSize += code->size;
+
+  if (exprCodeCacheSize > EXPR_CODE_CACHE_MAX) {
+    for (auto it = exprCodeCache.begin(); it != exprCodeCache.end(); ) {
+      if (it->second.use_count() == 1) { // only the cache holds it
+        exprCodeCacheSize -= it->second->size;
+        it = exprCodeCache.erase(it);
+      }
+      else
+        ++it;
+    }
+  }
+  return code;
+}
+#endif
+
+// Check CPU instuction level constraints:
+// opLoadRel8/16/32: minimum SSSE3 (pshufb, alignr) for SIMD, and no AVX2 support
+// Trig.func: C only
+static void checkJitConstraints(const std::vector<ExprOp> &ops, int cpuFlags, bool &planeOptAvx2, bool &planeOptSSE2) {
+  for (size_t j = 0; j < ops.size(); j++) {
+    const uint32_t op = ops[j].op;
+    if (op == opLoadRelSrc8 || op == opLoadRelSrc16 || op == opLoadRelSrcF32)
+    {
+      planeOptAvx2 = false; // avx2 path not implemented
+      if (!(cpuFlags & CPUF_SSSE3)) // required minimum (pshufb, alignr)
+        planeOptSSE2 = false;
+    }
+    // trig.functions C only
+    if (op == opSin || op == opCos || op == opTan || op == opAsin || op == opAcos || op == opAtan) {
+      planeOptAvx2 = false;
+      planeOptSSE2 = false;
+      break;
+    }
+  }
+}
+
+// Same plane sizes for every plane
+static bool samePlaneLayout(const VideoInfo &a, const VideoInfo &b) {
+  if (a.width != b.width || a.height != b.height || a.NumComponents() != b.NumComponents() || a.IsY() != b.IsY())
+    return false;
+  if (a.IsY())
+    return true;
+  const int plane_a = (a.IsYUV() || a.IsYUVA()) ? PLANAR_U : PLANAR_B;
+  const int plane_b = (b.IsYUV() || b.IsYUVA()) ? PLANAR_U : PLANAR_B;
+  return a.GetPlaneWidthSubsampling(plane_a) == b.GetPlaneWidthSubsampling(plane_b) &&
+    a.GetPlaneHeightSubsampling(plane_a) == b.GetPlaneHeightSubsampling(plane_b);
+}
+
+// Looks through the cache in front of an Expr filter. Anything else wrapped
+// around it (profiling for instance) is not looked through and prevents fusion.
+static Exprfilter *asExprfilter(const PClip &clip) {
+  IClip *raw = (IClip *)(void *)clip;
+  Cache *cache = dynamic_cast<Cache *>(raw);
+  if (cache != NULL)
+    raw = (IClip *)(void *)cache->GetChild();
+  return dynamic_cast<Exprfilter *>(raw);
+}
+
+// Whether a plane with this program runs JIT compiled code, see the
+// constructor. The C and the JIT path differ in details like the rounding
+// of stores or the precision of exp and log. Lookup tables are computed by
+// the same code as the plane they replace.
+bool Exprfilter::runsJit(std::vector<ExprOp> ops, const VideoInfo **vi_array, int cpuFlags) const {
+  eliminateCommonSubexpressions(ops);
+  bool planeOptAvx2 = optAvx2, planeOptSSE2 = optSSE2;
+  checkJitConstraints(ops, cpuFlags, planeOptAvx2, planeOptSSE2);
+  return optSSE2 && planeOptSSE2;
+}
+
+// Input k is an Expr filter, here called the inner one. Its program is
+// inserted wherever this filter loads its pixels, its inputs become inputs
+// of this filter, so its frames are no longer needed.
+// An opQuantize after the inserted program does what the store to and the
+// load from the intermediate frame did. Other than that the operations stay
+// the same, so the result is only the same if the inner program would have
+// run on the same (C or JIT) path as the combined one. If anything stands in
+// the way, the input is left alone and false is returned.
+bool Exprfilter::fuseInput(int k, Exprfilter *inner, const VideoInfo **vi_array, IScriptEnvironment *env) {
+  const ExprData &id = inner->d;
+  if (!samePlaneLayout(id.vi, d.vi))
+    return false;
+  for (int j = 0; j < id.numInputs; j++)
+    if (id.clipsUsed[j] && !samePlaneLayout(id.node[j]->GetVideoInfo(), d.vi))
+      return false;
+
+  std::vector<PClip> newChildren = children;
+  const VideoInfo *new_vi_array[MAX_EXPR_INPUTS] = {};
+  std::copy(vi_array, vi_array + d.numInputs, new_vi_array);
+  int clipIndex[MAX_EXPR_INPUTS]; // inner input -> input of this filter
+  std::fill_n(clipIndex, MAX_EXPR_INPUTS, -1);
+
+  std::vector<ExprOp> fused[4];
+  const int cpuFlags = env->GetCPUFlags();
+
+  for (int p = 0; p < d.vi.NumComponents(); p++) {
+    const std::vector<ExprOp> &ops = d.ops[p];
+    if (d.plane[p] == poCopy && d.planeCopySourceClip[p] == k)
+      return false;
+
+    bool loadsInner = false;
+    bool varUsed[MAX_USER_VARIABLES] = {};
+    for (size_t i = 0; i < ops.size(); i++) {
+      const uint32_t op = ops[i].op;
+      if ((op == opLoadRelSrc8 || op == opLoadRelSrc16 || op == opLoadRelSrcF32) && ops[i].e.ival == k)
+        return false; // neighbouring pixels would have to be computed as well
+      if ((op == opLoadSrc8 || op == opLoadSrc16 || op == opLoadSrcF32 || op == opLoadSrcF16) && ops[i].e.ival == k)
+        loadsInner = true;
+      if (op == opLoadVar || op == opStoreVar || op == opStoreAndPopVar)
+        varUsed[ops[i].e.ival] = true;
+    }
+    if (!loadsInner) {
+      fused[p] = ops;
+      continue;
+    }
+
+    // what loading a pixel of the inner filter's output gives
+    std::vector<ExprOp> value;
+    bool computed = false;
+    const int bits = id.vi.BitsPerComponent();
+    switch (id.plane[p]) {
+    case poCopy: {
+      const int c = id.planeCopySourceClip[p];
+      value.push_back(ExprOp(getLoadOp(&id.node[c]->GetVideoInfo(), false), c));
+      break;
+    }
+    case poFill: {
+      float fill = id.planeFillValue[p];
+      if (bits != 32)
+        fill = (float)(int)(std::max(0.0f, std::min(fill, (float)((1 << bits) - 1))) + 0.5f); // as in GetFrame
+      value.push_back(ExprOp(opLoadConst, fill));
+      break;
+    }
+    case poProcess:
+    case poLut: {
+      const std::vector<ExprOp> &iops = id.ops[p];
+      const uint32_t store = iops.back().op;
+      if (store == opStoreF16)
+        return false;
+      value.assign(iops.begin(), iops.end() - 1);
+      if (store != opStoreF32)
+        value.push_back(ExprOp(opQuantize, bits));
+      computed = true;
+      break;
+    }
+    default:
+      return false;
+    }
+
+    // inner clip indices and variables are renumbered for this filter
+    int varIndex[MAX_USER_VARIABLES];
+    std::fill_n(varIndex, MAX_USER_VARIABLES, -1);
+    int nextVar = 0;
+    for (size_t i = 0; i < value.size(); i++) {
+      ExprOp &op = value[i];
+      switch (op.op) {
+      case opLoadSrc8: case opLoadSrc16: case opLoadSrcF32: case opLoadSrcF16:
+      case opLoadRelSrc8: case opLoadRelSrc16: case opLoadRelSrcF32: {
+        const int j = op.e.ival;
+        if (clipIndex[j] < 0) {
+          for (size_t c = 0; c < newChildren.size(); c++)
+            if ((void *)newChildren[c] == (void *)id.node[j])
+              clipIndex[j] = (int)c;
+        }
+        if (clipIndex[j] < 0) {
+          if (newChildren.size() >= MAX_EXPR_INPUTS)
+            return false;
+          clipIndex[j] = (int)newChildren.size();
+          new_vi_array[clipIndex[j]] = &id.node[j]->GetVideoInfo();
+          newChildren.push_back(id.node[j]);
+        }
+        op.e.ival = clipIndex[j];
+        break;
+      }
+      case opLoadInternalVar:
+        if (inner->vi.num_frames != vi.num_frames)
+          return false; // time is relative to the clip length
+        break;
+      case opLoadVar:
+        if (varIndex[op.e.ival] < 0)
+          return false; // previous pixel's value
+        op.e.ival = varIndex[op.e.ival];
+        break;
+      case opStoreVar:
+      case opStoreAndPopVar:
+        if (varIndex[op.e.ival] < 0) {
+          while (nextVar < MAX_USER_VARIABLES && varUsed[nextVar])
+            nextVar++;
+          if (nextVar == MAX_USER_VARIABLES)
+            return false;
+          varIndex[op.e.ival] = nextVar++;
+        }
+        op.e.ival = varIndex[op.e.ival];
+        break;
+      }
+    }
+
+    for (size_t i = 0; i < ops.size(); i++) {
+      const uint32_t op = ops[i].op;
+      if ((op == opLoadSrc8 || op == opLoadSrc16 || op == opLoadSrcF32 || op == opLoadSrcF16) && ops[i].e.ival == k)
+        fused[p].insert(fused[p].end(), value.begin(), value.end());
+      else
+        fused[p].push_back(ops[i]);
+    }
+
+    const bool jit = runsJit(fused[p], new_vi_array, cpuFlags);
+    if (jit != runsJit(ops, vi_array, cpuFlags))
+      return false;
+    if (computed && jit != (id.plane[p] == poProcess && inner->optSSE2 && id.planeOptSSE2[p]))
+      return false;
+  }
+
+  children = newChildren;
+  d.numInputs = (int)children.size();
+  for (int i = 0; i < d.numInputs; i++) {
+    d.node[i] = children[i];
+    vi_array[i] = new_vi_array[i];
+  }
+  for (int p = 0; p < d.vi.NumComponents(); p++)
+    d.ops[p] = fused[p];
+  return true;
+}
+
 Exprfilter::Exprfilter(const std::vector<PClip>& _child_array, const std::vector<std::string>& _expr_array, const char *_newformat, const bool _optAvx2, 
-  const bool _optSingleMode, const bool _optSSE2, IScriptEnvironment *env) :
-  children(_child_array), expressions(_expr_array), optAvx2(_optAvx2), optSingleMode(_optSingleMode), optSSE2(_optSSE2) {
+  const bool _optSingleMode, const bool _optSSE2, const int _lutMode, const bool _fuse, IScriptEnvironment *env) :
+  children(_child_array), expressions(_expr_array), optAvx2(_optAvx2), optSingleMode(_optSingleMode), optSSE2(_optSSE2), lutMode(_lutMode), fuse(_fuse) {
 
   vi = children[0]->GetVideoInfo();
   d.vi = vi;
@@ -4703,6 +5440,24 @@ Exprfilter::Exprfilter(const std::vector<PClip>& _child_array, const std::vector
 
       d.maxStackSize = std::max(parseExpression(expr[i], d.ops[i], vi_array, &d.vi, getStoreOp(&d.vi), d.numInputs, planewidth, planeheight, env), d.maxStackSize);
       foldConstants(d.ops[i]);
+    }
+
+    // compute inputs made by Expr right here, without their intermediate frames
+    for (int k = 0; fuse && k < d.numInputs; k++) {
+      Exprfilter *inner = asExprfilter(d.node[k]);
+      if (inner)
+        fuseInput(k, inner, vi_array, env);
+    }
+
+    for (int i = 0; i < d.vi.NumComponents(); i++) {
+      const size_t opsBefore = d.ops[i].size();
+      eliminateCommonSubexpressions(d.ops[i]);
+      d.maxStackSize = std::max(stackDepth(d.ops[i]), d.maxStackSize); // folding may have added dups
+      if (!d.ops[i].empty()) {
+        static_cast<InternalEnvironment*>(env)->LogMsg(LOGLEVEL_INFO, "Expr: plane %d, %d ops, %d after removing repeated subexpressions",
+          i + 1, (int)opsBefore, (int)d.ops[i].size());
+        printExpression(i, d.ops[i], env);
+      }
 
       // optimize constant store, change operation to "fill"
       if (d.plane[i] == poProcess && d.ops[i].size() == 2 && d.ops[i][0].op == opLoadConst) {
@@ -4741,71 +5496,61 @@ Exprfilter::Exprfilter(const std::vector<PClip>& _child_array, const std::vector
         }
       }
 
-      // Check CPU instuction level constraints:
-      // opLoadRel8/16/32: minimum SSSE3 (pshufb, alignr) for SIMD, and no AVX2 support
-      // Trig.func: C only
       d.planeOptAvx2[i] = optAvx2;
       d.planeOptSSE2[i] = optSSE2;
-      for (size_t j = 0; j < d.ops[i].size(); j++) {
-        const uint32_t op = d.ops[i][j].op;
-        if (op == opLoadRelSrc8 || op == opLoadRelSrc16 || op == opLoadRelSrcF32)
-        {
-          d.planeOptAvx2[i] = false; // avx2 path not implemented
-          if(!(env->GetCPUFlags() & CPUF_SSSE3)) // required minimum (pshufb, alignr)
-            d.planeOptSSE2[i] = false;
-        }
-        // trig.functions C only
-        if (op == opSin || op == opCos || op == opTan || op == opAsin || op == opAcos || op == opAtan) {
-          d.planeOptAvx2[i] = false;
-          d.planeOptSSE2[i] = false;
-          break;
-        }
+      checkJitConstraints(d.ops[i], env->GetCPUFlags(), d.planeOptAvx2[i], d.planeOptSSE2[i]);
+
+      // optimize: pure function of one or two integer inputs, evaluate it once for all values
+      // the table is filled below, by the code the plane would run otherwise
+      if (d.plane[i] == poProcess && lutMode != lutOff) {
+        if (findLutInputs(d.ops[i], vi_array, d.lutClip[i], &d.lutDims[i]))
+          d.plane[i] = poLut;
+        else if (lutMode == lutForce)
+          env->ThrowError("Expr: lut=2, but the expression of plane %d is not a function of one 8-12 bit or two 8 bit input pixels", i + 1);
       }
-
     }
 
 #ifdef VS_TARGET_CPU_X86
     // optAvx2 can only disable avx2 when available
 
     for (int i = 0; i < d.vi.NumComponents(); i++) {
-      if (d.plane[i] == poProcess) {
+      if (d.plane[i] == poProcess || d.plane[i] == poLut) {
 
         const int plane_enum = plane_enums[i];
         int planewidth = d.vi.width >> d.vi.GetPlaneWidthSubsampling(plane_enum);
         int planeheight = d.vi.height >> d.vi.GetPlaneHeightSubsampling(plane_enum);
+        if (d.plane[i] == poLut)
+          lutRampSize(d, i, vi_array, &planewidth, &planeheight);
 
         if (optAvx2 && d.planeOptAvx2[i]) {
 
           // avx2
-          ExprEvalAvx2 ExprObj(d.ops[i], d.numInputs, env->GetCPUFlags(), planewidth, planeheight, optSingleMode);
-          if (ExprObj.GetCode(true) && ExprObj.GetCodeSize()) { // PF modded jitasm. true: epilog with vmovaps, and vzeroupper
-#ifdef VS_TARGET_OS_WINDOWS
-            d.proc[i] = (ExprData::ProcessLineProc)VirtualAlloc(nullptr, ExprObj.GetCodeSize(), MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-#else
-            d.proc[i] = (ExprData::ProcessLineProc)mmap(nullptr, ExprObj.GetCodeSize(), PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANON | MAP_PRIVATE, 0, 0);
-#endif
-            memcpy((void *)d.proc[i], ExprObj.GetCode(), ExprObj.GetCodeSize());
-          }
+          d.code[i] = getExprCode(d.ops[i], d.numInputs, env->GetCPUFlags(), planewidth, planeheight, optSingleMode, true);
         }
         else if (optSSE2 && d.planeOptSSE2[i]){
           // sse2, sse4
-          ExprEval ExprObj(d.ops[i], d.numInputs, env->GetCPUFlags(), planewidth, planeheight, optSingleMode);
-          if (ExprObj.GetCode() && ExprObj.GetCodeSize()) {
-#ifdef VS_TARGET_OS_WINDOWS
-            d.proc[i] = (ExprData::ProcessLineProc)VirtualAlloc(nullptr, ExprObj.GetCodeSize(), MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-#else
-            d.proc[i] = (ExprData::ProcessLineProc)mmap(nullptr, ExprObj.GetCodeSize(), PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANON | MAP_PRIVATE, 0, 0);
-#endif
-            memcpy((void *)d.proc[i], ExprObj.GetCode(), ExprObj.GetCodeSize());
-          }
+          d.code[i] = getExprCode(d.ops[i], d.numInputs, env->GetCPUFlags(), planewidth, planeheight, optSingleMode, false);
         }
+        if (d.code[i])
+          d.proc[i] = (ExprData::ProcessLineProc)d.code[i]->code;
       }
     }
-#ifdef VS_TARGET_OS_WINDOWS
-    if (optSSE2)
-      FlushInstructionCache(GetCurrentProcess(), nullptr, 0);
 #endif
+
+    for (int i = 0; i < d.vi.NumComponents(); i++) {
+      if (d.plane[i] != poLut)
+        continue;
+      int pixels_per_iter = 0;
+#ifdef VS_TARGET_CPU_X86
+      if (optSSE2 && d.planeOptSSE2[i] && d.proc[i])
+        pixels_per_iter = (optAvx2 && d.planeOptAvx2[i]) ? (optSingleMode ? 8 : 16) : (optSingleMode ? 4 : 8);
 #endif
+      buildLut(d, i, vi_array, pixels_per_iter);
+#ifdef VS_TARGET_CPU_X86
+      d.proc[i] = nullptr;
+      d.code[i] = nullptr;
+#endif
+    }
 
   }
   catch (std::runtime_error &e) {
@@ -67,7 +67,8 @@ typedef enum {
   opAnd, opOr, opXor, opNeg,
   opExp, opLog, opPow,
   opSin, opCos, opTan, opAsin, opAcos, opAtan,
-  opStoreVar, opLoadVar, opStoreAndPopVar
+  opStoreVar, opLoadVar, opStoreAndPopVar,
+  opQuantize // value after storing to and loading from an e.ival bit integer clip, for fused Expr inputs
 } SOperation;
 
 typedef union {
@@ -97,9 +98,25 @@ struct ExprOp {
 };
 
 enum PlaneOp {
-  poProcess, poCopy, poUndefined, poFill
+  poProcess, poCopy, poUndefined, poFill, poLut
 };
 
+// Expr lut parameter
+enum ExprLutMode {
+  lutOff, lutAuto, lutForce
+};
+
+#ifdef VS_TARGET_CPU_X86
+// Executable copy of a JIT compiled routine. Instances compiling the same
+// program share one, see getExprCode.
+struct ExprCode {
+  void *code;
+  size_t size;
+  ExprCode(const void *src, size_t _size);
+  ~ExprCode();
+};
+#endif
+
 struct ExprData {
 #ifdef __VAPOURSYNTH__
   VSNodeRef *node[MAX_EXPR_INPUTS];
@@ -115,25 +132,21 @@ struct ExprData {
   int planeCopySourceClip[4]; // optimize: copy plane from which clip
   bool planeOptAvx2[4]; // instruction set constraints
   bool planeOptSSE2[4]; 
+  // poLut: result for every input value, in the output pixel type.
+  // 1D: indexed by clip lutClip[0], 2D (8 bit inputs): by lutClip[0] + 256 * lutClip[1]
+  std::vector<uint8_t> lut[4];
+  int lutClip[4][2];
+  int lutDims[4];
   size_t maxStackSize;
   int numInputs;
 #ifdef VS_TARGET_CPU_X86
   typedef void(*ProcessLineProc)(void *rwptrs, intptr_t ptroff[RWPTR_SIZE], intptr_t niter, uint32_t spatialY);
   ProcessLineProc proc[4]; // 4th: alpha
+  std::shared_ptr<ExprCode> code[4]; // keeps proc alive
   ExprData() : node(), vi(), proc() {}
 #else
   ExprData() : node(), vi() {}
 #endif
-  ~ExprData() {
-#ifdef VS_TARGET_CPU_X86
-    for (int i = 0; i < 4; i++) // 4th: alpha
-#ifdef VS_TARGET_OS_WINDOWS
-      VirtualFree((LPVOID)proc[i], 0, MEM_RELEASE);
-#else
-      munmap((void *)proc[i], 0);
-#endif
-#endif
-  }
 };
 
 class Exprfilter : public IClip
@@ -149,10 +162,15 @@ private:
   const bool optAvx2; // disable avx2 path
   const bool optSingleMode; // generate asm code using only one XMM/YMM register set instead of two
   const bool optSSE2; // disable simd path
+  const int lutMode; // ExprLutMode
+  const bool fuse; // compute inputs made by Expr in place, for inputs nothing else uses
+
+  bool fuseInput(int k, Exprfilter *inner, const VideoInfo **vi_array, IScriptEnvironment *env);
+  bool runsJit(std::vector<ExprOp> ops, const VideoInfo **vi_array, int cpuFlags) const;
 
 public:
   Exprfilter(const std::vector<PClip>& _child_array, const std::vector<std::string>& _expr_array, const char *_newformat, const bool _optAvx2, 
-    const bool _optSingleMode2, const bool _optSSE2, IScriptEnvironment *env);
+    const bool _optSingleMode2, const bool _optSSE2, const int _lutMode, const bool _fuse, IScriptEnvironment *env);
   PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment *env);
   ~Exprfilter();
   static AVSValue __cdecl Create(AVSValue args, void*, IScriptEnvironment* env);
@@ -323,6 +323,8 @@ public:
   }
 
   inline PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env) {
+    if (n + 1 < vi.num_frames)
+      DeclareFrameDependency(child_array[congmod(n + 1, num_children)], (n + 1) / num_children, env);
 	return child_array[congmod(n, num_children)]->GetFrame(n / num_children, env);
   }
 
@@ -358,6 +360,8 @@ public:
   SelectEvery(PClip _child, int _every, int _from, IScriptEnvironment* env);
 
   inline PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env) {
+    if (n + 1 < vi.num_frames)
+      DeclareFrameDependency(child, (n + 1)*every + from, env);
     return child->GetFrame(n*every+from, env);
   }
 
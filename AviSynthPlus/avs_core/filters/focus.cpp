@@ -2255,6 +2255,10 @@ PVideoFrame TemporalSoften::GetFrame(int n, IScriptEnvironment* env)
     planeDisabled[p] = false;
   }
 
+  // Sequential access: the next frame only adds one new frame to the window
+  if (n + 1 < vi.num_frames)
+    DeclareFrameDependency(child, min(n + 1 + radius, vi.num_frames - 1), env);
+
   std::vector<PVideoFrame> frames;
   frames.reserve(kernel);
 
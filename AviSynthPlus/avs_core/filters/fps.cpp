@@ -518,6 +518,9 @@ PVideoFrame __stdcall ChangeFPS::GetFrame(int n, IScriptEnvironment* env)
 {
   int getframe = int((n * a) / b); // Use Floor! - Which frame to get next?
 
+  if (n + 1 < vi.num_frames)
+    DeclareFrameDependency(child, int(((n + 1) * a) / b), env);
+
   if (linear) {
     if ((lastframe < (getframe-1)) && (getframe - lastframe < 10)) {  // Do not decode more than 10 frames
       while (lastframe < (getframe-1)) {
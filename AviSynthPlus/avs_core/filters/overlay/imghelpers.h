@@ -146,6 +146,28 @@ public:
     ResetFake();
   }
 
+  // Rows [y, y+new_h) of the current view of 'parent', for blending in bands.
+  // Shares the planes of 'parent', which must outlive it.
+  ImageOverlayInternal(ImageOverlayInternal& parent, int y, int new_h) :
+    Env(parent.Env),
+    frame(parent.frame),
+    _w(parent.w()), _h(min(new_h, parent.h() - y)), _bits_per_pixel(parent._bits_per_pixel), grey(parent.grey), maskChroma(nullptr) {
+
+    planeCount = parent.planeCount;
+    planes = (parent.planes == parent.planes_y) ? planes_y : planes_r;
+    for (int p = 0; p < 4; p++) {
+      xSubSamplingShifts[p] = parent.xSubSamplingShifts[p];
+      ySubSamplingShifts[p] = parent.ySubSamplingShifts[p];
+      pitches[p] = parent.pitches[p];
+      origPlanes[p] = pitches[p] > 0 ? (parent.GetPtrByIndex(p) + (y >> ySubSamplingShifts[p]) * pitches[p]) : nullptr;
+    }
+    pitch = parent.pitch;
+    pitchUV = parent.pitchUV;
+    pitchA = parent.pitchA;
+
+    ResetFake();
+  }
+
   __inline int w() { return (return_original) ? _w : fake_w; }
   __inline int h() { return (return_original) ? _h : fake_h; }
 
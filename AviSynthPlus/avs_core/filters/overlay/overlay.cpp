@@ -38,6 +38,7 @@
 #include <stdlib.h>
 #include "overlay.h"
 #include "../core/internal.h"
+#include "../../core/RowBands.h"
 
 /********************************************************************
 ***** Declare index of new filters for Avisynth's filter engine *****
@@ -602,11 +603,18 @@ PVideoFrame __stdcall Overlay::GetFrame(int n, IScriptEnvironment *env) {
     func->setColorSpaceInfo(viInternalWorkingFormat->IsRGB(), viInternalWorkingFormat->IsY());
     func->setEnv(env);
 
-    if (!mask) {
-      func->DoBlendImage(img, overlayImg);
-    } else {
-      func->DoBlendImageMask(img, overlayImg, maskImg);
-    }
+    // Blend in horizontal bands on several threads. Band borders fall on
+    // chroma rows, so subsampled planes are split at the same place.
+    RunRowBands(env, img->h(), 1 << img->ySubSamplingShifts[1], [&](int y_begin, int y_end) {
+      ImageOverlayInternal imgBand(*img, y_begin, y_end - y_begin);
+      ImageOverlayInternal overlayBand(*overlayImg, y_begin, y_end - y_begin);
+      if (!mask) {
+        func->DoBlendImage(&imgBand, &overlayBand);
+      } else {
+        ImageOverlayInternal maskBand(*maskImg, y_begin, y_end - y_begin);
+        func->DoBlendImageMask(&imgBand, &overlayBand, &maskBand);
+      }
+    });
 
     delete func;
 
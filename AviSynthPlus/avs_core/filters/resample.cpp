@@ -34,8 +34,10 @@
 
 #include "resample.h"
 #include "resample_avx2.h"
+#include "resample_avx512.h"
 #include <avs/config.h>
 #include "../core/internal.h"
+#include "../core/RowBands.h"
 
 #include "transform.h"
 #include "turn.h"
@@ -49,6 +51,7 @@
 #include <emmintrin.h>
 #include <smmintrin.h>
 #include <algorithm>
+#include <new>
 
 /***************************************
  ********* Templated SSE Loader ********
@@ -556,6 +559,135 @@ static void resize_h_c_planar(BYTE* dst, const BYTE* src, int dst_pitch, int src
   }
 }
 
+//-------- Packed RGB Horizontals
+
+// Interleaved RGB24/RGB32/RGB48/RGB64 are resampled as they are, without
+// turning the frame: every tap of the program is applied to all channels of
+// the source pixel. 'width' is in pixels.
+template<typename pixel_t, int channels>
+static void resize_h_c_packedrgb(BYTE* dst, const BYTE* src, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int height, int bits_per_pixel) {
+  const int filter_size = program->filter_size;
+  const int fpscale = sizeof(pixel_t) == 1 ? FPScale : FPScale16;
+
+  typedef typename std::conditional < sizeof(pixel_t) == 1, int, __int64>::type sum_t;
+  const sum_t limit = (sum_t(1) << bits_per_pixel) - 1;
+
+  for (int y = 0; y < height; y++) {
+    const pixel_t* srcp = reinterpret_cast<const pixel_t*>(src);
+    pixel_t* dstp = reinterpret_cast<pixel_t*>(dst);
+    const short* current_coeff = program->pixel_coefficient;
+
+    for (int x = 0; x < width; x++) {
+      const pixel_t* p = srcp + program->pixel_offset[x] * channels;
+      sum_t result[channels] = {};
+      for (int i = 0; i < filter_size; i++) {
+        for (int c = 0; c < channels; c++)
+          result[c] += p[i * channels + c] * current_coeff[i];
+      }
+      for (int c = 0; c < channels; c++)
+        dstp[x * channels + c] = (pixel_t)clamp((result[c] + fpscale / 2) / fpscale, sum_t(0), limit);
+      current_coeff += filter_size;
+    }
+
+    dst += dst_pitch;
+    src += src_pitch;
+  }
+}
+
+// One pixel, its channels as 16 bit words in the low half.
+// 16 bit samples are shifted to the signed range for madd.
+template<typename pixel_t, int channels>
+__forceinline static __m128i load_packedrgb_pixel(const pixel_t* p) {
+  if (sizeof(pixel_t) == 1) {
+    const BYTE* p8 = reinterpret_cast<const BYTE*>(p);
+    const int data = channels == 4 ? *reinterpret_cast<const int*>(p8) : p8[0] | (p8[1] << 8) | (p8[2] << 16);
+    return _mm_unpacklo_epi8(_mm_cvtsi32_si128(data), _mm_setzero_si128());
+  }
+  else {
+    const uint16_t* p16 = reinterpret_cast<const uint16_t*>(p);
+    __m128i data;
+    if (channels == 4)
+      data = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p16));
+    else
+      data = _mm_insert_epi16(_mm_cvtsi32_si128(*reinterpret_cast<const int*>(p16)), p16[2], 2);
+    return _mm_add_epi16(data, _mm_set1_epi16(-32768)); // unsigned -> signed
+  }
+}
+
+template<typename pixel_t, int channels>
+static void resize_h_sse2_packedrgb(BYTE* dst, const BYTE* src, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int height, int bits_per_pixel) {
+  const int filter_size = program->filter_size;
+  const int scale_bits = sizeof(pixel_t) == 1 ? 14 : FPScale16bits; // FPScale or FPScale16
+  const __m128i rounder = _mm_set1_epi32(1 << (scale_bits - 1));
+  const __m128i zero = _mm_setzero_si128();
+
+  for (int y = 0; y < height; y++) {
+    const pixel_t* srcp = reinterpret_cast<const pixel_t*>(src);
+    pixel_t* dstp = reinterpret_cast<pixel_t*>(dst);
+    const short* current_coeff = program->pixel_coefficient;
+
+    for (int x = 0; x < width; x++) {
+      const pixel_t* p = srcp + program->pixel_offset[x] * channels;
+      __m128i result = rounder;
+
+      // two taps at once: their words are interleaved per channel, madd adds the pair
+      int i = 0;
+      for (; i < filter_size - 1; i += 2) {
+        const __m128i data = _mm_unpacklo_epi16(load_packedrgb_pixel<pixel_t, channels>(p + i * channels), load_packedrgb_pixel<pixel_t, channels>(p + (i + 1) * channels));
+        const __m128i coeff = _mm_unpacklo_epi16(_mm_set1_epi16(current_coeff[i]), _mm_set1_epi16(current_coeff[i + 1]));
+        result = _mm_add_epi32(result, _mm_madd_epi16(data, coeff));
+      }
+      if (i < filter_size) {
+        const __m128i data = _mm_unpacklo_epi16(load_packedrgb_pixel<pixel_t, channels>(p + i * channels), zero);
+        const __m128i coeff = _mm_set1_epi16(current_coeff[i]);
+        result = _mm_add_epi32(result, _mm_madd_epi16(data, coeff));
+      }
+
+      result = _mm_srai_epi32(result, scale_bits);
+      result = _mm_packs_epi32(result, result);
+
+      if (sizeof(pixel_t) == 1) {
+        const int pixel = _mm_cvtsi128_si32(_mm_packus_epi16(result, result));
+        BYTE* d = reinterpret_cast<BYTE*>(dstp + x * channels);
+        if (channels == 4) {
+          *reinterpret_cast<int*>(d) = pixel;
+        } else {
+          d[0] = (BYTE)pixel;
+          d[1] = (BYTE)(pixel >> 8);
+          d[2] = (BYTE)(pixel >> 16);
+        }
+      } else {
+        // back from signed range; the signed saturation above is the clamp to 0..65535
+        result = _mm_add_epi16(result, _mm_set1_epi16(-32768));
+        uint16_t* d = reinterpret_cast<uint16_t*>(dstp + x * channels);
+        if (channels == 4) {
+          _mm_storel_epi64(reinterpret_cast<__m128i*>(d), result);
+        } else {
+          d[0] = (uint16_t)_mm_extract_epi16(result, 0);
+          d[1] = (uint16_t)_mm_extract_epi16(result, 1);
+          d[2] = (uint16_t)_mm_extract_epi16(result, 2);
+        }
+      }
+      current_coeff += filter_size;
+    }
+
+    dst += dst_pitch;
+    src += src_pitch;
+  }
+}
+
+static ResamplerH GetResamplerPackedRGB(int CPU, const VideoInfo& vi)
+{
+  const bool sse2 = (CPU & CPUF_SSE2) != 0;
+  if (vi.IsRGB24())
+    return sse2 ? resize_h_sse2_packedrgb<uint8_t, 3> : resize_h_c_packedrgb<uint8_t, 3>;
+  if (vi.IsRGB32())
+    return sse2 ? resize_h_sse2_packedrgb<uint8_t, 4> : resize_h_c_packedrgb<uint8_t, 4>;
+  if (vi.IsRGB48())
+    return sse2 ? resize_h_sse2_packedrgb<uint16_t, 3> : resize_h_c_packedrgb<uint16_t, 3>;
+  return sse2 ? resize_h_sse2_packedrgb<uint16_t, 4> : resize_h_c_packedrgb<uint16_t, 4>; // RGB64
+}
+
 //-------- 128 bit float Horizontals
 
 __forceinline static void process_one_pixel_h_float(const float *src, int begin, int i, float *&current_coeff, __m128 &result) {
@@ -1453,14 +1585,19 @@ FilteredResizeH::FilteredResizeH( PClip _child, double subrange_left, double sub
       env2);
   }
 
+  // Packed RGB has direct kernels for every CPU, it is never turned
+  const bool packed_rgb = vi.IsRGB() && !isRGBPfamily;
+
   // r2592+: no target_width mod4 check, (old avs needed for unaligned frames?)
-  fast_resize = (env->GetCPUFlags() & CPUF_SSSE3) == CPUF_SSSE3 && vi.IsPlanar();
+  fast_resize = packed_rgb || ((env->GetCPUFlags() & CPUF_SSSE3) == CPUF_SSSE3 && vi.IsPlanar());
 
   if (false && resampling_program_luma->filter_size == 1 && vi.IsPlanar()) {
     // dead code?
     fast_resize = true;
     resampler_h_luma = resize_h_pointresize;
     resampler_h_chroma = resize_h_pointresize;
+  } else if (packed_rgb) {
+    resampler_h_luma = GetResamplerPackedRGB(env->GetCPUFlags(), vi);
   } else if (!fast_resize) {
 
     // nonfast-resize: using V resizer for horizontal resizing between a turnleft/right
@@ -1482,56 +1619,32 @@ FilteredResizeH::FilteredResizeH( PClip _child, double subrange_left, double sub
     // Initialize Turn function
     // see turn.cpp
     bool has_sse2 = (env->GetCPUFlags() & CPUF_SSE2) != 0;
-    if (vi.IsRGB24()) {
-      turn_left = turn_left_rgb24;
-      turn_right = turn_right_rgb24;
-    } else if (vi.IsRGB32()) {
+    switch (vi.ComponentSize()) {// AVS16
+    case 1: // 8 bit
       if (has_sse2) {
-        turn_left = turn_left_rgb32_sse2;
-        turn_right = turn_right_rgb32_sse2;
+        turn_left = turn_left_plane_8_sse2;
+        turn_right = turn_right_plane_8_sse2;
       } else {
-        turn_left = turn_left_rgb32_c;
-        turn_right = turn_right_rgb32_c;
+        turn_left = turn_left_plane_8_c;
+        turn_right = turn_right_plane_8_c;
       }
-    } else if (vi.IsRGB48()) {
-        turn_left = turn_left_rgb48_c;
-        turn_right = turn_right_rgb48_c;
-    } else if (vi.IsRGB64()) {
+      break;
+    case 2: // 16 bit
       if (has_sse2) {
-        turn_left = turn_left_rgb64_sse2;
-        turn_right = turn_right_rgb64_sse2;
+        turn_left = turn_left_plane_16_sse2;
+        turn_right = turn_right_plane_16_sse2;
       } else {
-        turn_left = turn_left_rgb64_c;
-        turn_right = turn_right_rgb64_c;
+        turn_left = turn_left_plane_16_c;
+        turn_right = turn_right_plane_16_c;
       }
-    } else {
-      switch (vi.ComponentSize()) {// AVS16
-      case 1: // 8 bit
-        if (has_sse2) {
-          turn_left = turn_left_plane_8_sse2;
-          turn_right = turn_right_plane_8_sse2;
-        } else {
-          turn_left = turn_left_plane_8_c;
-          turn_right = turn_right_plane_8_c;
-        }
-        break;
-      case 2: // 16 bit
-        if (has_sse2) {
-          turn_left = turn_left_plane_16_sse2;
-          turn_right = turn_right_plane_16_sse2;
-        } else {
-          turn_left = turn_left_plane_16_c;
-          turn_right = turn_right_plane_16_c;
-        }
-        break;
-      default: // 32 bit
-        if (has_sse2) {
-          turn_left = turn_left_plane_32_sse2;
-          turn_right = turn_right_plane_32_sse2;
-        } else {
-          turn_left = turn_left_plane_32_c;
-          turn_right = turn_right_plane_32_c;
-        }
+      break;
+    default: // 32 bit
+      if (has_sse2) {
+        turn_left = turn_left_plane_32_sse2;
+        turn_right = turn_right_plane_32_sse2;
+      } else {
+        turn_left = turn_left_plane_32_c;
+        turn_right = turn_right_plane_32_c;
       }
     }
   } else { // Planar + SSSE3 = use new horizontal resizer routines
@@ -1566,95 +1679,105 @@ PVideoFrame __stdcall FilteredResizeH::GetFrame(int n, IScriptEnvironment* env)
       env->ThrowError("Could not reserve memory in a resampler.");
     }
 
-    if (!vi.IsRGB() || isRGBPfamily) {
-      // Y/G Plane
-      turn_right(src->GetReadPtr(), temp_1, src_width * pixelsize, src_height, src->GetPitch(), temp_1_pitch); // * pixelsize: turn_right needs GetPlaneWidth full size
-      resampler_luma(temp_2, temp_1, temp_2_pitch, temp_1_pitch, resampling_program_luma, src_height, dst_width, bits_per_pixel, src_pitch_table_luma, filter_storage_luma);
-      turn_left(temp_2, dst->GetWritePtr(), dst_height * pixelsize, dst_width, temp_2_pitch, dst->GetPitch());
-
-      if (isRGBPfamily)
-      {
-        turn_right(src->GetReadPtr(PLANAR_B), temp_1, src_width * pixelsize, src_height, src->GetPitch(PLANAR_B), temp_1_pitch); // * pixelsize: turn_right needs GetPlaneWidth full size
-        resampler_luma(temp_2, temp_1, temp_2_pitch, temp_1_pitch, resampling_program_luma, src_height, dst_width, bits_per_pixel, src_pitch_table_luma, filter_storage_luma);
-        turn_left(temp_2, dst->GetWritePtr(PLANAR_B), dst_height * pixelsize, dst_width, temp_2_pitch, dst->GetPitch(PLANAR_B));
+    // Y/G Plane
+    turn_right(src->GetReadPtr(), temp_1, src_width * pixelsize, src_height, src->GetPitch(), temp_1_pitch); // * pixelsize: turn_right needs GetPlaneWidth full size
+    resampler_luma(temp_2, temp_1, temp_2_pitch, temp_1_pitch, resampling_program_luma, src_height, dst_width, bits_per_pixel, src_pitch_table_luma, filter_storage_luma);
+    turn_left(temp_2, dst->GetWritePtr(), dst_height * pixelsize, dst_width, temp_2_pitch, dst->GetPitch());
 
-        turn_right(src->GetReadPtr(PLANAR_R), temp_1, src_width * pixelsize, src_height, src->GetPitch(PLANAR_R), temp_1_pitch); // * pixelsize: turn_right needs GetPlaneWidth full size
-        resampler_luma(temp_2, temp_1, temp_2_pitch, temp_1_pitch, resampling_program_luma, src_height, dst_width, bits_per_pixel, src_pitch_table_luma, filter_storage_luma);
-        turn_left(temp_2, dst->GetWritePtr(PLANAR_R), dst_height * pixelsize, dst_width, temp_2_pitch, dst->GetPitch(PLANAR_R));
-      }
-      else if(!grey) {
-        const int shift = vi.GetPlaneWidthSubsampling(PLANAR_U);
-        const int shift_h = vi.GetPlaneHeightSubsampling(PLANAR_U);
-
-        const int src_chroma_width = src_width >> shift;
-        const int dst_chroma_width = dst_width >> shift;
-        const int src_chroma_height = src_height >> shift_h;
-        const int dst_chroma_height = dst_height >> shift_h;
-
-        // turn_xxx: width * pixelsize: needs GetPlaneWidth-like full size
-        // U Plane
-        turn_right(src->GetReadPtr(PLANAR_U), temp_1, src_chroma_width * pixelsize, src_chroma_height, src->GetPitch(PLANAR_U), temp_1_pitch);
-        resampler_luma(temp_2, temp_1, temp_2_pitch, temp_1_pitch, resampling_program_chroma, src_chroma_height, dst_chroma_width, bits_per_pixel, src_pitch_table_luma, filter_storage_chroma);
-        turn_left(temp_2, dst->GetWritePtr(PLANAR_U), dst_chroma_height * pixelsize, dst_chroma_width, temp_2_pitch, dst->GetPitch(PLANAR_U));
-
-        // V Plane
-        turn_right(src->GetReadPtr(PLANAR_V), temp_1, src_chroma_width * pixelsize, src_chroma_height, src->GetPitch(PLANAR_V), temp_1_pitch);
-        resampler_luma(temp_2, temp_1, temp_2_pitch, temp_1_pitch, resampling_program_chroma, src_chroma_height, dst_chroma_width, bits_per_pixel, src_pitch_table_luma, filter_storage_chroma);
-        turn_left(temp_2, dst->GetWritePtr(PLANAR_V), dst_chroma_height * pixelsize, dst_chroma_width, temp_2_pitch, dst->GetPitch(PLANAR_V));
-      }
-      if (vi.IsYUVA() || vi.IsPlanarRGBA())
-      {
-        turn_right(src->GetReadPtr(PLANAR_A), temp_1, src_width * pixelsize, src_height, src->GetPitch(PLANAR_A), temp_1_pitch); // * pixelsize: turn_right needs GetPlaneWidth full size
-        resampler_luma(temp_2, temp_1, temp_2_pitch, temp_1_pitch, resampling_program_luma, src_height, dst_width, bits_per_pixel, src_pitch_table_luma, filter_storage_luma);
-        turn_left(temp_2, dst->GetWritePtr(PLANAR_A), dst_height * pixelsize, dst_width, temp_2_pitch, dst->GetPitch(PLANAR_A));
-      }
+    if (isRGBPfamily)
+    {
+      turn_right(src->GetReadPtr(PLANAR_B), temp_1, src_width * pixelsize, src_height, src->GetPitch(PLANAR_B), temp_1_pitch); // * pixelsize: turn_right needs GetPlaneWidth full size
+      resampler_luma(temp_2, temp_1, temp_2_pitch, temp_1_pitch, resampling_program_luma, src_height, dst_width, bits_per_pixel, src_pitch_table_luma, filter_storage_luma);
+      turn_left(temp_2, dst->GetWritePtr(PLANAR_B), dst_height * pixelsize, dst_width, temp_2_pitch, dst->GetPitch(PLANAR_B));
 
-    } else {
-      // packed RGB
-      // First left, then right. Reason: packed RGB bottom to top. Right+left shifts RGB24/RGB32 image to the opposite horizontal direction
-      turn_left(src->GetReadPtr(), temp_1, vi.BytesFromPixels(src_width), src_height, src->GetPitch(), temp_1_pitch);
-      resampler_luma(temp_2, temp_1, temp_2_pitch, temp_1_pitch, resampling_program_luma, vi.BytesFromPixels(src_height) / pixelsize, dst_width, bits_per_pixel, src_pitch_table_luma, filter_storage_luma);
-      turn_right(temp_2, dst->GetWritePtr(), vi.BytesFromPixels(dst_height), dst_width, temp_2_pitch, dst->GetPitch());
+      turn_right(src->GetReadPtr(PLANAR_R), temp_1, src_width * pixelsize, src_height, src->GetPitch(PLANAR_R), temp_1_pitch); // * pixelsize: turn_right needs GetPlaneWidth full size
+      resampler_luma(temp_2, temp_1, temp_2_pitch, temp_1_pitch, resampling_program_luma, src_height, dst_width, bits_per_pixel, src_pitch_table_luma, filter_storage_luma);
+      turn_left(temp_2, dst->GetWritePtr(PLANAR_R), dst_height * pixelsize, dst_width, temp_2_pitch, dst->GetPitch(PLANAR_R));
     }
+    else if(!grey) {
+      const int shift = vi.GetPlaneWidthSubsampling(PLANAR_U);
+      const int shift_h = vi.GetPlaneHeightSubsampling(PLANAR_U);
 
-    env2->Free(temp_1);
-    env2->Free(temp_2);
-  } else {
-
-    // Y Plane
-    resampler_h_luma(dst->GetWritePtr(), src->GetReadPtr(), dst->GetPitch(), src->GetPitch(), resampling_program_luma, dst_width, dst_height, bits_per_pixel);
-
-    if (isRGBPfamily) {
-      resampler_h_luma(dst->GetWritePtr(PLANAR_B), src->GetReadPtr(PLANAR_B), dst->GetPitch(PLANAR_B), src->GetPitch(PLANAR_B), resampling_program_luma, dst_width, dst_height, bits_per_pixel);
-      resampler_h_luma(dst->GetWritePtr(PLANAR_R), src->GetReadPtr(PLANAR_R), dst->GetPitch(PLANAR_R), src->GetPitch(PLANAR_R), resampling_program_luma, dst_width, dst_height, bits_per_pixel);
-    }
-    else if (!grey) {
-      const int dst_chroma_width = dst_width >> vi.GetPlaneWidthSubsampling(PLANAR_U);
-      const int dst_chroma_height = dst_height >> vi.GetPlaneHeightSubsampling(PLANAR_U);
+      const int src_chroma_width = src_width >> shift;
+      const int dst_chroma_width = dst_width >> shift;
+      const int src_chroma_height = src_height >> shift_h;
+      const int dst_chroma_height = dst_height >> shift_h;
 
+      // turn_xxx: width * pixelsize: needs GetPlaneWidth-like full size
       // U Plane
-      resampler_h_chroma(dst->GetWritePtr(PLANAR_U), src->GetReadPtr(PLANAR_U), dst->GetPitch(PLANAR_U), src->GetPitch(PLANAR_U), resampling_program_chroma, dst_chroma_width, dst_chroma_height, bits_per_pixel);
+      turn_right(src->GetReadPtr(PLANAR_U), temp_1, src_chroma_width * pixelsize, src_chroma_height, src->GetPitch(PLANAR_U), temp_1_pitch);
+      resampler_luma(temp_2, temp_1, temp_2_pitch, temp_1_pitch, resampling_program_chroma, src_chroma_height, dst_chroma_width, bits_per_pixel, src_pitch_table_luma, filter_storage_chroma);
+      turn_left(temp_2, dst->GetWritePtr(PLANAR_U), dst_chroma_height * pixelsize, dst_chroma_width, temp_2_pitch, dst->GetPitch(PLANAR_U));
 
       // V Plane
-      resampler_h_chroma(dst->GetWritePtr(PLANAR_V), src->GetReadPtr(PLANAR_V), dst->GetPitch(PLANAR_V), src->GetPitch(PLANAR_V), resampling_program_chroma, dst_chroma_width, dst_chroma_height, bits_per_pixel);
+      turn_right(src->GetReadPtr(PLANAR_V), temp_1, src_chroma_width * pixelsize, src_chroma_height, src->GetPitch(PLANAR_V), temp_1_pitch);
+      resampler_luma(temp_2, temp_1, temp_2_pitch, temp_1_pitch, resampling_program_chroma, src_chroma_height, dst_chroma_width, bits_per_pixel, src_pitch_table_luma, filter_storage_chroma);
+      turn_left(temp_2, dst->GetWritePtr(PLANAR_V), dst_chroma_height * pixelsize, dst_chroma_width, temp_2_pitch, dst->GetPitch(PLANAR_V));
     }
     if (vi.IsYUVA() || vi.IsPlanarRGBA())
     {
-      resampler_h_luma(dst->GetWritePtr(PLANAR_A), src->GetReadPtr(PLANAR_A), dst->GetPitch(PLANAR_A), src->GetPitch(PLANAR_A), resampling_program_luma, dst_width, dst_height, bits_per_pixel);
+      turn_right(src->GetReadPtr(PLANAR_A), temp_1, src_width * pixelsize, src_height, src->GetPitch(PLANAR_A), temp_1_pitch); // * pixelsize: turn_right needs GetPlaneWidth full size
+      resampler_luma(temp_2, temp_1, temp_2_pitch, temp_1_pitch, resampling_program_luma, src_height, dst_width, bits_per_pixel, src_pitch_table_luma, filter_storage_luma);
+      turn_left(temp_2, dst->GetWritePtr(PLANAR_A), dst_height * pixelsize, dst_width, temp_2_pitch, dst->GetPitch(PLANAR_A));
+    }
+
+    env2->Free(temp_1);
+    env2->Free(temp_2);
+  } else {
+    // Rows are independent here, so all planes are resized together in
+    // horizontal bands on several threads. Band borders fall on chroma rows.
+    // Packed RGB is a single plane with interleaved channels.
+    const int planes_y[4] = { PLANAR_Y, PLANAR_U, PLANAR_V, PLANAR_A };
+    const int planes_r[4] = { PLANAR_G, PLANAR_B, PLANAR_R, PLANAR_A };
+    const int *planes = isRGBPfamily ? planes_r : planes_y;
+    const int num_planes = (grey || !vi.IsPlanar()) ? 1 : vi.NumComponents();
+    const bool has_chroma = !grey && !isRGBPfamily && vi.IsPlanar();
+
+    BYTE* dstp[4];
+    const BYTE* srcp[4];
+    int dst_pitch[4];
+    int src_pitch[4];
+    for (int p = 0; p < num_planes; p++) {
+      dstp[p] = dst->GetWritePtr(planes[p]);
+      srcp[p] = src->GetReadPtr(planes[p]);
+      dst_pitch[p] = dst->GetPitch(planes[p]);
+      src_pitch[p] = src->GetPitch(planes[p]);
     }
 
+    const int shift_h = has_chroma ? vi.GetPlaneHeightSubsampling(PLANAR_U) : 0;
+    const int dst_chroma_width = has_chroma ? dst_width >> vi.GetPlaneWidthSubsampling(PLANAR_U) : 0;
+
+    RunRowBands(env, dst_height, 1 << shift_h, [&](int y_begin, int y_end) {
+      for (int p = 0; p < num_planes; p++) {
+        const bool chroma = has_chroma && (p == 1 || p == 2);
+        const int y0 = chroma ? (y_begin >> shift_h) : y_begin;
+        const int y1 = chroma ? (y_end >> shift_h) : y_end;
+        if (chroma)
+          resampler_h_chroma(dstp[p] + y0 * dst_pitch[p], srcp[p] + y0 * src_pitch[p], dst_pitch[p], src_pitch[p], resampling_program_chroma, dst_chroma_width, y1 - y0, bits_per_pixel);
+        else
+          resampler_h_luma(dstp[p] + y0 * dst_pitch[p], srcp[p] + y0 * src_pitch[p], dst_pitch[p], src_pitch[p], resampling_program_luma, dst_width, y1 - y0, bits_per_pixel);
+      }
+    });
   }
 
   return dst;
 }
 
+// The AVX-512 resamplers use masked byte and word operations on all vector lengths
+static const int CPUF_AVX512_RESAMPLER = CPUF_AVX512F | CPUF_AVX512BW | CPUF_AVX512VL;
+
 ResamplerH FilteredResizeH::GetResampler(int CPU, bool aligned, int pixelsize, int bits_per_pixel, ResamplingProgram* program, IScriptEnvironment2* env)
 {
+  const bool has_avx512 = (CPU & CPUF_AVX512_RESAMPLER) == CPUF_AVX512_RESAMPLER;
+
   if (pixelsize == 1)
   {
     if (CPU & CPUF_SSSE3) {
       // make the resampling coefficient array mod8 friendly for simd, padding non-used coeffs with zeros
       resize_h_prepare_coeff_8(program, env);
+      if (has_avx512) {
+        return resizer_h_avx512_generic_uint8_t;
+      }
       if (CPU & CPUF_AVX2) {
         return resizer_h_avx2_generic_uint8_t;
       }
@@ -1672,6 +1795,12 @@ ResamplerH FilteredResizeH::GetResampler(int CPU, bool aligned, int pixelsize, i
   else if (pixelsize == 2) {
     if (CPU & CPUF_SSSE3) {
       resize_h_prepare_coeff_8(program, env);
+      if (has_avx512) {
+        if (bits_per_pixel < 16)
+          return resizer_h_avx512_generic_uint16_t<true>;
+        else
+          return resizer_h_avx512_generic_uint16_t<false>;
+      }
       if (CPU & CPUF_AVX2) {
         if(bits_per_pixel < 16)
           return resizer_h_avx2_generic_uint16_t<true>;
@@ -1697,7 +1826,11 @@ ResamplerH FilteredResizeH::GetResampler(int CPU, bool aligned, int pixelsize, i
     
     if (CPU & CPUF_SSSE3) {
       resize_h_prepare_coeff_8(program, env);
-      
+
+      if (has_avx512) {
+        return resizer_h_avx512_generic_float; // any filter size
+      }
+
       const int filtersizealign8 = AlignNumber(program->filter_size, 8);
       const int filtersizemod8 = program->filter_size & 7;
 
@@ -1847,10 +1980,6 @@ PVideoFrame __stdcall FilteredResizeV::GetFrame(int n, IScriptEnvironment* env)
 {
   PVideoFrame src = child->GetFrame(n, env);
   PVideoFrame dst = env->NewVideoFrame(vi);
-  int src_pitch = src->GetPitch();
-  int dst_pitch = dst->GetPitch();
-  const BYTE* srcp = src->GetReadPtr();
-        BYTE* dstp = dst->GetWritePtr();
 
   auto env2 = static_cast<IScriptEnvironment2*>(env);
 
@@ -1881,45 +2010,47 @@ PVideoFrame __stdcall FilteredResizeV::GetFrame(int n, IScriptEnvironment* env)
 
   // Do resizing
   int work_width = vi.IsPlanar() ? vi.width : vi.BytesFromPixels(vi.width) / pixelsize; // packed RGB: or vi.width * vi.NumComponent()
-  // alignment to FRAME_ALIGN is guaranteed
-  resampler_luma_aligned(dstp, srcp, dst_pitch, src_pitch, resampling_program_luma, work_width, vi.height, bits_per_pixel, src_pitch_table_luma, filter_storage_luma_aligned);
-  if(isRGBPfamily)
-  {
-    src_pitch = src->GetPitch(PLANAR_B);
-    dst_pitch = dst->GetPitch(PLANAR_B);
-    srcp = src->GetReadPtr(PLANAR_B);
-    dstp = dst->GetWritePtr(PLANAR_B);
-    // alignment to FRAME_ALIGN is guaranteed
-    resampler_luma_aligned(dstp, srcp, dst_pitch, src_pitch, resampling_program_luma, work_width, vi.height, bits_per_pixel, src_pitch_table_luma, filter_storage_luma_aligned);
-    src_pitch = src->GetPitch(PLANAR_R);
-    dst_pitch = dst->GetPitch(PLANAR_R);
-    srcp = src->GetReadPtr(PLANAR_R);
-    dstp = dst->GetWritePtr(PLANAR_R);
-    // alignment to FRAME_ALIGN is guaranteed
-    resampler_luma_aligned(dstp, srcp, dst_pitch, src_pitch, resampling_program_luma, work_width, vi.height, bits_per_pixel, src_pitch_table_luma, filter_storage_luma_aligned);
-  }
-  else if (!grey && vi.IsPlanar()) {
-    int width = vi.width >> vi.GetPlaneWidthSubsampling(PLANAR_U);
-    int height = vi.height >> vi.GetPlaneHeightSubsampling(PLANAR_U);
-
-    // Plane U resizing
-    src_pitch = src->GetPitch(PLANAR_U);
-    dst_pitch = dst->GetPitch(PLANAR_U);
-    srcp = src->GetReadPtr(PLANAR_U);
-    dstp = dst->GetWritePtr(PLANAR_U);
-
-    // alignment to FRAME_ALIGN is guaranteed
-    resampler_chroma_aligned(dstp, srcp, dst_pitch, src_pitch, resampling_program_chroma, width, height, bits_per_pixel, src_pitch_table_chromaU, filter_storage_chroma_aligned);
-
-    // Plane V resizing
-    src_pitch = src->GetPitch(PLANAR_V);
-    dst_pitch = dst->GetPitch(PLANAR_V);
-    srcp = src->GetReadPtr(PLANAR_V);
-    dstp = dst->GetWritePtr(PLANAR_V);
-
-    // alignment to FRAME_ALIGN is guaranteed
-    resampler_chroma_aligned(dstp, srcp, dst_pitch, src_pitch, resampling_program_chroma, width, height, bits_per_pixel, src_pitch_table_chromaV, filter_storage_chroma_aligned);
+  const bool has_chroma = !grey && vi.IsPlanar() && !isRGBPfamily;
+  const int planes_y[3] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+  const int planes_r[3] = { PLANAR_G, PLANAR_B, PLANAR_R };
+  const int *planes = isRGBPfamily ? planes_r : planes_y;
+  const int num_planes = (isRGBPfamily || has_chroma) ? 3 : 1;
+
+  BYTE* dstp[3];
+  const BYTE* srcp[3];
+  int dst_pitch[3];
+  int src_pitch[3];
+  for (int p = 0; p < num_planes; p++) {
+    dstp[p] = dst->GetWritePtr(planes[p]);
+    srcp[p] = src->GetReadPtr(planes[p]);
+    dst_pitch[p] = dst->GetPitch(planes[p]);
+    src_pitch[p] = src->GetPitch(planes[p]);
   }
+  const int* src_pitch_table_p[3] = { src_pitch_table_luma,
+    has_chroma ? src_pitch_table_chromaU : src_pitch_table_luma,
+    has_chroma ? src_pitch_table_chromaV : src_pitch_table_luma };
+
+  const int shift_h = has_chroma ? vi.GetPlaneHeightSubsampling(PLANAR_U) : 0;
+  const int chroma_width = has_chroma ? vi.width >> vi.GetPlaneWidthSubsampling(PLANAR_U) : 0;
+
+  // Output lines only depend on the source and the program, so the planes are
+  // resized in horizontal bands on several threads. Each band gets a window on
+  // the resampling program that starts at its first line. Bands are a multiple
+  // of 32 lines in every plane, which keeps the coefficient rows as aligned as
+  // the full program.
+  RunRowBands(env, vi.height, 32 << shift_h, [&](int y_begin, int y_end) {
+    for (int p = 0; p < num_planes; p++) {
+      const bool chroma = has_chroma && p > 0;
+      const int y0 = chroma ? (y_begin >> shift_h) : y_begin;
+      const int y1 = chroma ? (y_end >> shift_h) : y_end;
+      ResamplingProgram band_program(chroma ? *resampling_program_chroma : *resampling_program_luma, y0, y1 - y0);
+      // alignment to FRAME_ALIGN is guaranteed
+      if (chroma)
+        resampler_chroma_aligned(dstp[p] + y0 * dst_pitch[p], srcp[p], dst_pitch[p], src_pitch[p], &band_program, chroma_width, y1 - y0, bits_per_pixel, src_pitch_table_p[p], filter_storage_chroma_aligned);
+      else
+        resampler_luma_aligned(dstp[p] + y0 * dst_pitch[p], srcp[p], dst_pitch[p], src_pitch[p], &band_program, work_width, y1 - y0, bits_per_pixel, src_pitch_table_p[p], filter_storage_luma_aligned);
+    }
+  });
 
   // Free pitch table
   env2->Free(src_pitch_table_luma);
@@ -1929,6 +2060,55 @@ PVideoFrame __stdcall FilteredResizeV::GetFrame(int n, IScriptEnvironment* env)
   return dst;
 }
 
+// Vertical resamplers, fastest first. GetResampler takes the first entry
+// for the pixel size and bit depth whose CPU flags are all present.
+enum {
+  RESAMPLER_ANY_BITS,   // all bit depths of the pixel size
+  RESAMPLER_BITS_LT16,  // 10-14 bits
+  RESAMPLER_BITS_16
+};
+
+struct ResamplerVEntry {
+  int pixelsize;
+  int bits;           // RESAMPLER_xxx_BITS
+  int cpu;            // needed CPU flags
+  bool needs_aligned; // only for aligned frames
+  ResamplerV resampler;
+};
+
+static const ResamplerVEntry ResamplersV[] = {
+  // 8 bit
+  { 1, RESAMPLER_ANY_BITS,   CPUF_AVX512_RESAMPLER,       false, resize_v_avx512_planar_uint8_t },
+  { 1, RESAMPLER_ANY_BITS,   CPUF_SSSE3 | CPUF_AVX2,      true,  resize_v_avx2_planar_uint8_t },
+  { 1, RESAMPLER_ANY_BITS,   CPUF_SSSE3 | CPUF_SSE4_1,    true,  resize_v_ssse3_planar<simd_load_streaming> },
+  { 1, RESAMPLER_ANY_BITS,   CPUF_SSSE3,                  true,  resize_v_ssse3_planar<simd_load_aligned> },
+  { 1, RESAMPLER_ANY_BITS,   CPUF_SSSE3 | CPUF_SSE3,      false, resize_v_ssse3_planar<simd_load_unaligned_sse3> },
+  { 1, RESAMPLER_ANY_BITS,   CPUF_SSSE3,                  false, resize_v_ssse3_planar<simd_load_unaligned> },
+  { 1, RESAMPLER_ANY_BITS,   CPUF_SSE2 | CPUF_SSE4_1,     true,  resize_v_sse2_planar<simd_load_streaming> }, // SSE4.1 movntdqa constantly provide ~2% performance increase in my testing
+  { 1, RESAMPLER_ANY_BITS,   CPUF_SSE2,                   true,  resize_v_sse2_planar<simd_load_aligned> },
+  { 1, RESAMPLER_ANY_BITS,   CPUF_SSE2 | CPUF_SSE3,       false, resize_v_sse2_planar<simd_load_unaligned_sse3> },
+  { 1, RESAMPLER_ANY_BITS,   CPUF_SSE2,                   false, resize_v_sse2_planar<simd_load_unaligned> },
+#ifdef X86_32
+  { 1, RESAMPLER_ANY_BITS,   CPUF_MMX,                    false, resize_v_mmx_planar },
+#endif
+  { 1, RESAMPLER_ANY_BITS,   0,                           false, resize_v_c_planar<uint8_t> },
+  // 10-16 bit
+  { 2, RESAMPLER_BITS_LT16,  CPUF_AVX512_RESAMPLER,       false, resize_v_avx512_planar_uint16_t<true> },
+  { 2, RESAMPLER_BITS_16,    CPUF_AVX512_RESAMPLER,       false, resize_v_avx512_planar_uint16_t<false> },
+  { 2, RESAMPLER_BITS_LT16,  CPUF_AVX2,                   true,  resize_v_avx2_planar_uint16_t<true> },
+  { 2, RESAMPLER_BITS_16,    CPUF_AVX2,                   true,  resize_v_avx2_planar_uint16_t<false> },
+  { 2, RESAMPLER_BITS_LT16,  CPUF_SSE4_1,                 true,  resize_v_sse_planar_uint16_t<true, true> },
+  { 2, RESAMPLER_BITS_16,    CPUF_SSE4_1,                 true,  resize_v_sse_planar_uint16_t<false, true> },
+  { 2, RESAMPLER_BITS_LT16,  CPUF_SSE2,                   true,  resize_v_sse_planar_uint16_t<true, false> },
+  { 2, RESAMPLER_BITS_16,    CPUF_SSE2,                   true,  resize_v_sse_planar_uint16_t<false, false> },
+  { 2, RESAMPLER_ANY_BITS,   0,                           false, resize_v_c_planar<uint16_t> },
+  // float
+  { 4, RESAMPLER_ANY_BITS,   CPUF_AVX512_RESAMPLER,       false, resize_v_avx512_planar_float },
+  { 4, RESAMPLER_ANY_BITS,   CPUF_AVX2,                   true,  resize_v_avx2_planar_float },
+  { 4, RESAMPLER_ANY_BITS,   CPUF_SSE2,                   true,  resize_v_sse2_planar_float },
+  { 4, RESAMPLER_ANY_BITS,   0,                           false, resize_v_c_planar<float> },
+};
+
 ResamplerV FilteredResizeV::GetResampler(int CPU, bool aligned, int pixelsize, int bits_per_pixel, void*& storage, ResamplingProgram* program)
 {
   if (program->filter_size == 1) {
@@ -1941,84 +2121,17 @@ ResamplerV FilteredResizeV::GetResampler(int CPU, bool aligned, int pixelsize, i
       return resize_v_planar_pointresize<float>;
     }
   }
-  else {
-    // Other resizers
-    if (pixelsize == 1)
-    {
-      if (CPU & CPUF_SSSE3) {
-        if (aligned && (CPU & CPUF_AVX2)) {
-          return resize_v_avx2_planar_uint8_t;
-        }
-        if (aligned && (CPU & CPUF_SSE4_1)) {
-          return resize_v_ssse3_planar<simd_load_streaming>;
-        }
-        else if (aligned) { // SSSE3 aligned
-          return resize_v_ssse3_planar<simd_load_aligned>;
-        }
-        else if (CPU & CPUF_SSE3) { // SSE3 lddqu
-          return resize_v_ssse3_planar<simd_load_unaligned_sse3>;
-        }
-        else { // SSSE3 unaligned
-          return resize_v_ssse3_planar<simd_load_unaligned>;
-        }
-      }
-      else if (CPU & CPUF_SSE2) {
-        if (aligned && CPU & CPUF_SSE4_1) { // SSE4.1 movntdqa constantly provide ~2% performance increase in my testing
-          return resize_v_sse2_planar<simd_load_streaming>;
-        }
-        else if (aligned) { // SSE2 aligned
-          return resize_v_sse2_planar<simd_load_aligned>;
-        }
-        else if (CPU & CPUF_SSE3) { // SSE2 lddqu
-          return resize_v_sse2_planar<simd_load_unaligned_sse3>;
-        }
-        else { // SSE2 unaligned
-          return resize_v_sse2_planar<simd_load_unaligned>;
-        }
-#ifdef X86_32
-      }
-      else if (CPU & CPUF_MMX) {
-        return resize_v_mmx_planar;
-#endif
-      }
-      else { // C version
-        return resize_v_c_planar<uint8_t>;
-      }
-    }
-    else if (pixelsize == 2) {
-      if (aligned && (CPU & CPUF_AVX2)) {
-        if(bits_per_pixel<16)
-          return resize_v_avx2_planar_uint16_t<true>;
-        else
-          return resize_v_avx2_planar_uint16_t<false>;
-      }
-      else if (aligned && (CPU & CPUF_SSE4_1)) {
-        if (bits_per_pixel < 16)
-          return resize_v_sse_planar_uint16_t<true, true>;
-        else
-          return resize_v_sse_planar_uint16_t<false, true>;
-      }
-      else if (aligned && (CPU & CPUF_SSE2)) {
-        if (bits_per_pixel < 16)
-          return resize_v_sse_planar_uint16_t<true, false>;
-        else
-          return resize_v_sse_planar_uint16_t<false, false>;
-      }
-      else { // C version
-        return resize_v_c_planar<uint16_t>;
-      }
-    }
-    else { // pixelsize== 4
-      if (aligned && (CPU & CPUF_AVX2)) {
-        return resize_v_avx2_planar_float;
-      }
-      else if (aligned && (CPU & CPUF_SSE2)) {
-        return resize_v_sse2_planar_float;
-      } else {
-        return resize_v_c_planar<float>;
-      }
-    }
+
+  // Other resizers
+  const int bits = bits_per_pixel < 16 ? RESAMPLER_BITS_LT16 : RESAMPLER_BITS_16;
+  for (const ResamplerVEntry& entry : ResamplersV) {
+    if (entry.pixelsize == pixelsize
+      && (entry.bits == RESAMPLER_ANY_BITS || entry.bits == bits)
+      && (CPU & entry.cpu) == entry.cpu
+      && (aligned || !entry.needs_aligned))
+      return entry.resampler;
   }
+  return NULL; // not reached, every pixel size has a C entry
 }
 
 FilteredResizeV::~FilteredResizeV(void)
@@ -2028,10 +2141,150 @@ FilteredResizeV::~FilteredResizeV(void)
 }
 
 
+/***************************************
+ ***** Filtered Resize - 2D (fused) ****
+ ***************************************/
+
+// Output lines per tile. A multiple of 32 keeps the coefficient rows of a
+// program window as aligned as the full program. For a 4K to 1080p downscale
+// the buffer between the passes is then around 150KB for 8 bit luma.
+static const int RESIZE_2D_TILE_ROWS = 32;
+
+FilteredResize2D::FilteredResize2D( PClip _child, FilteredResizeH* _pass_h, FilteredResizeV* _pass_v, IScriptEnvironment* env )
+  : GenericVideoFilter(_child),
+  resize_h(_pass_h), resize_v(_pass_v),
+  pass_h(_pass_h), pass_v(_pass_v),
+  temp_size(0)
+{
+  vi = resize_v->GetVideoInfo();
+
+  const bool has_chroma = !vi.IsY() && !vi.IsPlanarRGB() && !vi.IsPlanarRGBA();
+  const int num_programs = has_chroma ? 2 : 1;
+
+  for (int c = 0; c < 2; c++) {
+    temp_pitch[c] = 0;
+    temp_rows[c] = 0;
+  }
+
+  for (int c = 0; c < num_programs; c++) {
+    const int width = c == 0 ? vi.width : vi.width >> vi.GetPlaneWidthSubsampling(PLANAR_U);
+    const ResamplingProgram* program_v = c == 0 ? pass_v->resampling_program_luma : pass_v->resampling_program_chroma;
+
+    // Source lines needed by the tallest tile. Tiles start at multiples of
+    // the tile height in every plane, see GetFrame.
+    for (int y = 0; y < program_v->target_size; y += RESIZE_2D_TILE_ROWS) {
+      const int last = min(y + RESIZE_2D_TILE_ROWS, program_v->target_size) - 1;
+      temp_rows[c] = max(temp_rows[c], program_v->pixel_offset[last] + program_v->filter_size - program_v->pixel_offset[y]);
+    }
+
+    temp_pitch[c] = AlignNumber(width * vi.ComponentSize(), FRAME_ALIGN);
+    temp_size = max(temp_size, (size_t)temp_pitch[c] * temp_rows[c]);
+
+    temp_pitch_table[c].resize(temp_rows[c]);
+    resize_v_create_pitch_table(temp_pitch_table[c].data(), temp_pitch[c], temp_rows[c]);
+  }
+}
+
+PVideoFrame __stdcall FilteredResize2D::GetFrame(int n, IScriptEnvironment* env)
+{
+  PVideoFrame src = child->GetFrame(n, env);
+  PVideoFrame dst = env->NewVideoFrame(vi);
+
+  const bool isRGBPfamily = vi.IsPlanarRGB() || vi.IsPlanarRGBA();
+  const bool has_chroma = !vi.IsY() && !isRGBPfamily;
+  const int planes_y[4] = { PLANAR_Y, PLANAR_U, PLANAR_V, PLANAR_A };
+  const int planes_r[4] = { PLANAR_G, PLANAR_B, PLANAR_R, PLANAR_A };
+  const int *planes = isRGBPfamily ? planes_r : planes_y;
+  const int num_planes = vi.IsY() ? 1 : vi.NumComponents();
+
+  BYTE* dstp[4];
+  const BYTE* srcp[4];
+  int dst_pitch[4];
+  int src_pitch[4];
+  for (int p = 0; p < num_planes; p++) {
+    dstp[p] = dst->GetWritePtr(planes[p]);
+    srcp[p] = src->GetReadPtr(planes[p]);
+    dst_pitch[p] = dst->GetPitch(planes[p]);
+    src_pitch[p] = src->GetPitch(planes[p]);
+  }
+
+  const int shift_h = has_chroma ? vi.GetPlaneHeightSubsampling(PLANAR_U) : 0;
+  const int chroma_width = has_chroma ? vi.width >> vi.GetPlaneWidthSubsampling(PLANAR_U) : 0;
+  const int bits_per_pixel = vi.BitsPerComponent();
+
+  RunRowBands(env, vi.height, RESIZE_2D_TILE_ROWS << shift_h, [&](int y_begin, int y_end) {
+    BYTE* temp = static_cast<BYTE*>(avs_malloc(temp_size, FRAME_ALIGN));
+    if (!temp)
+      throw std::bad_alloc();
+
+    int tile_offset[RESIZE_2D_TILE_ROWS];
+
+    for (int p = 0; p < num_planes; p++) {
+      const int c = (has_chroma && (p == 1 || p == 2)) ? 1 : 0;
+      const int y0 = c ? (y_begin >> shift_h) : y_begin;
+      const int y1 = c ? (y_end >> shift_h) : y_end;
+      const int width = c ? chroma_width : vi.width;
+
+      ResamplingProgram* program_h = c ? pass_h->resampling_program_chroma : pass_h->resampling_program_luma;
+      ResamplerH resampler_h = c ? pass_h->resampler_h_chroma : pass_h->resampler_h_luma;
+      ResamplingProgram* program_v = c ? pass_v->resampling_program_chroma : pass_v->resampling_program_luma;
+      ResamplerV resampler_v = c ? pass_v->resampler_chroma_aligned : pass_v->resampler_luma_aligned;
+      void* storage_v = c ? pass_v->filter_storage_chroma_aligned : pass_v->filter_storage_luma_aligned;
+
+      for (int y = y0; y < y1; y += RESIZE_2D_TILE_ROWS) {
+        const int rows = min(RESIZE_2D_TILE_ROWS, y1 - y);
+        const int first = program_v->pixel_offset[y];
+        const int end = program_v->pixel_offset[y + rows - 1] + program_v->filter_size;
+
+        // horizontal: only the source lines this tile needs
+        resampler_h(temp, srcp[p] + first * src_pitch[p], temp_pitch[c], src_pitch[p], program_h, width, end - first, bits_per_pixel);
+
+        // vertical: a window on the program, with offsets relative to the buffer
+        ResamplingProgram tile_program(*program_v, y, rows);
+        for (int i = 0; i < rows; i++)
+          tile_offset[i] = program_v->pixel_offset[y + i] - first;
+        tile_program.pixel_offset = tile_offset;
+
+        // alignment to FRAME_ALIGN is guaranteed
+        resampler_v(dstp[p] + y * dst_pitch[p], temp, dst_pitch[p], temp_pitch[c], &tile_program, width, rows, bits_per_pixel, temp_pitch_table[c].data(), storage_v);
+      }
+    }
+
+    avs_free(temp);
+  });
+
+  return dst;
+}
+
+
 /**********************************************
  *******   Resampling Factory Methods   *******
  **********************************************/
 
+// The horizontal resize is only a crop (or nothing at all)
+static bool IsCropH(const VideoInfo& vi, double subrange_left, double subrange_width, int target_width)
+{
+  if (subrange_left == int(subrange_left) && subrange_width == target_width
+   && subrange_left >= 0 && subrange_left + subrange_width <= vi.width) {
+    const int mask = ((vi.IsYUV() || vi.IsYUVA()) && !vi.IsY()) ? (1 << vi.GetPlaneWidthSubsampling(PLANAR_U)) - 1 : 0;
+
+    return ((int(subrange_left) | int(subrange_width)) & mask) == 0;
+  }
+  return false;
+}
+
+// The vertical resize is only a crop (or nothing at all)
+static bool IsCropV(const VideoInfo& vi, double subrange_top, double subrange_height, int target_height)
+{
+  if (subrange_top == int(subrange_top) && subrange_height == target_height
+   && subrange_top >= 0 && subrange_top + subrange_height <= vi.height) {
+    const int mask = ((vi.IsYUV() || vi.IsYUVA()) && !vi.IsY()) ? (1 << vi.GetPlaneHeightSubsampling(PLANAR_U)) - 1 : 0;
+
+    return ((int(subrange_top) | int(subrange_height)) & mask) == 0;
+  }
+  return false;
+}
+
 PClip FilteredResize::CreateResizeH(PClip clip, double subrange_left, double subrange_width, int target_width,
                     ResamplingFunction* func, IScriptEnvironment* env)
 {
@@ -2040,13 +2293,8 @@ PClip FilteredResize::CreateResizeH(PClip clip, double subrange_left, double sub
     return clip;
   }
 
-  if (subrange_left == int(subrange_left) && subrange_width == target_width
-   && subrange_left >= 0 && subrange_left + subrange_width <= vi.width) {
-    const int mask = ((vi.IsYUV() || vi.IsYUVA()) && !vi.IsY()) ? (1 << vi.GetPlaneWidthSubsampling(PLANAR_U)) - 1 : 0;
-
-    if (((int(subrange_left) | int(subrange_width)) & mask) == 0)
-      return new Crop(int(subrange_left), 0, int(subrange_width), vi.height, 0, clip, env);
-  }
+  if (IsCropH(vi, subrange_left, subrange_width, target_width))
+    return new Crop(int(subrange_left), 0, int(subrange_width), vi.height, 0, clip, env);
 
   // Convert interleaved yuv to planar yuv
   PClip result = clip;
@@ -2070,13 +2318,8 @@ PClip FilteredResize::CreateResizeV(PClip clip, double subrange_top, double subr
     return clip;
   }
 
-  if (subrange_top == int(subrange_top) && subrange_height == target_height
-   && subrange_top >= 0 && subrange_top + subrange_height <= vi.height) {
-    const int mask = ((vi.IsYUV() || vi.IsYUVA()) && !vi.IsY()) ? (1 << vi.GetPlaneHeightSubsampling(PLANAR_U)) - 1 : 0;
-
-    if (((int(subrange_top) | int(subrange_height)) & mask) == 0)
-      return new Crop(0, int(subrange_top), vi.width, int(subrange_height), 0, clip, env);
-  }
+  if (IsCropV(vi, subrange_top, subrange_height, target_height))
+    return new Crop(0, int(subrange_top), vi.width, int(subrange_height), 0, clip, env);
   return new FilteredResizeV(clip, subrange_top, subrange_height, target_height, func, env);
 }
 
@@ -2105,6 +2348,26 @@ PClip FilteredResize::CreateResize(PClip clip, int target_width, int target_heig
       result = CreateResizeV(clip, subrange_top, subrange_height, target_height, f, env);
       result = CreateResizeH(result, subrange_left, subrange_width, target_width, f, env);
   }
+  else if ((vi.IsPlanar() || vi.IsYUY2())
+    && !IsCropH(vi, subrange_left, subrange_width, target_width)
+    && !IsCropV(vi, subrange_top, subrange_height, target_height))
+  {
+      // Both passes really resample: do them in one, without the intermediate frame.
+      // Falls back to the chain when the horizontal pass has no direct planar kernels.
+      result = clip;
+      if (vi.IsYUY2())
+        result = new ConvertYUY2ToYV16(result, env);
+      FilteredResizeH* pass_h = new FilteredResizeH(result, subrange_left, subrange_width, target_width, f, env);
+      PClip resize_h = pass_h;
+      FilteredResizeV* pass_v = new FilteredResizeV(resize_h, subrange_top, subrange_height, target_height, f, env);
+      PClip resize_v = pass_v;
+      if (pass_h->IsFastResize())
+        result = new FilteredResize2D(result, pass_h, pass_v, env);
+      else
+        result = resize_v;
+      if (vi.IsYUY2())
+        result = new ConvertYV16ToYUY2(result, env);
+  }
   else
   {
       result = CreateResizeH(clip, subrange_left, subrange_width, target_width, f, env);
@@ -36,6 +36,7 @@
 #define __Resample_H__
 
 #include <avisynth.h>
+#include <vector>
 #include "resample_functions.h"
 
 // Resizer function pointer
@@ -63,7 +64,12 @@ public:
 
   static ResamplerH GetResampler(int CPU, bool aligned, int pixelsize, int bits_per_pixel, ResamplingProgram* program, IScriptEnvironment2* env);
 
+  // Planes are resampled directly, without turning them
+  bool IsFastResize() const { return fast_resize; }
+
 private:
+  friend class FilteredResize2D;
+
   // Resampling
   ResamplingProgram *resampling_program_luma;
   ResamplingProgram *resampling_program_chroma;
@@ -111,6 +117,8 @@ public:
   static ResamplerV GetResampler(int CPU, bool aligned, int pixelsize, int bits_per_pixel, void*& storage, ResamplingProgram* program);
 
 private:
+  friend class FilteredResize2D;
+
   bool grey;
   int pixelsize; // AVS16
   int bits_per_pixel;
@@ -128,6 +136,37 @@ private:
 };
 
 
+/**
+  * Class to resize planar formats in both directions in one pass.
+  * Horizontally resampled rows go into a small per-thread buffer which is
+  * resampled vertically right away, instead of into a whole intermediate frame.
+  * Uses the programs and resamplers of the FilteredResizeH / FilteredResizeV
+  * pair it replaces, so the output is the same.
+ **/
+class FilteredResize2D : public GenericVideoFilter
+{
+public:
+  FilteredResize2D( PClip _child, FilteredResizeH* _pass_h, FilteredResizeV* _pass_v, IScriptEnvironment* env );
+  PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment* env);
+
+  int __stdcall SetCacheHints(int cachehints, int frame_range) override {
+    return cachehints == CACHE_GET_MTMODE ? MT_NICE_FILTER : 0;
+  }
+
+private:
+  // Keeps the two passes alive, their GetFrame is never called
+  PClip resize_h, resize_v;
+  FilteredResizeH* pass_h;
+  FilteredResizeV* pass_v;
+
+  // Buffer between the passes, [0] for luma-sized planes, [1] for chroma
+  int temp_pitch[2];
+  int temp_rows[2];
+  size_t temp_size;
+  std::vector<int> temp_pitch_table[2];
+};
+
+
 /*** Resample factory methods ***/
 
 class FilteredResize
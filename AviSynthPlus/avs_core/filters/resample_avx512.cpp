@@ -0,0 +1,369 @@
+// Avisynth v2.5.  Copyright 2002 Ben Rudiak-Gould et al.
+// http://www.avisynth.org
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA, or visit
+// http://www.gnu.org/copyleft/gpl.html .
+//
+// Linking Avisynth statically or dynamically with other modules is making a
+// combined work based on Avisynth.  Thus, the terms and conditions of the GNU
+// General Public License cover the whole combination.
+//
+// As a special exception, the copyright holders of Avisynth give you
+// permission to link Avisynth with independent modules that communicate with
+// Avisynth solely through the interfaces defined in avisynth.h, regardless of the license
+// terms of these independent modules, and to copy and distribute the
+// resulting combined work under terms of your choice, provided that
+// every copy of the combined work is accompanied by a complete copy of
+// the source code of Avisynth (the version of Avisynth used to produce the
+// combined work), being distributed under the terms of the GNU General
+// Public License plus this exception.  An independent module is a module
+// which is not derived from or based on Avisynth, such as 3rd-party filters,
+// import and export plugins, or graphical user interfaces.
+
+#include "resample.h"
+#include <avs/config.h>
+#include "../core/internal.h"
+
+#include <avs/alignment.h>
+#include <avs/minmax.h>
+
+// simd includes for avx512 compiled files
+#if defined (__GNUC__) && ! defined (__INTEL_COMPILER)
+#include <x86intrin.h>
+#else
+#include <immintrin.h>
+#endif // __GNUC__
+
+#include "resample_avx512.h"
+
+// Sums the four 32 bit elements of every 128 bit lane. Lane k of the result
+// holds [sum(a lane k), sum(b lane k), sum(c lane k), sum(d lane k)].
+__forceinline static __m512i hsum_lanes_4x_epi32(const __m512i &a, const __m512i &b, const __m512i &c, const __m512i &d) {
+  const __m512i sum_ab = _mm512_add_epi32(_mm512_unpacklo_epi32(a, b), _mm512_unpackhi_epi32(a, b)); // a02 b02 a13 b13
+  const __m512i sum_cd = _mm512_add_epi32(_mm512_unpacklo_epi32(c, d), _mm512_unpackhi_epi32(c, d)); // c02 d02 c13 d13
+  return _mm512_add_epi32(_mm512_unpacklo_epi64(sum_ab, sum_cd), _mm512_unpackhi_epi64(sum_ab, sum_cd));
+}
+
+__forceinline static __m512 hsum_lanes_4x_ps(const __m512 &a, const __m512 &b, const __m512 &c, const __m512 &d) {
+  const __m512d sum_ab = _mm512_castps_pd(_mm512_add_ps(_mm512_unpacklo_ps(a, b), _mm512_unpackhi_ps(a, b)));
+  const __m512d sum_cd = _mm512_castps_pd(_mm512_add_ps(_mm512_unpacklo_ps(c, d), _mm512_unpackhi_ps(c, d)));
+  return _mm512_add_ps(_mm512_castpd_ps(_mm512_unpacklo_pd(sum_ab, sum_cd)), _mm512_castpd_ps(_mm512_unpackhi_pd(sum_ab, sum_cd)));
+}
+
+__forceinline static __m512i set_lanes_epi32(const __m128i &l0, const __m128i &l1, const __m128i &l2, const __m128i &l3) {
+  __m512i v = _mm512_castsi128_si512(l0);
+  v = _mm512_inserti32x4(v, l1, 1);
+  v = _mm512_inserti32x4(v, l2, 2);
+  return _mm512_inserti32x4(v, l3, 3);
+}
+
+__forceinline static __m512 set_lanes_ps(const __m128 &l0, const __m128 &l1, const __m128 &l2, const __m128 &l3) {
+  __m512 v = _mm512_castps128_ps512(l0);
+  v = _mm512_insertf32x4(v, l1, 1);
+  v = _mm512_insertf32x4(v, l2, 2);
+  return _mm512_insertf32x4(v, l3, 3);
+}
+
+// mask for the first 'count' of 'max' elements
+__forceinline static unsigned int tail_mask(int count, int max) {
+  return count >= max ? (unsigned int)((1ull << max) - 1) : (1u << count) - 1;
+}
+
+//-------- 512 bit Horizontals
+
+// 16 target pixels at once, in four accumulators: lane k of accumulator g
+// sums the taps of pixel x + 4*k + g, so after hsum_lanes_4x the pixels are
+// in order. Taps are read in 128 bit chunks, the last chunk with a mask, so
+// nothing beyond the filter window is read whatever the filter size.
+// Beyond the right edge the last pixel is repeated and not stored.
+
+// 8 taps as signed 16 bit words
+template<typename pixel_t, bool lessthan16bit>
+__forceinline static __m128i load_taps_8(const pixel_t *src, __mmask8 mask) {
+  if (sizeof(pixel_t) == 1)
+    return _mm_cvtepu8_epi16(_mm_maskz_loadu_epi8((__mmask16)mask, src));
+  __m128i data = _mm_maskz_loadu_epi16(mask, src);
+  if (!lessthan16bit)
+    data = _mm_add_epi16(data, _mm_set1_epi16(-32768)); // unsigned -> signed, padding coeffs are zero
+  return data;
+}
+
+template<typename pixel_t, bool lessthan16bit>
+static void internal_resizer_h_avx512_generic_int(BYTE* dst8, const BYTE* src8, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int height, int bits_per_pixel) {
+  const int filter_size = program->filter_size;
+  const int coeff_stride = AlignNumber(filter_size, ALIGN_RESIZER_COEFF_SIZE);
+  const int num_chunks = (filter_size + 7) / 8;
+  const __mmask8 last_chunk_mask = (__mmask8)tail_mask(filter_size - (num_chunks - 1) * 8, 8);
+
+  const int fpscale_bits = sizeof(pixel_t) == 1 ? 14 : FPScale16bits; // FPScale or FPScale16
+  const __m512i rounder = _mm512_set1_epi32(1 << (fpscale_bits - 1));
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i clamp_limit = _mm512_set1_epi32((1 << bits_per_pixel) - 1);
+
+  const pixel_t *src = reinterpret_cast<const pixel_t *>(src8);
+  pixel_t *dst = reinterpret_cast<pixel_t *>(dst8);
+  src_pitch /= sizeof(pixel_t);
+  dst_pitch /= sizeof(pixel_t);
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x += 16) {
+      __m512i acc[4];
+
+      for (int g = 0; g < 4; g++) {
+        const pixel_t *srcp[4];
+        const short *coeff[4];
+        for (int k = 0; k < 4; k++) {
+          const int px = min(x + 4 * k + g, width - 1);
+          srcp[k] = src + program->pixel_offset[px];
+          coeff[k] = program->pixel_coefficient + px * coeff_stride;
+        }
+
+        __m512i sum = zero;
+        for (int c = 0; c < num_chunks; c++) {
+          const __mmask8 mask = (c == num_chunks - 1) ? last_chunk_mask : (__mmask8)0xFF;
+          const __m512i data = set_lanes_epi32(
+            load_taps_8<pixel_t, lessthan16bit>(srcp[0] + c * 8, mask),
+            load_taps_8<pixel_t, lessthan16bit>(srcp[1] + c * 8, mask),
+            load_taps_8<pixel_t, lessthan16bit>(srcp[2] + c * 8, mask),
+            load_taps_8<pixel_t, lessthan16bit>(srcp[3] + c * 8, mask));
+          const __m512i coef = set_lanes_epi32(
+            _mm_load_si128(reinterpret_cast<const __m128i *>(coeff[0] + c * 8)),
+            _mm_load_si128(reinterpret_cast<const __m128i *>(coeff[1] + c * 8)),
+            _mm_load_si128(reinterpret_cast<const __m128i *>(coeff[2] + c * 8)),
+            _mm_load_si128(reinterpret_cast<const __m128i *>(coeff[3] + c * 8)));
+          sum = _mm512_add_epi32(sum, _mm512_madd_epi16(data, coef));
+        }
+        acc[g] = sum;
+      }
+
+      __m512i result = _mm512_add_epi32(hsum_lanes_4x_epi32(acc[0], acc[1], acc[2], acc[3]), rounder);
+      result = _mm512_srai_epi32(result, fpscale_bits);
+
+      const __mmask16 store_mask = (__mmask16)tail_mask(width - x, 16);
+      if (sizeof(pixel_t) == 1) {
+        result = _mm512_max_epi32(result, zero);
+        _mm_mask_storeu_epi8(dst + x, store_mask, _mm512_cvtusepi32_epi8(result));
+      }
+      else if (lessthan16bit) {
+        result = _mm512_min_epi32(_mm512_max_epi32(result, zero), clamp_limit);
+        _mm256_mask_storeu_epi16(dst + x, store_mask, _mm512_cvtepi32_epi16(result));
+      }
+      else {
+        // still in the signed range: saturate, then shift back
+        const __m256i result16 = _mm256_add_epi16(_mm512_cvtsepi32_epi16(result), _mm256_set1_epi16(-32768));
+        _mm256_mask_storeu_epi16(dst + x, store_mask, result16);
+      }
+    }
+
+    dst += dst_pitch;
+    src += src_pitch;
+  }
+  _mm256_zeroupper();
+}
+
+void resizer_h_avx512_generic_uint8_t(BYTE* dst8, const BYTE* src8, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int height, int bits_per_pixel) {
+  internal_resizer_h_avx512_generic_int<uint8_t, true>(dst8, src8, dst_pitch, src_pitch, program, width, height, bits_per_pixel);
+}
+
+template<bool lessthan16bit>
+void resizer_h_avx512_generic_uint16_t(BYTE* dst8, const BYTE* src8, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int height, int bits_per_pixel) {
+  internal_resizer_h_avx512_generic_int<uint16_t, lessthan16bit>(dst8, src8, dst_pitch, src_pitch, program, width, height, bits_per_pixel);
+}
+
+void resizer_h_avx512_generic_float(BYTE* dst8, const BYTE* src8, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int height, int bits_per_pixel) {
+  const int filter_size = program->filter_size;
+  const int coeff_stride = AlignNumber(filter_size, ALIGN_RESIZER_COEFF_SIZE);
+  const int num_chunks = (filter_size + 3) / 4;
+  const __mmask8 last_chunk_mask = (__mmask8)tail_mask(filter_size - (num_chunks - 1) * 4, 4);
+
+  const float *src = reinterpret_cast<const float *>(src8);
+  float *dst = reinterpret_cast<float *>(dst8);
+  src_pitch /= sizeof(float);
+  dst_pitch /= sizeof(float);
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x += 16) {
+      __m512 acc[4];
+
+      for (int g = 0; g < 4; g++) {
+        const float *srcp[4];
+        const float *coeff[4];
+        for (int k = 0; k < 4; k++) {
+          const int px = min(x + 4 * k + g, width - 1);
+          srcp[k] = src + program->pixel_offset[px];
+          coeff[k] = program->pixel_coefficient_float + px * coeff_stride;
+        }
+
+        __m512 sum = _mm512_setzero_ps();
+        for (int c = 0; c < num_chunks; c++) {
+          const __mmask8 mask = (c == num_chunks - 1) ? last_chunk_mask : (__mmask8)0x0F;
+          const __m512 data = set_lanes_ps(
+            _mm_maskz_loadu_ps(mask, srcp[0] + c * 4),
+            _mm_maskz_loadu_ps(mask, srcp[1] + c * 4),
+            _mm_maskz_loadu_ps(mask, srcp[2] + c * 4),
+            _mm_maskz_loadu_ps(mask, srcp[3] + c * 4));
+          const __m512 coef = set_lanes_ps(
+            _mm_load_ps(coeff[0] + c * 4),
+            _mm_load_ps(coeff[1] + c * 4),
+            _mm_load_ps(coeff[2] + c * 4),
+            _mm_load_ps(coeff[3] + c * 4));
+          sum = _mm512_fmadd_ps(data, coef, sum);
+        }
+        acc[g] = sum;
+      }
+
+      const __mmask16 store_mask = (__mmask16)tail_mask(width - x, 16);
+      _mm512_mask_storeu_ps(dst + x, store_mask, hsum_lanes_4x_ps(acc[0], acc[1], acc[2], acc[3]));
+    }
+
+    dst += dst_pitch;
+    src += src_pitch;
+  }
+  _mm256_zeroupper();
+}
+
+//-------- 512 bit Verticals
+
+// 32 samples (16 for float) of a row at once. Two source rows are
+// interleaved so that madd applies a pair of taps; masked loads and stores
+// handle the right edge.
+
+template<typename pixel_t, bool lessthan16bit>
+__forceinline static __m512i load_row_32(const pixel_t *src, __mmask32 mask) {
+  if (sizeof(pixel_t) == 1)
+    return _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(mask, src));
+  __m512i data = _mm512_maskz_loadu_epi16(mask, src);
+  if (!lessthan16bit)
+    data = _mm512_add_epi16(data, _mm512_set1_epi16(-32768)); // unsigned -> signed
+  return data;
+}
+
+template<typename pixel_t, bool lessthan16bit>
+static void internal_resize_v_avx512_planar_int(BYTE* dst0, const BYTE* src0, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int target_height, int bits_per_pixel, const int* pitch_table)
+{
+  const int filter_size = program->filter_size;
+  const short *current_coeff = program->pixel_coefficient;
+
+  const int fpscale_bits = sizeof(pixel_t) == 1 ? 14 : FPScale16bits; // FPScale or FPScale16
+  const __m512i rounder = _mm512_set1_epi32(1 << (fpscale_bits - 1));
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i clamp_limit = _mm512_set1_epi16((short)((1 << bits_per_pixel) - 1));
+
+  pixel_t *dst = reinterpret_cast<pixel_t *>(dst0);
+  src_pitch /= sizeof(pixel_t);
+  dst_pitch /= sizeof(pixel_t);
+
+  for (int y = 0; y < target_height; y++) {
+    const pixel_t *src_ptr = reinterpret_cast<const pixel_t *>(src0 + pitch_table[program->pixel_offset[y]]);
+
+    for (int x = 0; x < width; x += 32) {
+      const __mmask32 mask = (__mmask32)tail_mask(width - x, 32);
+      const pixel_t *src2_ptr = src_ptr + x;
+      __m512i result_lo = rounder;
+      __m512i result_hi = rounder;
+
+      int i = 0;
+      for (; i < filter_size - 1; i += 2) {
+        const __m512i row0 = load_row_32<pixel_t, lessthan16bit>(src2_ptr, mask);
+        const __m512i row1 = load_row_32<pixel_t, lessthan16bit>(src2_ptr + src_pitch, mask);
+        const __m512i coeff = _mm512_unpacklo_epi16(_mm512_set1_epi16(current_coeff[i]), _mm512_set1_epi16(current_coeff[i + 1]));
+        result_lo = _mm512_add_epi32(result_lo, _mm512_madd_epi16(_mm512_unpacklo_epi16(row0, row1), coeff));
+        result_hi = _mm512_add_epi32(result_hi, _mm512_madd_epi16(_mm512_unpackhi_epi16(row0, row1), coeff));
+        src2_ptr += 2 * src_pitch;
+      }
+      if (i < filter_size) {
+        const __m512i row0 = load_row_32<pixel_t, lessthan16bit>(src2_ptr, mask);
+        const __m512i coeff = _mm512_set1_epi32((unsigned short)current_coeff[i]);
+        result_lo = _mm512_add_epi32(result_lo, _mm512_madd_epi16(_mm512_unpacklo_epi16(row0, zero), coeff));
+        result_hi = _mm512_add_epi32(result_hi, _mm512_madd_epi16(_mm512_unpackhi_epi16(row0, zero), coeff));
+      }
+
+      result_lo = _mm512_srai_epi32(result_lo, fpscale_bits);
+      result_hi = _mm512_srai_epi32(result_hi, fpscale_bits);
+
+      // the unpacks above and the packs here are both per 128 bit lane, order is kept
+      if (sizeof(pixel_t) == 1) {
+        const __m512i result = _mm512_max_epi16(_mm512_packs_epi32(result_lo, result_hi), zero);
+        _mm256_mask_storeu_epi8(dst + x, mask, _mm512_cvtusepi16_epi8(result));
+      }
+      else if (lessthan16bit) {
+        const __m512i result = _mm512_min_epu16(_mm512_packus_epi32(result_lo, result_hi), clamp_limit);
+        _mm512_mask_storeu_epi16(dst + x, mask, result);
+      }
+      else {
+        // still in the signed range: saturate, then shift back
+        const __m512i result = _mm512_add_epi16(_mm512_packs_epi32(result_lo, result_hi), _mm512_set1_epi16(-32768));
+        _mm512_mask_storeu_epi16(dst + x, mask, result);
+      }
+    }
+
+    dst += dst_pitch;
+    current_coeff += filter_size;
+  }
+  _mm256_zeroupper();
+}
+
+void resize_v_avx512_planar_uint8_t(BYTE* dst, const BYTE* src, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int target_height, int bits_per_pixel, const int* pitch_table, const void* storage)
+{
+  internal_resize_v_avx512_planar_int<uint8_t, true>(dst, src, dst_pitch, src_pitch, program, width, target_height, bits_per_pixel, pitch_table);
+}
+
+template<bool lessthan16bit>
+void resize_v_avx512_planar_uint16_t(BYTE* dst0, const BYTE* src0, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int target_height, int bits_per_pixel, const int* pitch_table, const void* storage)
+{
+  internal_resize_v_avx512_planar_int<uint16_t, lessthan16bit>(dst0, src0, dst_pitch, src_pitch, program, width, target_height, bits_per_pixel, pitch_table);
+}
+
+void resize_v_avx512_planar_float(BYTE* dst0, const BYTE* src0, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int target_height, int bits_per_pixel, const int* pitch_table, const void* storage)
+{
+  const int filter_size = program->filter_size;
+  const float *current_coeff = program->pixel_coefficient_float;
+
+  float *dst = reinterpret_cast<float *>(dst0);
+  src_pitch /= sizeof(float);
+  dst_pitch /= sizeof(float);
+
+  for (int y = 0; y < target_height; y++) {
+    const float *src_ptr = reinterpret_cast<const float *>(src0 + pitch_table[program->pixel_offset[y]]);
+
+    for (int x = 0; x < width; x += 16) {
+      const __mmask16 mask = (__mmask16)tail_mask(width - x, 16);
+      const float *src2_ptr = src_ptr + x;
+      __m512 result = _mm512_setzero_ps();
+
+      for (int i = 0; i < filter_size; i++) {
+        result = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, src2_ptr), _mm512_set1_ps(current_coeff[i]), result);
+        src2_ptr += src_pitch;
+      }
+
+      _mm512_mask_storeu_ps(dst + x, mask, result);
+    }
+
+    dst += dst_pitch;
+    current_coeff += filter_size;
+  }
+  _mm256_zeroupper();
+}
+
+// instantiate here
+// avx512 16bit
+template void resizer_h_avx512_generic_uint16_t<false>(BYTE* dst8, const BYTE* src8, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int height, int bits_per_pixel);
+// avx512 10-14bit
+template void resizer_h_avx512_generic_uint16_t<true>(BYTE* dst8, const BYTE* src8, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int height, int bits_per_pixel);
+
+// avx512 16
+template void resize_v_avx512_planar_uint16_t<false>(BYTE* dst0, const BYTE* src0, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int target_height, int bits_per_pixel, const int* pitch_table, const void* storage);
+// avx512 10-14bit
+template void resize_v_avx512_planar_uint16_t<true>(BYTE* dst0, const BYTE* src0, int dst_pitch, int src_pitch, ResamplingProgram* program, int width, int target_height, int bits_per_pixel, const int* pitch_table, const void* storage);
@@ -37,6 +37,7 @@
 
 #include <avisynth.h>
 #include "avs/alignment.h"
+#include <avs/minmax.h>
 
 // Original value: 65536
 // 2 bits sacrificed because of 16 bit signed MMX multiplication
@@ -96,7 +97,26 @@ struct ResamplingProgram {
 
   };
 
+  // Window on target pixels [first, first+count) of 'parent', used to run a
+  // resampler on a band of the output. Shares the arrays of 'parent', which
+  // must outlive it, and owns nothing (Env is NULL).
+  ResamplingProgram(const ResamplingProgram& parent, int first, int count)
+    : filter_size(parent.filter_size), source_size(parent.source_size), target_size(count), crop_start(parent.crop_start), crop_size(parent.crop_size), bits_per_pixel(parent.bits_per_pixel),
+    pixel_offset(parent.pixel_offset + first),
+    pixel_coefficient(parent.pixel_coefficient ? parent.pixel_coefficient + first * parent.filter_size : 0),
+    pixel_coefficient_float(parent.pixel_coefficient_float ? parent.pixel_coefficient_float + first * parent.filter_size : 0),
+    Env(NULL)
+  {
+    // Source offsets stay as they are, the first unsafe target pixel is
+    // counted from the start of the window
+    overread_possible = parent.overread_possible && (parent.source_overread_beyond_targetx < first + count);
+    source_overread_offset = overread_possible ? parent.source_overread_offset : -1;
+    source_overread_beyond_targetx = overread_possible ? max(parent.source_overread_beyond_targetx - first, 0) : -1;
+  };
+
   ~ResamplingProgram() {
+    if (Env == NULL)
+      return;
     Env->Free(pixel_offset);
     Env->Free(pixel_coefficient);
     Env->Free(pixel_coefficient_float);
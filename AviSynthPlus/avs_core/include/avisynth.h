@@ -949,6 +949,21 @@ enum CachePolicyHint {
   CACHE_IS_MTGUARD_REQ,
   CACHE_IS_MTGUARD_ANS,
 
+  CACHE_SET_AUDIO_READAHEAD,        // Samples to read ahead of sequential audio requests, -1 = a quarter of the cache
+  CACHE_GET_AUDIO_READAHEAD,
+  CACHE_GET_AUDIO_HITS,             // Audio requests served entirely from the cache
+  CACHE_GET_AUDIO_MISSES,           // Audio requests that needed the child
+
+  CACHE_GET_PREFETCH_SCHEDULED,     // Frames a Prefetcher has queued on its own
+  CACHE_GET_PREFETCH_HITS,          // Requests a Prefetcher served from prefetched frames
+  CACHE_GET_PREFETCH_DECLARED,      // Frames a Prefetcher has fetched because a filter declared them
+
+  CACHE_GET_FRAME_HITS,             // Frame requests served from the cache
+  CACHE_GET_FRAME_MISSES,           // Frame requests that needed the child
+  CACHE_GET_GHOST_HITS,             // Misses on frames that had been evicted not long before
+  CACHE_GET_REUSE_GAP,              // Slots the cache lacked on average to turn those into hits
+  CACHE_GET_RECOMPUTE_COST,         // Average time of a child GetFrame on a miss, in microseconds
+
   CACHE_USER_CONSTANTS = 1000       // Smaller values are reserved for the core
 
 };
@@ -1283,7 +1298,8 @@ enum AvsEnvProperty
   AEP_THREADPOOL_THREADS = 3,
   AEP_FILTERCHAIN_THREADS = 4,
   AEP_THREAD_ID = 5,
-  AEP_VERSION = 6
+  AEP_VERSION = 6,
+  AEP_FILTER_PROFILE = 7        // number of filters profiled since SetFilterProfile(), 0 if not profiling
 };
 
 enum AvsAllocType
@@ -163,6 +163,23 @@ void __stdcall SSRC::GetAudio(void* buf, __int64 start, __int64 count, IScriptEn
 
 }
 
+int __stdcall SSRC::SetCacheHints(int cachehints, int frame_range) {
+
+  // Seeking restarts the resampler, let the parent cache absorb overlapping requests
+
+  switch (cachehints) {
+    case CACHE_GETCHILD_AUDIO_MODE: // Parent Cache asking Child for desired audio cache mode
+      return CACHE_AUDIO_AUTO;
+
+    case CACHE_GETCHILD_AUDIO_SIZE: // Parent Cache asking Child for desired audio cache size
+      return 1024*1024;
+
+    default:
+      break;
+  }
+  return 0;
+}
+
 AVSValue __cdecl Create_SSRC(AVSValue args, void*, IScriptEnvironment* env) {
 
   PClip clip = args[0].AsClip();
@@ -167,6 +167,20 @@ void __stdcall GetAudio(void* buf, __int64 start, __int64 count, IScriptEnvironm
   next_sample += count;
 }
 
+int __stdcall SetCacheHints(int cachehints, int frame_range)
+{
+  // Seeking clears the sampler, let the parent cache absorb overlapping requests
+  switch (cachehints) {
+    case CACHE_GETCHILD_AUDIO_MODE:
+      return CACHE_AUDIO_AUTO;
+    case CACHE_GETCHILD_AUDIO_SIZE:
+      return 1024*1024;
+    default:
+      break;
+  }
+  return 0;
+}
+
 ~AVSsoundtouch()
 {
     delete[] dstbuffer;
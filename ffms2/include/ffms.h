@@ -22,7 +22,7 @@
 #define FFMS_H
 
 // Version format: major - minor - micro - bump
-#define FFMS_VERSION ((2 << 24) | (30 << 16) | (0 << 8) | 0)
+#define FFMS_VERSION ((2 << 24) | (31 << 16) | (0 << 8) | 0)
 
 #include <stdint.h>
 #include <stddef.h>
@@ -332,6 +332,8 @@ typedef struct FFMS_Frame {
     int HasContentLightLevel; /* Non-zero if the 2 fields below are valid */
     unsigned int ContentLightLevelMax;
     unsigned int ContentLightLevelAverage;
+    /* Introduced in FFMS_VERSION ((2 << 24) | (31 << 16) | (0 << 8) | 0) */
+    void *AllocatorOpaque; /* Non-NULL if Data points into a buffer from the FFMS_SetFrameAllocatorV callback */
 } FFMS_Frame;
 
 typedef struct FFMS_TrackTimeBase {
@@ -396,6 +398,8 @@ typedef struct FFMS_AudioProperties {
 } FFMS_AudioProperties;
 
 typedef int (FFMS_CC *TIndexCallback)(int64_t Current, int64_t Total, void *ICPrivate);
+typedef int (FFMS_CC *TAllocateFrameCallback)(int PixelFormat, int Width, int Height, int Alignment, uint8_t *Data[4], int Linesize[4], void **Opaque, void *AFPrivate);
+typedef void (FFMS_CC *TReleaseFrameCallback)(void *Opaque, void *AFPrivate);
 
 /* Most functions return 0 on success */
 /* Functions without error message output can be assumed to never fail in a graceful way */
@@ -417,6 +421,8 @@ FFMS_API(int) FFMS_SetOutputFormatV2(FFMS_VideoSource *V, const int *TargetForma
 FFMS_API(void) FFMS_ResetOutputFormatV(FFMS_VideoSource *V);
 FFMS_API(int) FFMS_SetInputFormatV(FFMS_VideoSource *V, int ColorSpace, int ColorRange, int Format, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((2 << 24) | (17 << 16) | (1 << 8) | 0) */
 FFMS_API(void) FFMS_ResetInputFormatV(FFMS_VideoSource *V);
+FFMS_API(int) FFMS_SetCacheOptionsV(FFMS_VideoSource *V, int CachedFrames, int Decoders, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((2 << 24) | (31 << 16) | (0 << 8) | 0) */
+FFMS_API(int) FFMS_SetFrameAllocatorV(FFMS_VideoSource *V, TAllocateFrameCallback Allocate, TReleaseFrameCallback Release, void *AFPrivate, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((2 << 24) | (31 << 16) | (0 << 8) | 0) */
 FFMS_API(FFMS_ResampleOptions *) FFMS_CreateResampleOptions(FFMS_AudioSource *A); /* Introduced in FFMS_VERSION ((2 << 24) | (15 << 16) | (4 << 8) | 0) */
 FFMS_API(int) FFMS_SetOutputFormatA(FFMS_AudioSource *A, const FFMS_ResampleOptions*options, FFMS_ErrorInfo *ErrorInfo); /* Introduced in FFMS_VERSION ((2 << 24) | (15 << 16) | (4 << 8) | 0) */
 FFMS_API(void) FFMS_DestroyResampleOptions(FFMS_ResampleOptions *options); /* Introduced in FFMS_VERSION ((2 << 24) | (15 << 16) | (4 << 8) | 0) */
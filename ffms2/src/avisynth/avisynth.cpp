@@ -22,7 +22,9 @@
 #include "ffms.h"
 #include "avssources.h"
 #include "../core/utils.h"
+#include <algorithm>
 #include <iostream>
+#include <thread>
 
 int FFMS_CC UpdateProgress(int64_t Current, int64_t Total, void *Private) {
 
@@ -121,6 +123,7 @@ static AVSValue __cdecl CreateFFVideoSource(AVSValue Args, void* UserData, IScri
     const char *Resizer = Args[12].AsString("BICUBIC");
     const char *ColorSpace = Args[13].AsString("");
     const char *VarPrefix = Args[14].AsString("");
+    int Instances = Args[15].AsInt(1);
 
     if (FPSDen < 1)
         Env->ThrowError("FFVideoSource: FPS denominator needs to be 1 or higher");
@@ -140,6 +143,16 @@ static AVSValue __cdecl CreateFFVideoSource(AVSValue Args, void* UserData, IScri
     if (IsSamePath(Source, Timecodes))
         Env->ThrowError("FFVideoSource: Timecodes will overwrite the source");
 
+    if (Instances < 1)
+        Env->ThrowError("FFVideoSource: Instances needs to be 1 or higher");
+
+    if (Instances > 1 && SeekMode < 1)
+        Env->ThrowError("FFVideoSource: Multiple instances require seekmode 1 or higher");
+
+    // Split the default number of decoding threads between the instances
+    if (Instances > 1 && Threads < 1)
+        Threads = (std::max)(1, static_cast<int>(std::thread::hardware_concurrency()) / Instances);
+
     ErrorInfo E;
     FFMS_Index *Index = nullptr;
     std::string DefaultCache;
@@ -201,7 +214,7 @@ static AVSValue __cdecl CreateFFVideoSource(AVSValue Args, void* UserData, IScri
     AvisynthVideoSource *Filter;
 
     try {
-        Filter = new AvisynthVideoSource(Source, Track, Index, FPSNum, FPSDen, Threads, SeekMode, RFFMode, Width, Height, Resizer, ColorSpace, VarPrefix, Env);
+        Filter = new AvisynthVideoSource(Source, Track, Index, FPSNum, FPSDen, Threads, SeekMode, RFFMode, Width, Height, Resizer, ColorSpace, VarPrefix, Instances, Env);
     } catch (...) {
         FFMS_DestroyIndex(Index);
         throw;
@@ -379,7 +392,7 @@ extern "C" __declspec(dllexport) const char* __stdcall AvisynthPluginInit3(IScri
     AVS_linkage = vectors;
 
     Env->AddFunction("FFIndex", "[source]s[cachefile]s[indexmask]i[errorhandling]i[overwrite]b", CreateFFIndex, nullptr);
-    Env->AddFunction("FFVideoSource", "[source]s[track]i[cache]b[cachefile]s[fpsnum]i[fpsden]i[threads]i[timecodes]s[seekmode]i[rffmode]i[width]i[height]i[resizer]s[colorspace]s[varprefix]s", CreateFFVideoSource, nullptr);
+    Env->AddFunction("FFVideoSource", "[source]s[track]i[cache]b[cachefile]s[fpsnum]i[fpsden]i[threads]i[timecodes]s[seekmode]i[rffmode]i[width]i[height]i[resizer]s[colorspace]s[varprefix]s[instances]i", CreateFFVideoSource, nullptr);
     Env->AddFunction("FFAudioSource", "[source]s[track]i[cache]b[cachefile]s[adjustdelay]i[varprefix]s", CreateFFAudioSource, nullptr);
 
     Env->AddFunction("FFmpegSource2", "[source]s[vtrack]i[atrack]i[cache]b[cachefile]s[fpsnum]i[fpsden]i[threads]i[timecodes]s[seekmode]i[overwrite]b[width]i[height]i[resizer]s[colorspace]s[rffmode]i[adjustdelay]i[varprefix]s", CreateFFmpegSource2, nullptr);
@@ -115,7 +115,7 @@ static AVPixelFormat CSNameToPIXFMT(const char *CSName, AVPixelFormat Default, b
 AvisynthVideoSource::AvisynthVideoSource(const char *SourceFile, int Track, FFMS_Index *Index,
     int FPSNum, int FPSDen, int Threads, int SeekMode, int RFFMode,
     int ResizeToWidth, int ResizeToHeight, const char *ResizerName,
-    const char *ConvertToFormatName, const char *VarPrefix, IScriptEnvironment* Env)
+    const char *ConvertToFormatName, const char *VarPrefix, int Instances, IScriptEnvironment* Env)
     : FPSNum(FPSNum)
     , FPSDen(FPSDen)
     , RFFMode(RFFMode)
@@ -131,23 +131,50 @@ AvisynthVideoSource::AvisynthVideoSource(const char *SourceFile, int Track, FFMS
     V = FFMS_CreateVideoSource(SourceFile, Track, Index, Threads, SeekMode, &E);
     if (!V)
         Env->ThrowError("FFVideoSource: %s", E.Buffer);
+    Sources.push_back(V);
+
+    // The additional decoders share the index and only differ in where they are in the file
+    for (int i = 1; i < Instances; i++) {
+        FFMS_VideoSource *Source = FFMS_CreateVideoSource(SourceFile, Track, Index, Threads, SeekMode, &E);
+        if (!Source) {
+            DestroySources();
+            Env->ThrowError("FFVideoSource: %s", E.Buffer);
+        }
+        Sources.push_back(Source);
+    }
+    SourceLocks.reset(new std::mutex[Sources.size()]);
 
     try {
         InitOutputFormat(ResizeToWidth, ResizeToHeight, ResizerName, ConvertToFormatName, Env);
+        InitFrameAllocators(Env);
     } catch (AvisynthError &) {
-        FFMS_DestroyVideoSource(V);
+        DestroySources();
         throw;
     }
 
     const FFMS_VideoProperties *VP = FFMS_GetVideoProperties(V);
 
+    if (Sources.size() > 1) {
+        // A run has to be long enough that a decoder gets to its next run by seeking
+        // rather than by decoding all the runs in between, which it does for jumps
+        // of up to 10 frames
+        int MinRunLength = 10 / static_cast<int>(Sources.size() - 1) + 1;
+        FFMS_Track *VTrack = FFMS_GetTrackFromVideo(V);
+
+        RunStarts.push_back(0);
+        for (int i = 1; i < VP->NumFrames; i++) {
+            if (FFMS_GetFrameInfo(VTrack, i)->KeyFrame && i - RunStarts.back() >= MinRunLength)
+                RunStarts.push_back(i);
+        }
+    }
+
     if (RFFMode > 0) {
         // This part assumes things, and so should you
 
         FFMS_Track *VTrack = FFMS_GetTrackFromVideo(V);
 
         if (FFMS_GetFrameInfo(VTrack, 0)->RepeatPict < 0) {
-            FFMS_DestroyVideoSource(V);
+            DestroySources();
             Env->ThrowError("FFVideoSource: No RFF flags present");
         }
 
@@ -164,7 +191,7 @@ AvisynthVideoSource::AvisynthVideoSource(const char *SourceFile, int Track, FFMS
             int RepeatPict = FFMS_GetFrameInfo(VTrack, i)->RepeatPict;
 
             if (((RepeatPict + 1) * 2) % (RepeatMin + 1)) {
-                FFMS_DestroyVideoSource(V);
+                DestroySources();
                 Env->ThrowError("FFVideoSource: Unsupported RFF flag pattern");
             }
         }
@@ -258,7 +285,28 @@ AvisynthVideoSource::AvisynthVideoSource(const char *SourceFile, int Track, FFMS
 }
 
 AvisynthVideoSource::~AvisynthVideoSource() {
-    FFMS_DestroyVideoSource(V);
+    DestroySources();
+}
+
+void AvisynthVideoSource::DestroySources() {
+    for (auto Source : Sources)
+        FFMS_DestroyVideoSource(Source);
+    Sources.clear();
+    V = nullptr;
+}
+
+int AvisynthVideoSource::SourceForFrame(int n) const {
+    if (Sources.size() == 1)
+        return 0;
+    size_t Run = std::upper_bound(RunStarts.begin(), RunStarts.end(), n) - RunStarts.begin() - 1;
+    return static_cast<int>(Run % Sources.size());
+}
+
+int AvisynthVideoSource::SetCacheHints(int cachehints, int frame_range) {
+    // A single decoder can't be shared, with several each call locks the one it needs
+    if (cachehints == CACHE_GET_MTMODE)
+        return Sources.size() > 1 ? MT_NICE_FILTER : MT_SERIALIZED;
+    return 0;
 }
 
 static int GetSubSamplingH(const VideoInfo &vi) {
@@ -359,9 +407,11 @@ void AvisynthVideoSource::InitOutputFormat(
     TargetFormats.push_back(-1);
 
     // This trick is required to first get the "best" default format and then set only that format as the output
-    if (FFMS_SetOutputFormatV2(V, TargetFormats.data(),
-        ResizeToWidth, ResizeToHeight, Resizer, &E))
-        Env->ThrowError("FFVideoSource: No suitable output format found");
+    for (auto Source : Sources) {
+        if (FFMS_SetOutputFormatV2(Source, TargetFormats.data(),
+            ResizeToWidth, ResizeToHeight, Resizer, &E))
+            Env->ThrowError("FFVideoSource: No suitable output format found");
+    }
 
     F = FFMS_GetFrame(V, 0, &E);
 
@@ -465,6 +515,86 @@ void AvisynthVideoSource::InitOutputFormat(
     VI.height -= VI.height % (1 << (GetSubSamplingH(VI) + (RFFMode > 0 ? 1 : 0)));
 }
 
+void AvisynthVideoSource::InitFrameAllocators(IScriptEnvironment *Env) {
+    ErrorInfo E;
+    const FFMS_Frame *F = FFMS_GetFrame(V, 0, &E);
+    if (!F)
+        Env->ThrowError("FFVideoSource: %s", E.Buffer);
+
+    // Only frames output exactly as decoded can be shared. Packed RGB is stored
+    // upside down in Avisynth and alpha planes can't be passed to Subframe.
+    if (RFFMode > 0 || !VI.IsPlanar() || VI.IsYUVA() || VI.IsPlanarRGBA() ||
+        F->ConvertedPixelFormat != F->EncodedPixelFormat ||
+        F->ScaledWidth != F->EncodedWidth || F->ScaledHeight != F->EncodedHeight)
+        return;
+
+    // Decoder threads allocate frames whenever they like, so they get the environment
+    // the clip was created with rather than the one of some GetFrame call
+    OutputPixelFormat = F->ConvertedPixelFormat;
+    Allocators.reset(new FrameAllocator[Sources.size()]);
+    for (size_t i = 0; i < Sources.size(); i++) {
+        Allocators[i].Owner = this;
+        Allocators[i].Env = Env;
+        if (FFMS_SetFrameAllocatorV(Sources[i], AllocateFrame, ReleaseFrame, &Allocators[i], &E))
+            Env->ThrowError("FFVideoSource: %s", E.Buffer);
+    }
+}
+
+int FFMS_CC AvisynthVideoSource::AllocateFrame(int PixelFormat, int Width, int Height, int Alignment, uint8_t *Data[4], int Linesize[4], void **Opaque, void *Private) {
+    FrameAllocator *Allocator = static_cast<FrameAllocator *>(Private);
+    AvisynthVideoSource *Self = Allocator->Owner;
+    const VideoInfo &VI = Self->VI;
+    if (PixelFormat != Self->OutputPixelFormat)
+        return 1;
+
+    // The decoder wants a larger picture than the clip, the part that is output is cut out later
+    VideoInfo Padded = VI;
+    int SubW = GetSubSamplingW(VI);
+    int SubH = GetSubSamplingH(VI);
+    Padded.width = ((Width + (1 << SubW) - 1) >> SubW) << SubW;
+    Padded.height = ((Height + (1 << SubH) - 1) >> SubH) << SubH;
+
+    PVideoFrame Frame;
+    try {
+        Frame = Allocator->Env->NewVideoFrame(Padded, std::max(Alignment, FRAME_ALIGN));
+    } catch (AvisynthError &) {
+        return 1;
+    }
+
+    bool Gray = Self->HighBitDepth ? VI.IsY() : VI.IsY8();
+    for (int i = 0; i < (Gray ? 1 : 3); i++) {
+        static const int YUVPlanes[] = { PLANAR_Y, PLANAR_U, PLANAR_V };
+        static const int RGBPlanes[] = { PLANAR_G, PLANAR_B, PLANAR_R };
+        int PlaneId = VI.IsRGB() ? RGBPlanes[i] : YUVPlanes[i];
+        Data[i] = Frame->GetWritePtr(PlaneId);
+        Linesize[i] = Frame->GetPitch(PlaneId);
+    }
+
+    *Opaque = new PVideoFrame(Frame);
+    return 0;
+}
+
+void FFMS_CC AvisynthVideoSource::ReleaseFrame(void *Opaque, void *Private) {
+    delete static_cast<PVideoFrame *>(Opaque);
+}
+
+PVideoFrame AvisynthVideoSource::ShareFrame(const FFMS_Frame *Frame, IScriptEnvironment *Env) {
+    // The decoder may have moved the plane pointers to crop the picture
+    const PVideoFrame &Src = *static_cast<PVideoFrame *>(Frame->AllocatorOpaque);
+    int PlaneY = VI.IsRGB() ? PLANAR_G : PLANAR_Y;
+    int Offset = static_cast<int>(Frame->Data[0] - Src->GetReadPtr(PlaneY));
+
+    if (HighBitDepth ? VI.IsY() : VI.IsY8())
+        return Env->Subframe(Src, Offset, Src->GetPitch(PlaneY), VI.RowSize(PlaneY), VI.height);
+
+    int PlaneU = VI.IsRGB() ? PLANAR_B : PLANAR_U;
+    int PlaneV = VI.IsRGB() ? PLANAR_R : PLANAR_V;
+    int OffsetU = static_cast<int>(Frame->Data[1] - Src->GetReadPtr(PlaneU));
+    int OffsetV = static_cast<int>(Frame->Data[2] - Src->GetReadPtr(PlaneV));
+    return Env->SubframePlanar(Src, Offset, Src->GetPitch(PlaneY), VI.RowSize(PlaneY), VI.height,
+        OffsetU, OffsetV, Src->GetPitch(PlaneU));
+}
+
 static void BlitPlane(const FFMS_Frame *Frame, PVideoFrame &Dst, IScriptEnvironment *Env, int Plane, int PlaneId) {
     Env->BitBlt(Dst->GetWritePtr(PlaneId), Dst->GetPitch(PlaneId),
         Frame->Data[Plane], Frame->Linesize[Plane],
@@ -524,19 +654,29 @@ void AvisynthVideoSource::OutputField(const FFMS_Frame *Frame, PVideoFrame &Dst,
 PVideoFrame AvisynthVideoSource::GetFrame(int n, IScriptEnvironment *Env) {
     n = std::min(std::max(n, 0), VI.num_frames - 1);
 
-    PVideoFrame Dst = Env->NewVideoFrame(VI);
+    PVideoFrame Dst;
 
     ErrorInfo E;
     if (RFFMode > 0) {
-        const FFMS_Frame *Frame = FFMS_GetFrame(V, std::min(FieldList[n].Top, FieldList[n].Bottom), &E);
-        if (Frame == nullptr)
-            Env->ThrowError("FFVideoSource: %s", E.Buffer);
-        if (FieldList[n].Top == FieldList[n].Bottom) {
-            OutputFrame(Frame, Dst, Env);
-        } else {
-            int FirstField = std::min(FieldList[n].Top, FieldList[n].Bottom) == FieldList[n].Bottom;
-            OutputField(Frame, Dst, FirstField, Env);
-            Frame = FFMS_GetFrame(V, std::max(FieldList[n].Top, FieldList[n].Bottom), &E);
+        Dst = Env->NewVideoFrame(VI);
+        int First = std::min(FieldList[n].Top, FieldList[n].Bottom);
+        int Second = std::max(FieldList[n].Top, FieldList[n].Bottom);
+        int FirstField = First == FieldList[n].Bottom;
+        {
+            int S = SourceForFrame(First);
+            std::lock_guard<std::mutex> Lock(SourceLocks[S]);
+            const FFMS_Frame *Frame = FFMS_GetFrame(Sources[S], First, &E);
+            if (Frame == nullptr)
+                Env->ThrowError("FFVideoSource: %s", E.Buffer);
+            if (First == Second)
+                OutputFrame(Frame, Dst, Env);
+            else
+                OutputField(Frame, Dst, FirstField, Env);
+        }
+        if (First != Second) {
+            int S = SourceForFrame(Second);
+            std::lock_guard<std::mutex> Lock(SourceLocks[S]);
+            const FFMS_Frame *Frame = FFMS_GetFrame(Sources[S], Second, &E);
             if (Frame == nullptr)
                 Env->ThrowError("FFVideoSource: %s", E.Buffer);
             OutputField(Frame, Dst, !FirstField, Env);
@@ -546,12 +686,20 @@ PVideoFrame AvisynthVideoSource::GetFrame(int n, IScriptEnvironment *Env) {
     } else {
         const FFMS_Frame *Frame;
 
+        // Only locality matters when picking the decoder so the source frame is
+        // simply estimated for CFR output
+        int SourceFrame = n;
+        if (FPSNum > 0 && FPSDen > 0)
+            SourceFrame = static_cast<int>(n * static_cast<int64_t>(FFMS_GetVideoProperties(V)->NumFrames) / VI.num_frames);
+        int S = SourceForFrame(SourceFrame);
+        std::lock_guard<std::mutex> Lock(SourceLocks[S]);
+
         if (FPSNum > 0 && FPSDen > 0) {
-            Frame = FFMS_GetFrameByTime(V, FFMS_GetVideoProperties(V)->FirstTime +
+            Frame = FFMS_GetFrameByTime(Sources[S], FFMS_GetVideoProperties(V)->FirstTime +
                 (double)(n * (int64_t)FPSDen) / FPSNum, &E);
             Env->SetVar(Env->Sprintf("%s%s", this->VarPrefix, "FFVFR_TIME"), -1);
         } else {
-            Frame = FFMS_GetFrame(V, n, &E);
+            Frame = FFMS_GetFrame(Sources[S], n, &E);
             FFMS_Track *T = FFMS_GetTrackFromVideo(V);
             const FFMS_TrackTimeBase *TB = FFMS_GetTimeBase(T);
             Env->SetVar(Env->Sprintf("%s%s", this->VarPrefix, "FFVFR_TIME"), static_cast<int>(FFMS_GetFrameInfo(T, n)->PTS * static_cast<double>(TB->Num) / TB->Den));
@@ -561,7 +709,12 @@ PVideoFrame AvisynthVideoSource::GetFrame(int n, IScriptEnvironment *Env) {
             Env->ThrowError("FFVideoSource: %s", E.Buffer);
 
         Env->SetVar(Env->Sprintf("%s%s", this->VarPrefix, "FFPICT_TYPE"), static_cast<int>(Frame->PictType));
-        OutputFrame(Frame, Dst, Env);
+        if (Frame->AllocatorOpaque) {
+            Dst = ShareFrame(Frame, Env);
+        } else {
+            Dst = Env->NewVideoFrame(VI);
+            OutputFrame(Frame, Dst, Env);
+        }
     }
 
     return Dst;
@@ -21,6 +21,8 @@
 #ifndef FFAVSSOURCES_H
 #define FFAVSSOURCES_H
 
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <windows.h>
 #include <avisynth.h>
@@ -43,6 +45,18 @@ class AvisynthVideoSource : public IClip {
     VideoInfo VI;
     bool HighBitDepth;
     FFMS_VideoSource *V;
+    // V and any additional decoders, each with a lock so they can be used from several threads at once
+    std::vector<FFMS_VideoSource *> Sources;
+    std::unique_ptr<std::mutex[]> SourceLocks;
+    // First frame of each run of whole GOPs, the runs are handed to the decoders in turn
+    std::vector<int> RunStarts;
+    // Lets the decoders decode straight into Avisynth frames, one per source
+    struct FrameAllocator {
+        AvisynthVideoSource *Owner;
+        IScriptEnvironment *Env; // set once at construction, read from decoder threads
+    };
+    std::unique_ptr<FrameAllocator[]> Allocators;
+    int OutputPixelFormat;
     int FPSNum;
     int FPSDen;
     int RFFMode;
@@ -53,14 +67,20 @@ class AvisynthVideoSource : public IClip {
         const char *ResizerName, const char *ConvertToFormatName, IScriptEnvironment *Env);
     void OutputFrame(const FFMS_Frame *Frame, PVideoFrame &Dst, IScriptEnvironment *Env);
     void OutputField(const FFMS_Frame *Frame, PVideoFrame &Dst, int Field, IScriptEnvironment *Env);
+    int SourceForFrame(int n) const;
+    void DestroySources();
+    void InitFrameAllocators(IScriptEnvironment *Env);
+    static int FFMS_CC AllocateFrame(int PixelFormat, int Width, int Height, int Alignment, uint8_t *Data[4], int Linesize[4], void **Opaque, void *Private);
+    static void FFMS_CC ReleaseFrame(void *Opaque, void *Private);
+    PVideoFrame ShareFrame(const FFMS_Frame *Frame, IScriptEnvironment *Env);
 public:
     AvisynthVideoSource(const char *SourceFile, int Track, FFMS_Index *Index,
         int FPSNum, int FPSDen, int Threads, int SeekMode, int RFFMode,
         int ResizeToWidth, int ResizeToHeight, const char *ResizerName,
-        const char *ConvertToFormatName, const char *VarPrefix, IScriptEnvironment* Env);
+        const char *ConvertToFormatName, const char *VarPrefix, int Instances, IScriptEnvironment* Env);
     ~AvisynthVideoSource();
     bool __stdcall GetParity(int n);
-    int __stdcall SetCacheHints(int cachehints, int frame_range) { return 0; }
+    int __stdcall SetCacheHints(int cachehints, int frame_range);
     const VideoInfo& __stdcall GetVideoInfo() { return VI; }
     void __stdcall GetAudio(void* Buf, __int64 Start, __int64 Count, IScriptEnvironment *Env) {}
     PVideoFrame __stdcall GetFrame(int n, IScriptEnvironment *Env);
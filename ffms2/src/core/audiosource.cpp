@@ -283,7 +283,7 @@ FFMS_AudioSource::AudioBlock *FFMS_AudioSource::CacheBlock(CacheIterator &pos) {
 }
 
 int FFMS_AudioSource::DecodeNextBlock(CacheIterator *pos) {
-    CurrentFrame = &Frames[PacketNumber];
+    CurrentFrame = Frames[PacketNumber];
 
     AVPacket Packet;
     if (!ReadPacket(&Packet))
@@ -291,8 +291,8 @@ int FFMS_AudioSource::DecodeNextBlock(CacheIterator *pos) {
             "ReadPacket unexpectedly failed to read a packet");
 
     // ReadPacket may have changed the packet number
-    CurrentFrame = &Frames[PacketNumber];
-    CurrentSample = CurrentFrame->SampleStart;
+    CurrentFrame = Frames[PacketNumber];
+    CurrentSample = CurrentFrame.SampleStart;
 
     int NumberOfSamples = 0;
     AudioBlock *CachedBlock = nullptr;
@@ -317,10 +317,10 @@ int FFMS_AudioSource::DecodeNextBlock(CacheIterator *pos) {
     ++PacketNumber;
 
     // Add padding after the packet, if needed
-    if (!CachedBlock || CachedBlock->Samples == CurrentFrame->SampleCount)
+    if (!CachedBlock || CachedBlock->Samples == CurrentFrame.SampleCount)
         return NumberOfSamples;
 
-    const int64_t MissingSamples = static_cast<int64_t>(CurrentFrame->SampleCount - CachedBlock->Samples);
+    const int64_t MissingSamples = static_cast<int64_t>(CurrentFrame.SampleCount - CachedBlock->Samples);
     // This can apparently happen in some rare circumstances, caused by inaccurate seeking?
     if (MissingSamples <= 0)
         return NumberOfSamples;
@@ -410,7 +410,7 @@ void FFMS_AudioSource::GetAudio(void *Buf, int64_t Start, int64_t Count) {
             // Decode until we hit the block we want
             if (PacketNumber >= Frames.size())
                 throw FFMS_Exception(FFMS_ERROR_SEEKING, FFMS_ERROR_CODEC, "Seeking is severely broken");
-            while (CurrentSample + CurrentFrame->SampleCount <= Start && PacketNumber < Frames.size())
+            while (CurrentSample + CurrentFrame.SampleCount <= Start && PacketNumber < Frames.size())
                 DecodeNextBlock(&it);
             if (CurrentSample > Start)
                 throw FFMS_Exception(FFMS_ERROR_SEEKING, FFMS_ERROR_CODEC, "Seeking is severely broken");
@@ -112,7 +112,7 @@ struct FFMS_AudioSource {
     // Next packet to be read
     size_t PacketNumber = 0;
     // Current audio frame
-    const FrameInfo *CurrentFrame = nullptr;
+    FrameInfo CurrentFrame{};
     // Track which this corresponds to
     int TrackNumber;
     // Number of packets which the demuxer requires to know where it is
@@ -216,6 +216,26 @@ FFMS_API(void) FFMS_ResetInputFormatV(FFMS_VideoSource *V) {
     V->ResetInputFormat();
 }
 
+FFMS_API(int) FFMS_SetCacheOptionsV(FFMS_VideoSource *V, int CachedFrames, int Decoders, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        V->SetCacheOptions(CachedFrames, Decoders);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
+FFMS_API(int) FFMS_SetFrameAllocatorV(FFMS_VideoSource *V, TAllocateFrameCallback Allocate, TReleaseFrameCallback Release, void *AFPrivate, FFMS_ErrorInfo *ErrorInfo) {
+    ClearErrorInfo(ErrorInfo);
+    try {
+        V->SetFrameAllocator(Allocate, Release, AFPrivate);
+    } catch (FFMS_Exception &e) {
+        return e.CopyOut(ErrorInfo);
+    }
+    return FFMS_ERROR_SUCCESS;
+}
+
 FFMS_API(FFMS_ResampleOptions *) FFMS_CreateResampleOptions(FFMS_AudioSource *A) {
     return A->CreateResampleOptions().release();
 }
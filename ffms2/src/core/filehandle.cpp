@@ -24,6 +24,16 @@
 
 #include <cstdarg>
 
+#ifdef _WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif // _WIN32
+
 extern "C" {
 #include <libavformat/avio.h>
 }
@@ -116,3 +126,135 @@ int FileHandle::Printf(const char *fmt, ...) {
 
     return avio->error < 0 ? avio->error : ret;
 }
+
+MappedFile::MappedFile(const char *filename, int error_source, int error_cause) {
+    if (Map(filename))
+        return;
+
+    FileHandle file(filename, "rb", error_source, error_cause);
+    int64_t file_size = file.Size();
+    if (static_cast<uint64_t>(file_size) > SIZE_MAX)
+        throw FFMS_Exception(error_source, FFMS_ERROR_ALLOCATION_FAILED,
+            "'" + std::string(filename) + "' is too large to be read");
+    size = static_cast<size_t>(file_size);
+    buffer.resize((size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    data = reinterpret_cast<const uint8_t *>(buffer.data());
+    if (file.Read(reinterpret_cast<char *>(buffer.data()), size) != size)
+        throw FFMS_Exception(error_source, error_cause,
+            "Failed to read from '" + std::string(filename) + "'");
+}
+
+MappedFile::MappedFile(const uint8_t *in_buffer, size_t size)
+    : size(size)
+    , buffer((size + sizeof(uint64_t) - 1) / sizeof(uint64_t)) {
+    data = reinterpret_cast<const uint8_t *>(buffer.data());
+    if (size)
+        memcpy(buffer.data(), in_buffer, size);
+}
+
+#ifdef _WIN32
+static bool WideFilename(const char *filename, std::vector<wchar_t> &wide_filename) {
+    int len = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, filename, -1, nullptr, 0);
+    if (len <= 0)
+        return false;
+    wide_filename.resize(len);
+    MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, filename, -1, wide_filename.data(), len);
+    return true;
+}
+
+bool RenameFile(const char *from, const char *to) {
+    std::vector<wchar_t> wide_from, wide_to;
+    if (!WideFilename(from, wide_from) || !WideFilename(to, wide_to))
+        return false;
+    if (MoveFileExW(wide_from.data(), wide_to.data(), MOVEFILE_REPLACE_EXISTING))
+        return true;
+
+    // A mapped file can't be replaced, but as MappedFile shares it for
+    // deletion it can be moved aside. Deleting it is only attempted, while
+    // it is still mapped that may fail and leave it behind.
+    std::wstring aside = std::wstring(wide_to.data()) + L"." + std::to_wstring(GetCurrentProcessId()) + L"." + std::to_wstring(GetTickCount()) + L".old";
+    if (!MoveFileExW(wide_to.data(), aside.c_str(), 0))
+        return false;
+    if (!MoveFileExW(wide_from.data(), wide_to.data(), 0)) {
+        MoveFileExW(aside.c_str(), wide_to.data(), 0);
+        return false;
+    }
+    HANDLE file = CreateFileW(aside.c_str(), DELETE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+    return true;
+}
+
+void RemoveFile(const char *filename) {
+    std::vector<wchar_t> wide_filename;
+    if (WideFilename(filename, wide_filename))
+        DeleteFileW(wide_filename.data());
+}
+
+bool MappedFile::Map(const char *filename) {
+    std::vector<wchar_t> wide_filename;
+    if (!WideFilename(filename, wide_filename))
+        return false;
+
+    // Shared for deletion, so that a new index can be moved in while this one is still mapped
+    HANDLE file = CreateFileW(wide_filename.data(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER file_size;
+    HANDLE file_mapping = nullptr;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0 && static_cast<uint64_t>(file_size.QuadPart) <= SIZE_MAX)
+        file_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    // The mapping keeps the file open by itself
+    CloseHandle(file);
+    if (!file_mapping)
+        return false;
+
+    void *view = MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(file_mapping);
+    if (!view)
+        return false;
+
+    mapping = view;
+    data = static_cast<const uint8_t *>(view);
+    size = static_cast<size_t>(file_size.QuadPart);
+    return true;
+}
+
+MappedFile::~MappedFile() {
+    if (mapping)
+        UnmapViewOfFile(mapping);
+}
+#else
+bool RenameFile(const char *from, const char *to) {
+    return !rename(from, to);
+}
+
+void RemoveFile(const char *filename) {
+    unlink(filename);
+}
+
+bool MappedFile::Map(const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    void *view = MAP_FAILED;
+    if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0 && static_cast<uint64_t>(st.st_size) <= SIZE_MAX)
+        view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+        return false;
+
+    mapping = view;
+    data = static_cast<const uint8_t *>(view);
+    size = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+MappedFile::~MappedFile() {
+    if (mapping)
+        munmap(mapping, size);
+}
+#endif // _WIN32
@@ -22,6 +22,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 struct AVIOContext;
 
@@ -48,3 +49,29 @@ public:
 #endif
         ;
 };
+
+// Moves 'from' over 'to', also while 'to' is mapped by a MappedFile. Fails if
+// either isn't a local file.
+bool RenameFile(const char *from, const char *to);
+void RemoveFile(const char *filename);
+
+// Read-only view of a whole file. Local files are mapped into memory; anything
+// avio can open but not map is read into an 8-byte aligned buffer instead.
+class MappedFile {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    std::vector<uint64_t> buffer;
+    void *mapping = nullptr;
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    bool Map(const char *filename);
+public:
+    MappedFile(const char *filename, int error_source, int error_cause);
+    MappedFile(const uint8_t *in_buffer, size_t size);
+    ~MappedFile();
+
+    const uint8_t *Data() const { return data; }
+    size_t Size() const { return size; }
+};
@@ -20,6 +20,7 @@
 
 #include "indexing.h"
 
+#include "filehandle.h"
 #include "track.h"
 #include "videoutils.h"
 #include "zipfile.h"
@@ -36,7 +37,41 @@ extern "C" {
 }
 
 #define INDEXID 0x53920873
-#define INDEX_VERSION 5
+#define INDEX_VERSION 6
+// The zlib compressed format used up to index version 5, which can still be read
+#define ZIP_INDEX_VERSION 5
+// The first FFMS2 version writing uncompressed indexes, older ones wrote the zlib format
+#define MAPPED_INDEX_FFMS_VERSION ((2 << 24) | (31 << 16) | (0 << 8) | 0)
+
+namespace {
+// Start of an uncompressed index. It can't be mistaken for a zlib stream,
+// which never starts with the low byte of INDEXID. The tracks follow.
+struct MappedIndexHeader {
+    uint32_t ID;
+    uint32_t Version;
+    uint16_t IndexVersion;
+    uint16_t Reserved;
+    uint32_t Tracks;
+    int32_t ErrorHandling;
+    uint32_t AVUtilVersion;
+    uint32_t AVFormatVersion;
+    uint32_t AVCodecVersion;
+    uint32_t SWScaleVersion;
+    uint32_t Reserved2;
+    int64_t Filesize;
+    uint8_t Digest[20];
+    uint32_t Reserved3;
+};
+
+static_assert(sizeof(MappedIndexHeader) == 72, "MappedIndexHeader must not contain padding");
+
+bool IsMappedIndex(const uint8_t *Data, size_t Size) {
+    uint32_t ID = 0;
+    if (Size >= sizeof(ID))
+        memcpy(&ID, Data, sizeof(ID));
+    return ID == INDEXID;
+}
+}
 
 SharedAVContext::~SharedAVContext() {
     avcodec_free_context(&CodecContext);
@@ -102,38 +137,105 @@ bool FFMS_Index::CompareFileSignature(const char *Filename) {
     return (CFilesize == Filesize && !memcmp(CDigest, Digest, sizeof(Digest)));
 }
 
-void FFMS_Index::WriteIndex(ZipFile &zf) {
+void FFMS_Index::WriteIndex(std::vector<uint8_t> &Stream) {
     // Write the index file header
-    zf.Write<uint32_t>(INDEXID);
-    zf.Write<uint32_t>(FFMS_VERSION);
-    zf.Write<uint16_t>(INDEX_VERSION);
-    zf.Write<uint32_t>(size());
-    zf.Write<uint32_t>(ErrorHandling);
-    zf.Write<uint32_t>(avutil_version());
-    zf.Write<uint32_t>(avformat_version());
-    zf.Write<uint32_t>(avcodec_version());
-    zf.Write<uint32_t>(swscale_version());
-    zf.Write<int64_t>(Filesize);
-    zf.Write(Digest);
+    MappedIndexHeader Header{};
+    Header.ID = INDEXID;
+    Header.Version = FFMS_VERSION;
+    Header.IndexVersion = INDEX_VERSION;
+    Header.Tracks = static_cast<uint32_t>(size());
+    Header.ErrorHandling = ErrorHandling;
+    Header.AVUtilVersion = avutil_version();
+    Header.AVFormatVersion = avformat_version();
+    Header.AVCodecVersion = avcodec_version();
+    Header.SWScaleVersion = swscale_version();
+    Header.Filesize = Filesize;
+    memcpy(Header.Digest, Digest, sizeof(Digest));
+
+    Stream.resize(sizeof(Header));
+    memcpy(Stream.data(), &Header, sizeof(Header));
 
     for (size_t i = 0; i < size(); ++i)
-        at(i).Write(zf);
+        at(i).Write(Stream);
+}
 
-    zf.Finish();
+static void WriteStreamToFile(const char *Filename, std::vector<uint8_t> const& Stream) {
+    FileHandle file(Filename, "wb", FFMS_ERROR_PARSER, FFMS_ERROR_FILE_WRITE);
+    const size_t ChunkSize = 1 << 24;
+    for (size_t Pos = 0; Pos < Stream.size(); Pos += ChunkSize)
+        file.Write(reinterpret_cast<const char *>(Stream.data() + Pos), std::min(ChunkSize, Stream.size() - Pos));
 }
 
 void FFMS_Index::WriteIndexFile(const char *IndexFile) {
-    ZipFile zf(IndexFile, "wb");
+    std::vector<uint8_t> Stream;
+    WriteIndex(Stream);
+
+    // Whoever still has the old file mapped keeps seeing it, truncating it
+    // instead would pull the data out from under them. Files that can't be
+    // replaced that way are overwritten.
+    std::string TempFile = std::string(IndexFile) + ".tmp";
+    try {
+        WriteStreamToFile(TempFile.c_str(), Stream);
+        if (RenameFile(TempFile.c_str(), IndexFile))
+            return;
+    } catch (FFMS_Exception const&) {
+    }
+    RemoveFile(TempFile.c_str());
 
-    WriteIndex(zf);
+    WriteStreamToFile(IndexFile, Stream);
 }
 
 uint8_t *FFMS_Index::WriteIndexBuffer(size_t *Size) {
-    ZipFile zf;
+    std::vector<uint8_t> Stream;
+    WriteIndex(Stream);
 
-    WriteIndex(zf);
+    uint8_t *ret = static_cast<uint8_t *>(av_malloc(Stream.size()));
+    if (ret == nullptr)
+        throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_ALLOCATION_FAILED, "Failed to allocate index return buffer");
 
-    return zf.GetBuffer(Size);
+    memcpy(ret, Stream.data(), Stream.size());
+    *Size = Stream.size();
+
+    return ret;
+}
+
+void FFMS_Index::ReadIndex(std::shared_ptr<MappedFile> const& File, const char *IndexFile) {
+    if (File->Size() < sizeof(MappedIndexHeader))
+        throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
+            std::string("'") + IndexFile + "' is truncated or corrupt");
+
+    MappedIndexHeader Header;
+    memcpy(&Header, File->Data(), sizeof(Header));
+
+    if (Header.Version != FFMS_VERSION)
+        throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
+            std::string("'") + IndexFile + "' was not created with the expected FFMS2 version");
+
+    if (Header.IndexVersion != INDEX_VERSION)
+        throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
+            std::string("'") + IndexFile + "' is not the expected index version");
+
+    ErrorHandling = Header.ErrorHandling;
+
+    if (Header.AVUtilVersion != avutil_version() ||
+        Header.AVFormatVersion != avformat_version() ||
+        Header.AVCodecVersion != avcodec_version() ||
+        Header.SWScaleVersion != swscale_version())
+        throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
+            std::string("A different FFmpeg build was used to create '") + IndexFile + "'");
+
+    Filesize = Header.Filesize;
+    memcpy(Digest, Header.Digest, sizeof(Digest));
+
+    if (Header.Tracks > File->Size() / sizeof(MappedIndexHeader))
+        throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
+            std::string("'") + IndexFile + "' is truncated or corrupt");
+
+    // The tracks only keep pointers into the file, the frames themselves are never copied
+    uint64_t Offset = sizeof(Header);
+    reserve(Header.Tracks);
+    for (size_t i = 0; i < Header.Tracks; ++i)
+        emplace_back(File, Offset, IndexFile);
 }
 
 void FFMS_Index::ReadIndex(ZipFile &zf, const char *IndexFile) {
@@ -142,11 +244,13 @@ void FFMS_Index::ReadIndex(ZipFile &zf, const char *IndexFile) {
         throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
             std::string("'") + IndexFile + "' is not a valid index file");
 
-    if (zf.Read<uint32_t>() != FFMS_VERSION)
+    // The format didn't change within index version 5, so any version before
+    // the uncompressed format will do
+    if (zf.Read<uint32_t>() >= MAPPED_INDEX_FFMS_VERSION)
         throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
             std::string("'") + IndexFile + "' was not created with the expected FFMS2 version");
 
-    if (zf.Read<uint16_t>() != INDEX_VERSION)
+    if (zf.Read<uint16_t>() != ZIP_INDEX_VERSION)
         throw FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
             std::string("'") + IndexFile + "' is not the expected index version");
 
@@ -176,14 +280,23 @@ void FFMS_Index::ReadIndex(ZipFile &zf, const char *IndexFile) {
 }
 
 FFMS_Index::FFMS_Index(const char *IndexFile) {
-    ZipFile zf(IndexFile, "rb");
+    auto File = std::make_shared<MappedFile>(IndexFile, FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ);
+    if (IsMappedIndex(File->Data(), File->Size())) {
+        ReadIndex(File, IndexFile);
+        return;
+    }
 
+    ZipFile zf(IndexFile, "rb");
     ReadIndex(zf, IndexFile);
 }
 
 FFMS_Index::FFMS_Index(const uint8_t *Buffer, size_t Size) {
-    ZipFile zf(Buffer, Size);
+    if (IsMappedIndex(Buffer, Size)) {
+        ReadIndex(std::make_shared<MappedFile>(Buffer, Size), "User supplied buffer");
+        return;
+    }
 
+    ZipFile zf(Buffer, Size);
     ReadIndex(zf, "User supplied buffer");
 }
 
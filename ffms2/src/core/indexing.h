@@ -32,6 +32,7 @@ extern "C" {
 #include <libavutil/avutil.h>
 }
 
+class MappedFile;
 class Wave64Writer;
 class ZipFile;
 
@@ -46,7 +47,8 @@ struct FFMS_Index : public std::vector<FFMS_Track> {
     FFMS_Index(FFMS_Index const&) = delete;
     FFMS_Index& operator=(FFMS_Index const&) = delete;
     void ReadIndex(ZipFile &zf, const char* IndexFile);
-    void WriteIndex(ZipFile &zf);
+    void ReadIndex(std::shared_ptr<MappedFile> const& File, const char* IndexFile);
+    void WriteIndex(std::vector<uint8_t> &Stream);
 public:
     static void CalculateFileSignature(const char *Filename, int64_t *Filesize, uint8_t Digest[20]);
 
@@ -25,6 +25,7 @@
 #include "indexing.h"
 
 #include <algorithm>
+#include <cstring>
 
 extern "C" {
 #include <libavutil/avutil.h>
@@ -51,20 +52,90 @@ FrameInfo ReadFrame(ZipFile &stream, FrameInfo const& prev, const FFMS_TrackType
     return f;
 }
 
-static void WriteFrame(ZipFile &stream, FrameInfo const& f, FrameInfo const& prev, const FFMS_TrackType TT) {
-    stream.Write(f.PTS - prev.PTS);
-    stream.Write(f.OriginalPTS - prev.OriginalPTS);
-    stream.Write<int8_t>(f.KeyFrame);
-    stream.Write(f.FilePos - prev.FilePos);
-    stream.Write<uint8_t>(f.Hidden);
+enum {
+    FLAG_KEYFRAME = 1,
+    FLAG_HIDDEN = 2
+};
+
+enum {
+    COLUMN_PTS,
+    COLUMN_ORIGINAL_PTS,
+    COLUMN_FILE_POS,
+    COLUMN_SAMPLE_START,
+    COLUMN_SAMPLE_COUNT,
+    COLUMN_ORIGINAL_POS,
+    COLUMN_REPEAT_PICT,
+    COLUMN_FLAGS,
+    COLUMN_COUNT
+};
+
+const size_t ColumnWidth[COLUMN_COUNT] = { 8, 8, 8, 8, 4, 4, 4, 1 };
+
+// How a track is stored in an uncompressed index. The header is followed by
+// the columns, each starting on an 8 byte boundary. Column offsets are from
+// the start of the file and 0 for the columns the track type doesn't have.
+struct MappedTrackHeader {
+    int32_t TT;
+    uint8_t UseDTS;
+    uint8_t HasTS;
+    uint8_t Reserved[2];
+    int32_t MaxBFrames;
+    int32_t Reserved2;
+    int64_t TBNum;
+    int64_t TBDen;
+    int64_t LastDuration;
+    uint64_t NumFrames;
+    uint64_t Columns[COLUMN_COUNT];
+};
+
+static_assert(sizeof(MappedTrackHeader) == 112, "MappedTrackHeader must not contain padding");
+
+bool HasColumn(FFMS_TrackType TT, int Column) {
+    switch (Column) {
+    case COLUMN_SAMPLE_START:
+    case COLUMN_SAMPLE_COUNT:
+        return TT == FFMS_TYPE_AUDIO;
+    case COLUMN_ORIGINAL_POS:
+    case COLUMN_REPEAT_PICT:
+        return TT == FFMS_TYPE_VIDEO;
+    default:
+        return true;
+    }
+}
 
-    if (TT == FFMS_TYPE_AUDIO)
-        stream.Write(f.SampleCount - prev.SampleCount);
-    else if (TT == FFMS_TYPE_VIDEO) {
-        stream.Write(static_cast<uint64_t>(f.OriginalPos) - prev.OriginalPos - 1);
-        stream.Write<int32_t>(f.RepeatPict);
+uint64_t AlignColumn(uint64_t Offset) {
+    return (Offset + 7) & ~static_cast<uint64_t>(7);
+}
+
+template<typename T, typename Field>
+uint64_t WriteColumn(std::vector<uint8_t> &stream, FFMS_Track const& track, Field field) {
+    stream.resize(static_cast<size_t>(AlignColumn(stream.size())));
+    size_t offset = stream.size();
+    stream.resize(offset + track.size() * sizeof(T));
+    for (size_t i = 0; i < track.size(); ++i) {
+        T value = static_cast<T>(field(track[i]));
+        memcpy(stream.data() + offset + i * sizeof(T), &value, sizeof(T));
     }
+    return offset;
+}
 }
+
+FrameInfo FFMS_Track::FrameColumns::Get(size_t i) const {
+    FrameInfo f{};
+    f.PTS = PTS[i];
+    f.OriginalPTS = OriginalPTS[i];
+    f.FilePos = FilePos[i];
+    f.KeyFrame = !!(Flags[i] & FLAG_KEYFRAME);
+    f.Hidden = !!(Flags[i] & FLAG_HIDDEN);
+
+    if (TT == FFMS_TYPE_AUDIO) {
+        f.SampleStart = SampleStart[i];
+        f.SampleCount = SampleCount[i];
+    } else if (TT == FFMS_TYPE_VIDEO) {
+        f.OriginalPos = OriginalPos[i];
+        f.RepeatPict = RepeatPict[i];
+    }
+    return f;
 }
 
 FFMS_Track::FFMS_Track()
@@ -100,27 +171,87 @@ FFMS_Track::FFMS_Track(ZipFile &stream)
     Frames.reserve(FrameCount);
     for (size_t i = 0; i < FrameCount; ++i)
         Frames.push_back(ReadFrame(stream, i == 0 ? temp : Frames.back(), TT));
-
-    if (TT == FFMS_TYPE_VIDEO)
-        GeneratePublicInfo();
 }
 
-void FFMS_Track::Write(ZipFile &stream) const {
-    frame_vec &Frames = Data->Frames;
-    stream.Write<uint8_t>(TT);
-    stream.Write(TB.Num);
-    stream.Write(TB.Den);
-    stream.Write<int64_t>(LastDuration);
-    stream.Write<int32_t>(MaxBFrames);
-    stream.Write<uint8_t>(UseDTS);
-    stream.Write<uint8_t>(HasTS);
-    stream.Write<uint64_t>(size());
+FFMS_Track::FFMS_Track(std::shared_ptr<MappedFile> const& Storage, uint64_t &Offset, const char *IndexFile)
+    : Data(std::make_shared<TrackData>()) {
+    const uint64_t FileSize = Storage->Size();
+    const auto Corrupt = [&] {
+        return FFMS_Exception(FFMS_ERROR_PARSER, FFMS_ERROR_FILE_READ,
+            std::string("'") + IndexFile + "' is truncated or corrupt");
+    };
+
+    Offset = AlignColumn(Offset);
+    if (Offset > FileSize || FileSize - Offset < sizeof(MappedTrackHeader))
+        throw Corrupt();
+    MappedTrackHeader Header;
+    memcpy(&Header, Storage->Data() + Offset, sizeof(Header));
+    Offset += sizeof(Header);
+
+    TT = static_cast<FFMS_TrackType>(Header.TT);
+    TB.Num = Header.TBNum;
+    TB.Den = Header.TBDen;
+    LastDuration = Header.LastDuration;
+    MaxBFrames = Header.MaxBFrames;
+    UseDTS = !!Header.UseDTS;
+    HasTS = !!Header.HasTS;
+
+    // Nothing is read here, the frames are only looked up in the columns when needed
+    const uint8_t *Columns[COLUMN_COUNT] = {};
+    for (int i = 0; i < COLUMN_COUNT; ++i) {
+        if (!HasColumn(TT, i))
+            continue;
+        uint64_t Start = Header.Columns[i];
+        if (Start % 8 || Start > FileSize || Header.NumFrames > (FileSize - Start) / ColumnWidth[i])
+            throw Corrupt();
+        Columns[i] = Storage->Data() + Start;
+        Offset = std::max(Offset, Start + Header.NumFrames * ColumnWidth[i]);
+    }
 
-    if (empty()) return;
+    FrameColumns &C = Data->Columns;
+    C.TT = TT;
+    C.PTS = reinterpret_cast<const int64_t *>(Columns[COLUMN_PTS]);
+    C.OriginalPTS = reinterpret_cast<const int64_t *>(Columns[COLUMN_ORIGINAL_PTS]);
+    C.FilePos = reinterpret_cast<const int64_t *>(Columns[COLUMN_FILE_POS]);
+    C.SampleStart = reinterpret_cast<const int64_t *>(Columns[COLUMN_SAMPLE_START]);
+    C.SampleCount = reinterpret_cast<const uint32_t *>(Columns[COLUMN_SAMPLE_COUNT]);
+    C.OriginalPos = reinterpret_cast<const uint32_t *>(Columns[COLUMN_ORIGINAL_POS]);
+    C.RepeatPict = reinterpret_cast<const int32_t *>(Columns[COLUMN_REPEAT_PICT]);
+    C.Flags = Columns[COLUMN_FLAGS];
+    Data->NumFrames = static_cast<size_t>(Header.NumFrames);
+    Data->Storage = Storage;
+}
 
-    FrameInfo temp{};
-    for (size_t i = 0; i < size(); ++i)
-        WriteFrame(stream, Frames[i], i == 0 ? temp : Frames[i - 1], TT);
+void FFMS_Track::Write(std::vector<uint8_t> &stream) const {
+    stream.resize(static_cast<size_t>(AlignColumn(stream.size())));
+    size_t HeaderOffset = stream.size();
+    stream.resize(HeaderOffset + sizeof(MappedTrackHeader));
+
+    MappedTrackHeader Header{};
+    Header.TT = TT;
+    Header.UseDTS = UseDTS;
+    Header.HasTS = HasTS;
+    Header.MaxBFrames = MaxBFrames;
+    Header.TBNum = TB.Num;
+    Header.TBDen = TB.Den;
+    Header.LastDuration = LastDuration;
+    Header.NumFrames = size();
+
+    Header.Columns[COLUMN_PTS] = WriteColumn<int64_t>(stream, *this, [](FrameInfo const& f) { return f.PTS; });
+    Header.Columns[COLUMN_ORIGINAL_PTS] = WriteColumn<int64_t>(stream, *this, [](FrameInfo const& f) { return f.OriginalPTS; });
+    Header.Columns[COLUMN_FILE_POS] = WriteColumn<int64_t>(stream, *this, [](FrameInfo const& f) { return f.FilePos; });
+    if (TT == FFMS_TYPE_AUDIO) {
+        Header.Columns[COLUMN_SAMPLE_START] = WriteColumn<int64_t>(stream, *this, [](FrameInfo const& f) { return f.SampleStart; });
+        Header.Columns[COLUMN_SAMPLE_COUNT] = WriteColumn<uint32_t>(stream, *this, [](FrameInfo const& f) { return f.SampleCount; });
+    } else if (TT == FFMS_TYPE_VIDEO) {
+        Header.Columns[COLUMN_ORIGINAL_POS] = WriteColumn<uint32_t>(stream, *this, [](FrameInfo const& f) { return f.OriginalPos; });
+        Header.Columns[COLUMN_REPEAT_PICT] = WriteColumn<int32_t>(stream, *this, [](FrameInfo const& f) { return f.RepeatPict; });
+    }
+    Header.Columns[COLUMN_FLAGS] = WriteColumn<uint8_t>(stream, *this, [](FrameInfo const& f) {
+        return (f.KeyFrame ? FLAG_KEYFRAME : 0) | (f.Hidden ? FLAG_HIDDEN : 0);
+    });
+
+    memcpy(stream.data() + HeaderOffset, &Header, sizeof(Header));
 }
 
 void FFMS_Track::AddVideoFrame(int64_t PTS, int RepeatPict, bool KeyFrame, int FrameType, int64_t FilePos, bool Hidden) {
@@ -135,7 +266,7 @@ void FFMS_Track::AddAudioFrame(int64_t PTS, int64_t SampleStart, uint32_t Sample
 }
 
 void FFMS_Track::WriteTimecodes(const char *TimecodeFile) const {
-    frame_vec &Frames = Data->Frames;
+    const FFMS_Track &Frames = *this;
     FileHandle file(TimecodeFile, "w", FFMS_ERROR_TRACK, FFMS_ERROR_FILE_WRITE);
 
     file.Printf("# timecode format v2\n");
@@ -154,16 +285,28 @@ int FFMS_Track::FrameFromPTS(int64_t PTS) const {
     F.PTS = PTS;
 
     auto Pos = std::lower_bound(begin(), end(), F, PTSComparison);
-    if (Pos == end() || Pos->PTS != PTS)
+    if (Pos == end() || (*Pos).PTS != PTS)
         return -1;
     return std::distance(begin(), Pos);
 }
 
 int FFMS_Track::FrameFromPos(int64_t Pos) const {
-    for (size_t i = 0; i < size(); i++)
-        if (Data->Frames[i].FilePos == Pos)
-            return static_cast<int>(i);
-    return -1;
+    GenerateSeekInfo();
+    std::vector<int> &PosOrder = Data->PosOrder;
+    auto Frame = std::lower_bound(PosOrder.begin(), PosOrder.end(), Pos,
+        [this](int Frame, int64_t Pos) { return FilePosAt(Frame) < Pos; });
+    if (Frame == PosOrder.end() || FilePosAt(*Frame) != Pos)
+        return -1;
+    return *Frame;
+}
+
+int FFMS_Track::FirstFrameStoredAfter(int Frame) const {
+    // Finds the run of frames right before Frame which come after it in the file,
+    // i.e. the ones that will be output after Frame if decoding starts at Frame
+    if (Frame <= 0 || FilePosAt(Frame) == -1)
+        return Frame;
+    GenerateSeekInfo();
+    return Data->PrevNotAfter[Frame] + 1;
 }
 
 int FFMS_Track::ClosestFrameFromPTS(int64_t PTS) const {
@@ -174,25 +317,36 @@ int FFMS_Track::ClosestFrameFromPTS(int64_t PTS) const {
     if (Pos == end())
         return static_cast<int>(size() - 1);
     size_t Frame = std::distance(begin(), Pos);
-    if (Pos == begin() || FFABS(Pos->PTS - PTS) <= FFABS((Pos - 1)->PTS - PTS))
+    if (Pos == begin() || FFABS((*Pos).PTS - PTS) <= FFABS(Pos[-1].PTS - PTS))
         return static_cast<int>(Frame);
     return static_cast<int>(Frame - 1);
 }
 
 int FFMS_Track::FindClosestVideoKeyFrame(int Frame) const {
-    frame_vec &Frames = Data->Frames;
+    GenerateSeekInfo();
     Frame = std::min(std::max(Frame, 0), static_cast<int>(size()) - 1);
-    for (; Frame > 0 && !Frames[Frame].KeyFrame; Frame--);
-    for (; Frame > 0 && !Frames[Frames[Frame].OriginalPos].KeyFrame; Frame--);
-    return Frame;
+
+    // The last keyframe at or before Frame, and then the last frame at or
+    // before that one which is decoded from a keyframe
+    std::vector<int> &KeyFrames = Data->KeyFrames;
+    auto Key = std::upper_bound(KeyFrames.begin(), KeyFrames.end(), Frame);
+    Frame = Key == KeyFrames.begin() ? 0 : *(Key - 1);
+
+    std::vector<int> &DecodingKeyFrames = Data->DecodingKeyFrames;
+    Key = std::upper_bound(DecodingKeyFrames.begin(), DecodingKeyFrames.end(), Frame);
+    return Key == DecodingKeyFrames.begin() ? 0 : *(Key - 1);
 }
 
 int FFMS_Track::RealFrameNumber(int Frame) const {
+    GeneratePublicInfo();
     return Data->RealFrameNumbers[Frame];
 }
 
 int FFMS_Track::VisibleFrameCount() const {
-    return TT == FFMS_TYPE_AUDIO ? static_cast<int>(Data->Frames.size()) : static_cast<int>(Data->RealFrameNumbers.size());
+    if (TT == FFMS_TYPE_AUDIO)
+        return static_cast<int>(size());
+    GeneratePublicInfo();
+    return static_cast<int>(Data->RealFrameNumbers.size());
 }
 
 void FFMS_Track::MaybeReorderFrames() {
@@ -381,26 +535,67 @@ void FFMS_Track::FinalizeTrack() {
     for (size_t i = 0; i < size(); i++)
         Frames[ReorderTemp[i]].OriginalPos = i;
 
-    GeneratePublicInfo();
+    GenerateSeekInfo();
 }
 
-void FFMS_Track::GeneratePublicInfo() {
-    frame_vec &Frames = Data->Frames;
-    std::vector<int> &RealFrameNumbers = Data->RealFrameNumbers;
-    std::vector<FFMS_FrameInfo> &PublicFrameInfo = Data->PublicFrameInfo;
-    RealFrameNumbers.reserve(size());
-    PublicFrameInfo.reserve(size());
-    for (size_t i = 0; i < size(); ++i) {
-        if (Frames[i].Hidden)
-            continue;
-        RealFrameNumbers.push_back(static_cast<int>(i));
+void FFMS_Track::GenerateSeekInfo() const {
+    std::call_once(Data->SeekInfoOnce, [this] {
+        const FFMS_Track &Frames = *this;
+        std::vector<int> &PosOrder = Data->PosOrder;
+        std::vector<int> &PrevNotAfter = Data->PrevNotAfter;
+        int NumFrames = static_cast<int>(size());
+
+        // Equal positions stay in frame order so the first one is found
+        PosOrder.resize(NumFrames);
+        for (int i = 0; i < NumFrames; ++i)
+            PosOrder[i] = i;
+        std::stable_sort(PosOrder.begin(), PosOrder.end(),
+            [this](int A, int B) { return FilePosAt(A) < FilePosAt(B); });
+
+        // Unknown positions (-1) sort before everything, which makes them
+        // stop the search for frames stored later like they should
+        std::vector<int> Earlier;
+        PrevNotAfter.resize(NumFrames);
+        for (int i = 0; i < NumFrames; ++i) {
+            FrameInfo const& f = Frames[i];
+            if (f.KeyFrame)
+                Data->KeyFrames.push_back(i);
+            if (Frames[f.OriginalPos].KeyFrame)
+                Data->DecodingKeyFrames.push_back(i);
+
+            while (!Earlier.empty() && FilePosAt(Earlier.back()) > f.FilePos)
+                Earlier.pop_back();
+            PrevNotAfter[i] = Earlier.empty() ? -1 : Earlier.back();
+            Earlier.push_back(i);
+        }
+    });
+}
 
-        FFMS_FrameInfo info = { Frames[i].PTS, Frames[i].RepeatPict, Frames[Frames[i].OriginalPos].KeyFrame, Frames[i].OriginalPTS };
-        PublicFrameInfo.push_back(info);
-    }
+void FFMS_Track::GeneratePublicInfo() const {
+    if (TT != FFMS_TYPE_VIDEO)
+        return;
+
+    // Several sources may share the track, whichever needs it first builds it
+    std::call_once(Data->PublicInfoOnce, [this] {
+        const FFMS_Track &Frames = *this;
+        std::vector<int> &RealFrameNumbers = Data->RealFrameNumbers;
+        std::vector<FFMS_FrameInfo> &PublicFrameInfo = Data->PublicFrameInfo;
+        RealFrameNumbers.reserve(size());
+        PublicFrameInfo.reserve(size());
+        for (size_t i = 0; i < size(); ++i) {
+            FrameInfo const& f = Frames[i];
+            if (f.Hidden)
+                continue;
+            RealFrameNumbers.push_back(static_cast<int>(i));
+
+            FFMS_FrameInfo info = { f.PTS, f.RepeatPict, Frames[f.OriginalPos].KeyFrame, f.OriginalPTS };
+            PublicFrameInfo.push_back(info);
+        }
+    });
 }
 
 const FFMS_FrameInfo *FFMS_Track::GetFrameInfo(size_t N) const {
+    GeneratePublicInfo();
     std::vector<FFMS_FrameInfo> &PublicFrameInfo = Data->PublicFrameInfo;
     if (N >= PublicFrameInfo.size()) return nullptr;
     return &PublicFrameInfo[N];
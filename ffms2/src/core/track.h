@@ -24,9 +24,12 @@
 #include "ffms.h"
 
 #include <cstddef>
+#include <iterator>
 #include <vector>
 #include <memory>
+#include <mutex>
 
+class MappedFile;
 class ZipFile;
 
 struct FrameInfo {
@@ -45,17 +48,53 @@ struct FrameInfo {
 struct FFMS_Track {
 private:
     typedef std::vector<FrameInfo> frame_vec;
+
+    // The frames of a track read from an uncompressed index, one array per
+    // field straight from the mapped file
+    struct FrameColumns {
+        FFMS_TrackType TT = FFMS_TYPE_UNKNOWN;
+        const int64_t *PTS = nullptr;
+        const int64_t *OriginalPTS = nullptr;
+        const int64_t *FilePos = nullptr;
+        const int64_t *SampleStart = nullptr;
+        const uint32_t *SampleCount = nullptr;
+        const uint32_t *OriginalPos = nullptr;
+        const int32_t *RepeatPict = nullptr;
+        const uint8_t *Flags = nullptr;
+
+        FrameInfo Get(size_t i) const;
+    };
+
     struct TrackData {
+        // Tracks read from an uncompressed index keep the file and leave Frames empty
         frame_vec Frames;
+        std::shared_ptr<MappedFile> Storage;
+        FrameColumns Columns;
+        size_t NumFrames = 0;
+
+        // Only built when first needed
+        std::once_flag PublicInfoOnce;
         std::vector<int> RealFrameNumbers;
         std::vector<FFMS_FrameInfo> PublicFrameInfo;
+
+        // Lookup tables for seeking, built by FinalizeTrack or when first needed
+        std::once_flag SeekInfoOnce;
+        // All frames ordered by file position
+        std::vector<int> PosOrder;
+        // Keyframes, and frames whose packet in decoding order is a keyframe
+        std::vector<int> KeyFrames;
+        std::vector<int> DecodingKeyFrames;
+        // For each frame the closest earlier frame which isn't stored after it, or -1
+        std::vector<int> PrevNotAfter;
     };
 
     std::shared_ptr<TrackData> Data;
 
     void MaybeReorderFrames();
     void FillAudioGaps();
-    void GeneratePublicInfo();
+    void GeneratePublicInfo() const;
+    void GenerateSeekInfo() const;
+    int64_t FilePosAt(size_t Frame) const { return Data->Storage ? Data->Columns.FilePos[Frame] : Data->Frames[Frame].FilePos; }
 
 public:
     FFMS_TrackType TT = FFMS_TYPE_UNKNOWN;
@@ -76,6 +115,7 @@ public:
     int FindClosestVideoKeyFrame(int Frame) const;
     int FrameFromPTS(int64_t PTS) const;
     int FrameFromPos(int64_t Pos) const;
+    int FirstFrameStoredAfter(int Frame) const;
     int ClosestFrameFromPTS(int64_t PTS) const;
     int RealFrameNumber(int Frame) const;
     int VisibleFrameCount() const;
@@ -83,31 +123,61 @@ public:
     const FFMS_FrameInfo *GetFrameInfo(size_t N) const;
 
     void WriteTimecodes(const char *TimecodeFile) const;
-    void Write(ZipFile &Stream) const;
+    void Write(std::vector<uint8_t> &Stream) const;
 
-    typedef frame_vec::allocator_type allocator_type;
     typedef frame_vec::size_type size_type;
     typedef frame_vec::difference_type difference_type;
-    typedef frame_vec::const_pointer pointer;
-    typedef frame_vec::const_reference reference;
     typedef frame_vec::value_type value_type;
-    typedef frame_vec::const_iterator iterator;
-    typedef frame_vec::const_reverse_iterator reverse_iterator;
+    // Frames may be assembled from columns, so they are always returned by value
+    typedef value_type reference;
+
+    class iterator {
+        const FFMS_Track *Track = nullptr;
+        size_type Pos = 0;
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef FFMS_Track::value_type value_type;
+        typedef FFMS_Track::difference_type difference_type;
+        typedef FFMS_Track::reference reference;
+        typedef const value_type *pointer;
+
+        iterator() {}
+        iterator(const FFMS_Track *Track, size_type Pos) : Track(Track), Pos(Pos) {}
+
+        reference operator*() const { return (*Track)[Pos]; }
+        reference operator[](difference_type n) const { return (*Track)[Pos + n]; }
+        iterator &operator++() { ++Pos; return *this; }
+        iterator &operator--() { --Pos; return *this; }
+        iterator operator++(int) { iterator Tmp = *this; ++Pos; return Tmp; }
+        iterator operator--(int) { iterator Tmp = *this; --Pos; return Tmp; }
+        iterator &operator+=(difference_type n) { Pos += n; return *this; }
+        iterator &operator-=(difference_type n) { Pos -= n; return *this; }
+        iterator operator+(difference_type n) const { return iterator(Track, Pos + n); }
+        iterator operator-(difference_type n) const { return iterator(Track, Pos - n); }
+        difference_type operator-(iterator const& Other) const { return static_cast<difference_type>(Pos) - static_cast<difference_type>(Other.Pos); }
+        bool operator==(iterator const& Other) const { return Pos == Other.Pos; }
+        bool operator!=(iterator const& Other) const { return Pos != Other.Pos; }
+        bool operator<(iterator const& Other) const { return Pos < Other.Pos; }
+        bool operator>(iterator const& Other) const { return Pos > Other.Pos; }
+        bool operator<=(iterator const& Other) const { return Pos <= Other.Pos; }
+        bool operator>=(iterator const& Other) const { return Pos >= Other.Pos; }
+    };
 
     void clear() {
         Data = std::make_shared<TrackData>();
     }
 
-    bool empty() const { return Data->Frames.empty(); }
-    size_type size() const { return Data->Frames.size(); }
-    reference operator[](size_type pos) const { return Data->Frames[pos]; }
-    reference front() const { return Data->Frames.front(); }
-    reference back() const { return Data->Frames.back(); }
-    iterator begin() const { return Data->Frames.begin(); }
-    iterator end() const { return Data->Frames.end(); }
+    bool empty() const { return size() == 0; }
+    size_type size() const { return Data->Storage ? Data->NumFrames : Data->Frames.size(); }
+    reference operator[](size_type pos) const { return Data->Storage ? Data->Columns.Get(pos) : Data->Frames[pos]; }
+    reference front() const { return (*this)[0]; }
+    reference back() const { return (*this)[size() - 1]; }
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, size()); }
 
     FFMS_Track();
     FFMS_Track(ZipFile &Stream);
+    FFMS_Track(std::shared_ptr<MappedFile> const& Storage, uint64_t &Offset, const char *IndexFile);
     FFMS_Track(int64_t Num, int64_t Den, FFMS_TrackType TT, bool HasDiscontTS, bool UseDTS, bool HasTS = true);
 };
 
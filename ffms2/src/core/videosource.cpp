@@ -22,6 +22,7 @@
 #include "indexing.h"
 #include "videoutils.h"
 #include <algorithm>
+#include <climits>
 #include <thread>
 
 
@@ -63,12 +64,14 @@ FFMS_Frame *FFMS_VideoSource::OutputFrame(AVFrame *Frame) {
             LocalFrame.Data[i] = SWSFrameData[i];
             LocalFrame.Linesize[i] = SWSFrameLinesize[i];
         }
+        LocalFrame.AllocatorOpaque = nullptr;
     } else {
         // Special case to avoid ugly casts
         for (int i = 0; i < 4; i++) {
             LocalFrame.Data[i] = Frame->data[i];
             LocalFrame.Linesize[i] = Frame->linesize[i];
         }
+        LocalFrame.AllocatorOpaque = FindAllocatorOpaque(Frame);
     }
 
     LocalFrame.EncodedWidth = Frame->width;
@@ -130,7 +133,7 @@ FFMS_Frame *FFMS_VideoSource::OutputFrame(AVFrame *Frame) {
 }
 
 FFMS_VideoSource::FFMS_VideoSource(const char *SourceFile, FFMS_Index &Index, int Track, int Threads, int SeekMode)
-    : Index(Index), SeekMode(SeekMode) {
+    : Index(Index), SeekMode(SeekMode), FileName(SourceFile) {
 
     try {
         if (Track < 0 || Track >= static_cast<int>(Index.size()))
@@ -157,49 +160,12 @@ FFMS_VideoSource::FFMS_VideoSource(const char *SourceFile, FFMS_Index &Index, in
         else
             DecodingThreads = Threads;
 
-        DecodeFrame = av_frame_alloc();
-        LastDecodedFrame = av_frame_alloc();
-
-        if (!DecodeFrame || !LastDecodedFrame)
-            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
-                "Could not allocate dummy frame.");
-
         // Dummy allocations so the unallocated case doesn't have to be handled later
         if (av_image_alloc(SWSFrameData, SWSFrameLinesize, 16, 16, AV_PIX_FMT_GRAY8, 4) < 0)
             throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
                 "Could not allocate dummy frame.");
 
-        LAVFOpenFile(SourceFile, FormatContext, VideoTrack);
-
-        AVCodec *Codec = avcodec_find_decoder(FormatContext->streams[VideoTrack]->codecpar->codec_id);
-        if (Codec == nullptr)
-            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
-                "Video codec not found");
-
-        CodecContext = avcodec_alloc_context3(Codec);
-        if (CodecContext == nullptr)
-            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
-                "Could not allocate video codec context.");
-        if (avcodec_parameters_to_context(CodecContext, FormatContext->streams[VideoTrack]->codecpar) < 0)
-            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
-                "Could not copy video decoder parameters.");
-        CodecContext->thread_count = DecodingThreads;
-        CodecContext->has_b_frames = Frames.MaxBFrames;
-
-        // Full explanation by more clever person availale here: https://github.com/Nevcairiel/LAVFilters/issues/113
-        if (CodecContext->codec_id == AV_CODEC_ID_H264 && CodecContext->has_b_frames)
-            CodecContext->has_b_frames = 15; // the maximum possible value for h264
-
-        if (avcodec_open2(CodecContext, Codec, nullptr) < 0)
-            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
-                "Could not open video codec");
-
-        // Similar yet different to h264 workaround above
-        // vc1 simply sets has_b_frames to 1 no matter how many there are so instead we set it to the max value
-        // in order to not confuse our own delay guesses later
-        // Has to be set after codec open to not be overwritten, doesn't affect actual vc1 reordering unlike h264
-        if (CodecContext->codec_id == AV_CODEC_ID_VC1 && CodecContext->has_b_frames)
-            CodecContext->has_b_frames = 7; // the maximum possible value for vc1
+        OpenDecoder();
 
         // Always try to decode a frame to make sure all required parameters are known
         int64_t DummyPTS = 0, DummyPos = 0;
@@ -256,16 +222,7 @@ FFMS_VideoSource::FFMS_VideoSource(const char *SourceFile, FFMS_Index &Index, in
             VP.Rotation = rot;
         }
 
-        if (SeekMode >= 0 && Frames.size() > 1) {
-            if (Seek(0) < 0) {
-                throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
-                    "Video track is unseekable");
-            } else {
-                avcodec_flush_buffers(CodecContext);
-                // Since we seeked to frame 0 we need to specify that frame 0 is once again the next frame that wil be decoded
-                CurrentFrame = 0;
-            }
-        }
+        RewindDecoder();
 
         // Cannot "output" without doing all other initialization
         // This is the additional mess required for seekmode=-1 to work in a reasonable way
@@ -292,6 +249,312 @@ FFMS_VideoSource::FFMS_VideoSource(const char *SourceFile, FFMS_Index &Index, in
     }
 }
 
+void FFMS_VideoSource::OpenDecoder() {
+    DecodeFrame = av_frame_alloc();
+    LastDecodedFrame = av_frame_alloc();
+
+    if (!DecodeFrame || !LastDecodedFrame)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+            "Could not allocate dummy frame.");
+
+    LAVFOpenFile(FileName.c_str(), FormatContext, VideoTrack);
+
+    AVCodec *Codec = avcodec_find_decoder(FormatContext->streams[VideoTrack]->codecpar->codec_id);
+    if (Codec == nullptr)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
+            "Video codec not found");
+
+    CodecContext = avcodec_alloc_context3(Codec);
+    if (CodecContext == nullptr)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+            "Could not allocate video codec context.");
+    if (avcodec_parameters_to_context(CodecContext, FormatContext->streams[VideoTrack]->codecpar) < 0)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
+            "Could not copy video decoder parameters.");
+    CodecContext->thread_count = DecodingThreads;
+    CodecContext->has_b_frames = Frames.MaxBFrames;
+
+    if (AllocateFrame) {
+        CodecContext->opaque = this;
+        CodecContext->get_buffer2 = GetBuffer;
+    }
+
+    // Full explanation by more clever person availale here: https://github.com/Nevcairiel/LAVFilters/issues/113
+    if (CodecContext->codec_id == AV_CODEC_ID_H264 && CodecContext->has_b_frames)
+        CodecContext->has_b_frames = 15; // the maximum possible value for h264
+
+    if (avcodec_open2(CodecContext, Codec, nullptr) < 0)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
+            "Could not open video codec");
+
+    // Similar yet different to h264 workaround above
+    // vc1 simply sets has_b_frames to 1 no matter how many there are so instead we set it to the max value
+    // in order to not confuse our own delay guesses later
+    // Has to be set after codec open to not be overwritten, doesn't affect actual vc1 reordering unlike h264
+    if (CodecContext->codec_id == AV_CODEC_ID_VC1 && CodecContext->has_b_frames)
+        CodecContext->has_b_frames = 7; // the maximum possible value for vc1
+}
+
+void FFMS_VideoSource::RewindDecoder() {
+    if (SeekMode >= 0 && Frames.size() > 1) {
+        if (Seek(0) < 0) {
+            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
+                "Video track is unseekable");
+        } else {
+            avcodec_flush_buffers(CodecContext);
+            // Since we seeked to frame 0 we need to specify that frame 0 is once again the next frame that wil be decoded
+            CurrentFrame = 0;
+        }
+    }
+}
+
+int FFMS_VideoSource::GetBuffer(AVCodecContext *Context, AVFrame *Frame, int Flags) {
+    FFMS_VideoSource *Self = static_cast<FFMS_VideoSource *>(Context->opaque);
+    if (!(Context->codec->capabilities & AV_CODEC_CAP_DR1))
+        return avcodec_default_get_buffer2(Context, Frame, Flags);
+
+    // Same padding and alignment as the default allocator, with two extra rows so
+    // that SIMD reads past the end of the last plane stay inside the buffer
+    int Width = Frame->width;
+    int Height = Frame->height;
+    int LinesizeAlign[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(Context, &Width, &Height, LinesizeAlign);
+    int Alignment = *std::max_element(LinesizeAlign, LinesizeAlign + 4);
+
+    uint8_t *Data[4] = {};
+    int Linesize[4] = {};
+    void *Opaque = nullptr;
+    if (Self->AllocateFrame(Frame->format, Width, Height + 2, Alignment, Data, Linesize, &Opaque, Self->AllocatorPrivate))
+        return avcodec_default_get_buffer2(Context, Frame, Flags);
+
+    bool Usable = Data[0] != nullptr;
+    for (int i = 0; i < 4; i++) {
+        if (Data[i] && (Linesize[i] % LinesizeAlign[i] || reinterpret_cast<uintptr_t>(Data[i]) % LinesizeAlign[i]))
+            Usable = false;
+    }
+
+    AllocatedBuffer *Buffer = nullptr;
+    if (Usable) {
+        Buffer = new AllocatedBuffer{ Self, Opaque, Self->ReleaseFrame, Self->AllocatorPrivate };
+        Frame->buf[0] = av_buffer_create(reinterpret_cast<uint8_t *>(Buffer), sizeof(AllocatedBuffer), FreeBuffer, Buffer, 0);
+    }
+    if (!Frame->buf[0]) {
+        delete Buffer;
+        Self->ReleaseFrame(Opaque, Self->AllocatorPrivate);
+        return avcodec_default_get_buffer2(Context, Frame, Flags);
+    }
+
+    {
+        std::lock_guard<std::mutex> Lock(Self->AllocatedBuffersMutex);
+        Self->AllocatedBuffers.insert(Buffer);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        Frame->data[i] = Data[i];
+        Frame->linesize[i] = Linesize[i];
+    }
+    Frame->extended_data = Frame->data;
+    return 0;
+}
+
+void FFMS_VideoSource::FreeBuffer(void *Opaque, uint8_t *) {
+    AllocatedBuffer *Buffer = static_cast<AllocatedBuffer *>(Opaque);
+    {
+        std::lock_guard<std::mutex> Lock(Buffer->Owner->AllocatedBuffersMutex);
+        Buffer->Owner->AllocatedBuffers.erase(Buffer);
+    }
+    Buffer->Release(Buffer->Opaque, Buffer->Private);
+    delete Buffer;
+}
+
+void *FFMS_VideoSource::FindAllocatorOpaque(AVFrame *Frame) {
+    if (!AllocateFrame || !Frame->buf[0])
+        return nullptr;
+    void *Buffer = av_buffer_get_opaque(Frame->buf[0]);
+    std::lock_guard<std::mutex> Lock(AllocatedBuffersMutex);
+    if (!AllocatedBuffers.count(Buffer))
+        return nullptr;
+    return static_cast<AllocatedBuffer *>(Buffer)->Opaque;
+}
+
+void FFMS_VideoSource::SetFrameAllocator(TAllocateFrameCallback Allocate, TReleaseFrameCallback Release, void *Private) {
+    if (Allocate && !Release)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+            "No release callback given");
+
+    // Decoders don't expect the layout of their buffers to change mid-stream, so
+    // everything decoded so far is dropped and decoding starts over
+    FreeDecoder();
+    for (auto &Decoder : ParkedDecoders) {
+        SwapDecoder(Decoder);
+        FreeDecoder();
+    }
+    ParkedDecoders.clear();
+    TrimFrameCache(0);
+
+    AllocateFrame = Allocate;
+    ReleaseFrame = Allocate ? Release : nullptr;
+    AllocatorPrivate = Allocate ? Private : nullptr;
+
+    CurrentFrame = 1;
+    DelayCounter = 0;
+    InitialDecode = 1;
+    SeekByPos = false;
+    PosOffset = 0;
+
+    OpenDecoder();
+    int64_t DummyPTS = 0, DummyPos = 0;
+    DecodeNextFrame(DummyPTS, DummyPos);
+    RewindDecoder();
+
+    OutputFrame(DecodeFrame);
+    LastFrameNum = 0;
+    LastFrameFromCache = false;
+}
+
+void FFMS_VideoSource::FreeDecoder() {
+    avcodec_free_context(&CodecContext);
+    avformat_close_input(&FormatContext);
+    av_frame_free(&DecodeFrame);
+    av_frame_free(&LastDecodedFrame);
+}
+
+void FFMS_VideoSource::SwapDecoder(ParkedDecoder &Decoder) {
+    std::swap(CodecContext, Decoder.CodecContext);
+    std::swap(FormatContext, Decoder.FormatContext);
+    std::swap(DecodeFrame, Decoder.DecodeFrame);
+    std::swap(LastDecodedFrame, Decoder.LastDecodedFrame);
+    std::swap(CurrentFrame, Decoder.CurrentFrame);
+    std::swap(DelayCounter, Decoder.DelayCounter);
+    std::swap(InitialDecode, Decoder.InitialDecode);
+    std::swap(SeekByPos, Decoder.SeekByPos);
+    std::swap(PosOffset, Decoder.PosOffset);
+}
+
+void FFMS_VideoSource::AddDecoder() {
+    // Park the active decoder where it is and make a fresh one active
+    ParkedDecoders.emplace_back();
+    SwapDecoder(ParkedDecoders.back());
+    ParkedDecoders.back().LastUse = ++DecoderUseCounter;
+
+    try {
+        OpenDecoder();
+        if (Seek(0) < 0)
+            throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_CODEC,
+                "Video track is unseekable");
+        CurrentFrame = 0;
+    } catch (FFMS_Exception &) {
+        FreeDecoder();
+        SwapDecoder(ParkedDecoders.back());
+        ParkedDecoders.pop_back();
+        throw;
+    }
+}
+
+bool FFMS_VideoSource::DecodesForwardTo(int n, int TargetFrame, int Position) const {
+    if (n < Position)
+        return false;
+    if (SeekMode == 0)
+        return true;
+    // 10 frames is used as a margin to prevent excessive seeking since the predicted best keyframe isn't always selected by avformat
+    return TargetFrame <= Position + 10 && !(SeekMode == 3 && n > Position + 10);
+}
+
+void FFMS_VideoSource::SelectDecoder(int n) {
+    if (MaxDecoders <= 1 || SeekMode < 0 || Frames.size() <= 1)
+        return;
+
+    int TargetFrame = n;
+    if (SeekMode > 0 && SeekMode < 3)
+        TargetFrame = Frames.FindClosestVideoKeyFrame(n);
+
+    // Use the decoder that gets to n with the least decoding and no seek
+    int Best = -1;
+    int BestDistance = DecodesForwardTo(n, TargetFrame, CurrentFrame) ? n - CurrentFrame : INT_MAX;
+    for (size_t i = 0; i < ParkedDecoders.size(); i++) {
+        int Position = ParkedDecoders[i].CurrentFrame;
+        if (DecodesForwardTo(n, TargetFrame, Position) && n - Position < BestDistance) {
+            Best = static_cast<int>(i);
+            BestDistance = n - Position;
+        }
+    }
+
+    if (BestDistance == INT_MAX) {
+        // All of them would have to seek, so keep their positions if another
+        // decoder may be opened and otherwise give up the least recently used one
+        if (static_cast<int>(ParkedDecoders.size()) + 1 < MaxDecoders) {
+            AddDecoder();
+            return;
+        }
+        Best = 0;
+        for (size_t i = 1; i < ParkedDecoders.size(); i++) {
+            if (ParkedDecoders[i].LastUse < ParkedDecoders[Best].LastUse)
+                Best = static_cast<int>(i);
+        }
+    }
+
+    if (Best >= 0) {
+        SwapDecoder(ParkedDecoders[Best]);
+        ParkedDecoders[Best].LastUse = ++DecoderUseCounter;
+    }
+}
+
+AVFrame *FFMS_VideoSource::FindCachedFrame(int n) {
+    auto Entry = FrameCacheIndex.find(n);
+    if (Entry == FrameCacheIndex.end())
+        return nullptr;
+    FrameCache.splice(FrameCache.begin(), FrameCache, Entry->second);
+    return Entry->second->second;
+}
+
+void FFMS_VideoSource::CacheFrame(int n, AVFrame *Frame) {
+    if (MaxCachedFrames <= 0 || n < 0 || FindCachedFrame(n))
+        return;
+
+    AVFrame *Ref = av_frame_clone(Frame);
+    if (!Ref)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_ALLOCATION_FAILED,
+            "Could not reference cached frame");
+
+    FrameCache.emplace_front(n, Ref);
+    FrameCacheIndex[n] = FrameCache.begin();
+    TrimFrameCache(MaxCachedFrames);
+}
+
+void FFMS_VideoSource::TrimFrameCache(size_t MaxFrames) {
+    while (FrameCache.size() > MaxFrames) {
+        FrameCacheIndex.erase(FrameCache.back().first);
+        av_frame_free(&FrameCache.back().second);
+        FrameCache.pop_back();
+    }
+}
+
+void FFMS_VideoSource::SetCacheOptions(int CachedFrames, int Decoders) {
+    if (CachedFrames < 0 || Decoders < 1)
+        throw FFMS_Exception(FFMS_ERROR_DECODING, FFMS_ERROR_INVALID_ARGUMENT,
+            "Invalid cache options");
+
+    MaxCachedFrames = CachedFrames;
+    MaxDecoders = Decoders;
+
+    // The last output frame may be one of the frames dropped here
+    if (LastFrameFromCache)
+        LastFrameNum = -1;
+    TrimFrameCache(MaxCachedFrames);
+
+    while (static_cast<int>(ParkedDecoders.size()) + 1 > MaxDecoders) {
+        auto Oldest = ParkedDecoders.begin();
+        for (auto Iter = ParkedDecoders.begin(); Iter != ParkedDecoders.end(); ++Iter) {
+            if (Iter->LastUse < Oldest->LastUse)
+                Oldest = Iter;
+        }
+        SwapDecoder(*Oldest);
+        FreeDecoder();
+        SwapDecoder(*Oldest);
+        ParkedDecoders.erase(Oldest);
+    }
+}
+
 FFMS_VideoSource::~FFMS_VideoSource() {
     Free();
 }
@@ -324,6 +587,8 @@ void FFMS_VideoSource::SetOutputFormat(const AVPixelFormat *TargetFormats, int W
 
     ReAdjustOutputFormat(DecodeFrame);
     OutputFrame(DecodeFrame);
+    if (LastFrameFromCache)
+        LastFrameNum = -1;
 }
 
 void FFMS_VideoSource::SetInputFormat(int ColorSpace, int ColorRange, AVPixelFormat Format) {
@@ -339,6 +604,8 @@ void FFMS_VideoSource::SetInputFormat(int ColorSpace, int ColorRange, AVPixelFor
     if (TargetPixelFormats.size()) {
         ReAdjustOutputFormat(DecodeFrame);
         OutputFrame(DecodeFrame);
+        if (LastFrameFromCache)
+            LastFrameNum = -1;
     }
 }
 
@@ -451,6 +718,8 @@ void FFMS_VideoSource::ResetOutputFormat() {
     OutputColorRangeSet = false;
 
     OutputFrame(DecodeFrame);
+    if (LastFrameFromCache)
+        LastFrameNum = -1;
 }
 
 void FFMS_VideoSource::ResetInputFormat() {
@@ -461,6 +730,8 @@ void FFMS_VideoSource::ResetInputFormat() {
 
     ReAdjustOutputFormat(DecodeFrame);
     OutputFrame(DecodeFrame);
+    if (LastFrameFromCache)
+        LastFrameNum = -1;
 }
 
 void FFMS_VideoSource::SetVideoProperties() {
@@ -574,13 +845,16 @@ int FFMS_VideoSource::ReadFrame(AVPacket *pkt) {
 }
 
 void FFMS_VideoSource::Free() {
-    avcodec_free_context(&CodecContext);
-    avformat_close_input(&FormatContext);
+    FreeDecoder();
+    for (auto &Decoder : ParkedDecoders) {
+        SwapDecoder(Decoder);
+        FreeDecoder();
+    }
+    ParkedDecoders.clear();
+    TrimFrameCache(0);
     if (SWS)
         sws_freeContext(SWS);
     av_freep(&SWSFrameData[0]);
-    av_frame_free(&DecodeFrame);
-    av_frame_free(&LastDecodedFrame);
 }
 
 void FFMS_VideoSource::DecodeNextFrame(int64_t &AStartTime, int64_t &Pos) {
@@ -632,8 +906,7 @@ bool FFMS_VideoSource::SeekTo(int n, int SeekOffset) {
                 CurrentFrame = 0;
             }
         } else {
-            // 10 frames is used as a margin to prevent excessive seeking since the predicted best keyframe isn't always selected by avformat
-            if (n < CurrentFrame || TargetFrame > CurrentFrame + 10 || (SeekMode == 3 && n > CurrentFrame + 10)) {
+            if (!DecodesForwardTo(n, TargetFrame, CurrentFrame)) {
                 Seek(TargetFrame);
                 avcodec_flush_buffers(CodecContext);
                 return true;
@@ -653,10 +926,28 @@ FFMS_Frame *FFMS_VideoSource::GetFrame(int n) {
     if (LastFrameNum == n)
         return &LocalFrame;
 
+    if (AVFrame *Cached = FindCachedFrame(n)) {
+        FFMS_Frame *Output = OutputFrame(Cached);
+        LastFrameNum = n;
+        LastFrameFromCache = true;
+        return Output;
+    }
+
+    // LocalFrame may point into a frame that is released below
+    LastFrameNum = -1;
+    LastFrameFromCache = false;
+
+    SelectDecoder(n);
+
     int SeekOffset = 0;
     bool Seek = true;
+    bool Cacheable = false;
 
     do {
+        // Whatever the previous pass decoded is frame CurrentFrame - 1
+        if (Cacheable)
+            CacheFrame(CurrentFrame - 1, DecodeFrame);
+
         bool HasSeeked = false;
         if (Seek) {
             HasSeeked = SeekTo(n, SeekOffset);
@@ -670,6 +961,8 @@ FFMS_Frame *FFMS_VideoSource::GetFrame(int n) {
 
         int64_t StartTime = AV_NOPTS_VALUE, FilePos = -1;
         DecodeNextFrame(StartTime, FilePos);
+        // Frames decoded while skipping aren't necessarily the ones they're counted as
+        Cacheable = CodecContext->skip_frame == AVDISCARD_DEFAULT;
 
         if (!HasSeeked)
             continue;
@@ -697,6 +990,7 @@ FFMS_Frame *FFMS_VideoSource::GetFrame(int n) {
                 // No idea where we are so go back a bit further
                 SeekOffset -= 10;
                 Seek = true;
+                Cacheable = false;
                 continue;
             }
             CurrentFrame = Frames.ClosestFrameFromPTS(StartTime);
@@ -706,15 +1000,12 @@ FFMS_Frame *FFMS_VideoSource::GetFrame(int n) {
         // but what we currently know is the frame number of the first packet
         // we fed into the decoder, and these can be different with open-gop or
         // aggressive (non-keyframe) seeking.
-        int64_t Pos = Frames[CurrentFrame].FilePos;
-        if (CurrentFrame > 0 && Pos != -1) {
-            int Prev = CurrentFrame - 1;
-            while (Prev >= 0 && Frames[Prev].FilePos != -1 && Frames[Prev].FilePos > Pos)
-                --Prev;
-            CurrentFrame = Prev + 1;
-        }
+        CurrentFrame = Frames.FirstFrameStoredAfter(CurrentFrame);
     } while (++CurrentFrame <= n);
 
+    if (Cacheable)
+        CacheFrame(CurrentFrame - 1, DecodeFrame);
+
     LastFrameNum = n;
     return OutputFrame(DecodeFrame);
 }
@@ -31,6 +31,11 @@ extern "C" {
 #include <libavutil/mastering_display_metadata.h>
 }
 
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
 #include <vector>
 
 #include "track.h"
@@ -88,6 +93,44 @@ private:
     int SeekMode;
     bool SeekByPos = false;
     int PosOffset = 0;
+    std::string FileName;
+
+    // Decoded frames kept for random access, most recently used first
+    typedef std::list<std::pair<int, AVFrame *>> FrameCacheList;
+    FrameCacheList FrameCache;
+    std::map<int, FrameCacheList::iterator> FrameCacheIndex;
+    int MaxCachedFrames = 0;
+    bool LastFrameFromCache = false;
+
+    // Decoders other than the active one, each left where its last request ended
+    struct ParkedDecoder {
+        AVCodecContext *CodecContext = nullptr;
+        AVFormatContext *FormatContext = nullptr;
+        AVFrame *DecodeFrame = nullptr;
+        AVFrame *LastDecodedFrame = nullptr;
+        int CurrentFrame = 0;
+        int DelayCounter = 0;
+        int InitialDecode = 1;
+        bool SeekByPos = false;
+        int PosOffset = 0;
+        uint64_t LastUse = 0;
+    };
+    std::vector<ParkedDecoder> ParkedDecoders;
+    int MaxDecoders = 1;
+    uint64_t DecoderUseCounter = 0;
+
+    // Decoder output buffers from the user's allocator, see FFMS_SetFrameAllocatorV
+    struct AllocatedBuffer {
+        FFMS_VideoSource *Owner;
+        void *Opaque;
+        TReleaseFrameCallback Release;
+        void *Private;
+    };
+    TAllocateFrameCallback AllocateFrame = nullptr;
+    TReleaseFrameCallback ReleaseFrame = nullptr;
+    void *AllocatorPrivate = nullptr;
+    std::mutex AllocatedBuffersMutex; // buffers may be freed from the decoder's threads
+    std::set<void *> AllocatedBuffers;
 
     void ReAdjustOutputFormat(AVFrame *Frame);
     FFMS_Frame *OutputFrame(AVFrame *Frame);
@@ -97,6 +140,19 @@ private:
     bool SeekTo(int n, int SeekOffset);
     int Seek(int n);
     int ReadFrame(AVPacket *pkt);
+    void OpenDecoder();
+    void FreeDecoder();
+    void SwapDecoder(ParkedDecoder &Decoder);
+    void AddDecoder();
+    void SelectDecoder(int n);
+    bool DecodesForwardTo(int n, int TargetFrame, int Position) const;
+    AVFrame *FindCachedFrame(int n);
+    void CacheFrame(int n, AVFrame *Frame);
+    void TrimFrameCache(size_t MaxFrames);
+    void RewindDecoder();
+    static int GetBuffer(AVCodecContext *Context, AVFrame *Frame, int Flags);
+    static void FreeBuffer(void *Opaque, uint8_t *Data);
+    void *FindAllocatorOpaque(AVFrame *Frame);
     void Free();
     static void SanityCheckFrameForData(AVFrame *Frame);
 public:
@@ -111,6 +167,8 @@ public:
     void ResetOutputFormat();
     void SetInputFormat(int ColorSpace, int ColorRange, AVPixelFormat Format);
     void ResetInputFormat();
+    void SetCacheOptions(int CachedFrames, int Decoders);
+    void SetFrameAllocator(TAllocateFrameCallback Allocate, TReleaseFrameCallback Release, void *Private);
 };
 
 #endif